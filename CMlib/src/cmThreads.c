@@ -11,12 +11,48 @@ bfekete@ccny.cuny.edu
 *******************************************************************************/
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <sys/time.h>
 #include <signal.h>
 #include <unistd.h>
 #include <cm.h>
 
+const char *CMthreadScheduleStrings [] = { "static", "steal", "dataflow", (char *) NULL };
+const char *CMthreadReportFormatStrings [] = { "csv", "json", (char *) NULL };
+
+static long long _CMthreadClock () {
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((long long) ts.tv_sec * 1000000000LL + (long long) ts.tv_nsec);
+}
+
+// Books one dispatched group (or a group the master ran alone while the workers waited) into the team profile.
+// The imbalance ratio is the sum of the slowest thread's busy time over the sum of the mean busy time per group.
+static void _CMthreadProfileGroup (CMthreadTeam_p team, long long wall, bool serial) {
+	size_t threadId, bin = 0;
+	long long busy, maxBusy = 0, sumBusy = 0, usec;
+
+	for (usec = wall / 1000; (usec > 0) && (bin < CMthreadProfileBins - 1); usec >>= 1) bin++;
+	team->GroupHist [bin]++;
+	team->GroupNum++;
+	team->GroupTime += wall;
+	if (serial) { team->SerialNum++; team->SerialTime += wall; }
+	if (team->ThreadNum <= 1) return;
+	for (threadId = 0; threadId < team->ThreadNum; ++threadId) {
+		busy = serial ? 0 : team->Threads [threadId].GroupBusy;
+		team->Threads [threadId].Busy += busy;
+		team->Threads [threadId].Idle += wall > busy ? wall - busy : 0;
+		if (maxBusy < busy) maxBusy = busy;
+		sumBusy += busy;
+	}
+	if (serial == false) {
+		team->MaxBusy  += maxBusy;
+		team->MeanBusy += sumBusy / (long long) team->ThreadNum;
+	}
+}
+
 size_t CMthreadProcessorNum () {
 	char *procEnv;
 	int procNum;
@@ -57,6 +93,9 @@ CMthreadJob_p CMthreadJobCreate (size_t taskNum, CMthreadUserExecFunc execFunc,
 
 	job->GroupNum  = 1;
 	job->Completed = 0;
+	job->Pending    = (int *)    NULL;
+	job->Counters   = (int *)    NULL;
+	job->ReadyTasks = (size_t *) NULL;
 	job->Sorted    = true;
 	job->TaskNum   = taskNum;
 	for (taskId = 0;taskId < job->TaskNum; ++taskId) {
@@ -93,64 +132,95 @@ CMreturn CMthreadJobTaskDependent (CMthreadJob_p job, size_t taskId, size_t *dep
         job->Tasks [taskId].Dependents[dlink] = job->Tasks + dependents[dlink]; // array of pointers to tasks
     job->Tasks [taskId].NDependents = dlinknum;
     job->Sorted = false;
+    if (job->Pending != (int *) NULL) { free (job->Pending); job->Pending = (int *) NULL; }
 	return (CMsucceeded);
 }
 
-static int _CMthreadJobTaskCompare (const void *lPtr,const void *rPtr) {
-	int ret;
-	CMthreadTask_p lTaskInit = *((CMthreadTask_p *) lPtr);
-	CMthreadTask_p rTaskInit = *((CMthreadTask_p *) rPtr);
-	CMthreadTask_p lTask = lTaskInit;
-	CMthreadTask_p rTask = rTaskInit;
+typedef struct _CMthreadVisit_s {
+    CMthreadTask_p Task;
+    size_t Dep;
+} _CMthreadVisit_t;
 
-	if ((ret = (int) rTask->Travel - (int) lTask->Travel) != 0) return (ret);
-
-    return 0;
-}
-
-static size_t _CMtravel_dist(CMthreadTask_t *task) { // RECURSIVE
-    int depi;
-    size_t travel, maxtravel = 0;
-    if (task->TravelSet) return task->Travel;
-    if (task->Dependents != (CMthreadTask_p *) NULL) {
-        for (depi = 0; depi < task->NDependents; depi++) {
-            travel = _CMtravel_dist(task->Dependents[depi]) + 1;
-            if (travel > maxtravel) maxtravel = travel;
-        }
-    }
-    task->Travel = maxtravel;
-    task->TravelSet = true;
-    return maxtravel;
-}
+#define _CMthreadTravelActive ((size_t) -1)
 
+// Travel is the longest dependence chain from a task down to a task without Dependents. It is computed by a
+// depth first walk with an explicit (heap) stack, so the cost is linear in tasks plus dependencies and long
+// river chains do not overflow the program stack. Tasks are then placed into their groups by counting sort.
 static CMreturn _CMthreadJobTaskSort (CMthreadJob_p job) {
-	size_t taskId, start;
-	size_t travel;
-
-	for (taskId = 0;taskId < job->TaskNum; ++taskId) {
-        if (job->Tasks[taskId].TravelSet) continue;
-        job->Tasks[taskId].Travel = _CMtravel_dist(job->Tasks + taskId);
+	size_t taskId, travel, depth, stackSize = 0, groupId;
+	size_t *offsets;
+	_CMthreadVisit_t *stack = (_CMthreadVisit_t *) NULL, *visit;
+	CMthreadTask_p task, dep;
+
+	for (taskId = 0; taskId < job->TaskNum; ++taskId) {
+		job->Tasks [taskId].Travel    = 0;
+		job->Tasks [taskId].TravelSet = false;
+	}
+	job->GroupNum = job->TaskNum > 0 ? 1 : 0;
+	for (taskId = 0; taskId < job->TaskNum; ++taskId) {
+		if (job->Tasks [taskId].TravelSet) continue;
+		depth = 0;
+		task  = job->Tasks + taskId;
+		do {
+			if (depth == stackSize) {
+				stackSize = stackSize > 0 ? stackSize * 2 : 1024;
+				if ((visit = (_CMthreadVisit_t *) realloc (stack, stackSize * sizeof (_CMthreadVisit_t))) == (_CMthreadVisit_t *) NULL) {
+					CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+					free (stack);
+					return (CMfailed);
+				}
+				stack = visit;
+			}
+			task->Travel = _CMthreadTravelActive;
+			stack [depth].Task = task;
+			stack [depth].Dep  = 0;
+			depth++;
+			task = (CMthreadTask_p) NULL;
+			while ((task == (CMthreadTask_p) NULL) && (depth > 0)) {
+				visit = stack + depth - 1;
+				for ( ; visit->Dep < visit->Task->NDependents; visit->Dep++) {
+					dep = visit->Task->Dependents [visit->Dep];
+					if (dep->TravelSet) continue;
+					if (dep->Travel == _CMthreadTravelActive) {
+						CMmsgPrint (CMmsgAppError,"Circular task dependence at task %d in: %s:%d",(int) dep->Id,__FILE__,__LINE__);
+						free (stack);
+						return (CMfailed);
+					}
+					task = dep;
+					break;
+				}
+				if (task != (CMthreadTask_p) NULL) break;
+				travel = 0;
+				for (visit->Dep = 0; visit->Dep < visit->Task->NDependents; visit->Dep++)
+					if (travel < visit->Task->Dependents [visit->Dep]->Travel + 1) travel = visit->Task->Dependents [visit->Dep]->Travel + 1;
+				visit->Task->Travel    = travel;
+				visit->Task->TravelSet = true;
+				if (job->GroupNum < travel + 1) job->GroupNum = travel + 1;
+				depth--;
+			}
+		} while (task != (CMthreadTask_p) NULL);
 	}
+	if (stack != (_CMthreadVisit_t *) NULL) free (stack);
 
-    qsort (job->SortedTasks,job->TaskNum,sizeof (CMthreadTask_p),_CMthreadJobTaskCompare);
-	job->GroupNum = job->SortedTasks [0]->Travel + 1;
-	if ((job->Groups = (CMthreadTaskGroup_p) realloc (job->Groups, job->GroupNum * sizeof (CMthreadTaskGroup_t))) == (CMthreadTaskGroup_p) NULL) {
+	if ((job->Groups = (CMthreadTaskGroup_p) realloc (job->Groups, (job->GroupNum > 0 ? job->GroupNum : 1) * sizeof (CMthreadTaskGroup_t))) == (CMthreadTaskGroup_p) NULL) {
 		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
 		return (CMfailed);
 	}
-	travel = job->SortedTasks [0]->Travel;
-	start  = 0;
-	for (taskId = 0;taskId < job->TaskNum; ++taskId) {
-		if (travel != job->SortedTasks [taskId]->Travel) {
-			job->Groups [job->GroupNum  - travel - 1].Start = (size_t) start;
-			job->Groups [job->GroupNum  - travel - 1].End   = (size_t) taskId;
-			travel = job->SortedTasks [taskId]->Travel;
-			start = taskId;
-		}
+	if ((offsets = (size_t *) calloc (job->GroupNum + 1, sizeof (size_t))) == (size_t *) NULL) {
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	// The most upstream tasks (largest travel) form the first group
+	for (taskId = 0; taskId < job->TaskNum; ++taskId) offsets [job->GroupNum - job->Tasks [taskId].Travel]++;
+	for (groupId = 0; groupId < job->GroupNum; ++groupId) {
+		offsets [groupId + 1] += offsets [groupId];
+		job->Groups [groupId].Start = offsets [groupId];
+		job->Groups [groupId].End   = offsets [groupId + 1];
 	}
-    job->Groups [job->GroupNum  - travel - 1].Start = (size_t) start;
-    job->Groups [job->GroupNum  - travel - 1].End   = (size_t) taskId;
-    job->Sorted = true;
+	for (taskId = 0; taskId < job->TaskNum; ++taskId)
+		job->SortedTasks [offsets [job->GroupNum - job->Tasks [taskId].Travel - 1]++] = job->Tasks + taskId;
+	free (offsets);
+	job->Sorted = true;
 	return (CMsucceeded);
 }
 
@@ -158,10 +228,114 @@ void CMthreadJobDestroy (CMthreadJob_p job) {
 	size_t group;
 
 	if (job->Groups != (CMthreadTaskGroup_p) NULL) free (job->Groups);
+	if (job->Pending    != (int *)    NULL) free (job->Pending);
+	if (job->Counters   != (int *)    NULL) free (job->Counters);
+	if (job->ReadyTasks != (size_t *) NULL) free (job->ReadyTasks);
 	free (job->Tasks);
 	free (job);
 }
 
+// Each thread owns the [Head,Tail) range of the sorted tasks seeded by CMthreadJobExecute. The owner consumes
+// tasks from the head, while idle threads steal the back half of a victim's remaining range. Tasks are never
+// added during a group, so a thread that finds every deque empty can leave for the group barrier.
+static void _CMthreadWorkSteal (CMthreadTeam_p team, CMthreadData_p data, CMthreadJob_p job) {
+    size_t taskId, threadId, half, head, tail;
+    CMthreadData_p victim;
+
+    do {
+        pthread_mutex_lock (&(data->Mutex));
+        while (data->Head < data->Tail) {
+            taskId = data->Head++;
+            pthread_mutex_unlock (&(data->Mutex));
+            job->UserFunc(data->Id, job->SortedTasks[taskId]->Id, job->CommonData);
+            pthread_mutex_lock (&(data->Mutex));
+        }
+        pthread_mutex_unlock (&(data->Mutex));
+
+        head = tail = 0;
+        for (threadId = 1; threadId < team->ThreadNum; ++threadId) {
+            victim = team->Threads + (data->Id + threadId) % team->ThreadNum;
+            pthread_mutex_lock (&(victim->Mutex));
+            if (victim->Head < victim->Tail) {
+                half = (victim->Tail - victim->Head + 1) / 2;
+                tail = victim->Tail;
+                head = victim->Tail = victim->Tail - half;
+            }
+            pthread_mutex_unlock (&(victim->Mutex));
+            if (head < tail) break;
+        }
+        if (head < tail) {
+            pthread_mutex_lock (&(data->Mutex));
+            data->Head = head;
+            data->Tail = tail;
+            pthread_mutex_unlock (&(data->Mutex));
+        }
+    } while (head < tail);
+}
+
+static CMreturn _CMthreadJobDataflowSetup (CMthreadJob_p job) {
+	size_t taskId, dep;
+
+	if (((job->Pending    = (int *)    calloc (job->TaskNum, sizeof (int)))    == (int *)    NULL) ||
+	    ((job->Counters   = (int *)    realloc (job->Counters,   job->TaskNum * sizeof (int)))    == (int *)    NULL) ||
+	    ((job->ReadyTasks = (size_t *) realloc (job->ReadyTasks, job->TaskNum * sizeof (size_t))) == (size_t *) NULL)) {
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+		if (job->Pending != (int *) NULL) { free (job->Pending); job->Pending = (int *) NULL; }
+		return (CMfailed);
+	}
+	for (taskId = 0; taskId < job->TaskNum; ++taskId)
+		for (dep = 0; dep < job->Tasks [taskId].NDependents; ++dep)
+			job->Pending [job->Tasks [taskId].Dependents [dep]->Id]++;
+	return (CMsucceeded);
+}
+
+static void _CMthreadDataflowPush (CMthreadTeam_p team, CMthreadJob_p job, size_t taskId) {
+	pthread_mutex_lock   (&(team->RMutex));
+	job->ReadyTasks [job->ReadyTail++] = taskId;
+	pthread_cond_signal  (&(team->RCond));
+	pthread_mutex_unlock (&(team->RMutex));
+}
+
+// Workers claim batches of ready tasks from the shared queue. Finishing a task counts down the readiness
+// counter of each of its Dependents; the first one that becomes ready is run right away by the same thread
+// (following the chain downstream keeps its inputs in cache) and the rest are queued for the team.
+static void _CMthreadWorkDataflow (CMthreadTeam_p team, CMthreadData_p data, CMthreadJob_p job) {
+	size_t slot, head, tail, batch, taskId, nextId = 0, dep;
+	bool next;
+	CMthreadTask_p task;
+
+	do {
+		pthread_mutex_lock (&(team->RMutex));
+		while ((job->ReadyHead == job->ReadyTail) && (__atomic_load_n (&(job->Remaining), __ATOMIC_ACQUIRE) > 0))
+			pthread_cond_wait (&(team->RCond), &(team->RMutex));
+		batch = (job->ReadyTail - job->ReadyHead) / (2 * team->ThreadNum);
+		batch = batch < 1 ? 1 : (batch > 64 ? 64 : batch);
+		head  = job->ReadyHead;
+		tail  = job->ReadyHead = head + batch < job->ReadyTail ? head + batch : job->ReadyTail;
+		pthread_mutex_unlock (&(team->RMutex));
+
+		for (slot = head; slot < tail; ++slot) {
+			taskId = job->ReadyTasks [slot];
+			do {
+				job->UserFunc (data->Id, taskId, job->CommonData);
+				task = job->Tasks + taskId;
+				next = false;
+				for (dep = 0; dep < task->NDependents; ++dep) {
+					if (__atomic_sub_fetch (job->Counters + task->Dependents [dep]->Id, 1, __ATOMIC_ACQ_REL) > 0) continue;
+					if (next) _CMthreadDataflowPush (team, job, task->Dependents [dep]->Id);
+					else { nextId = task->Dependents [dep]->Id; next = true; }
+				}
+				if (__atomic_sub_fetch (&(job->Remaining), 1, __ATOMIC_ACQ_REL) == 0) {
+					pthread_mutex_lock     (&(team->RMutex));
+					pthread_cond_broadcast (&(team->RCond));
+					pthread_mutex_unlock   (&(team->RMutex));
+				}
+				taskId = nextId;
+			} while (next);
+		}
+	} while (head < tail);
+}
+
 static void *_CMthreadWork (void *dataPtr) {
 	CMthreadData_p data = (CMthreadData_p) dataPtr;
 	size_t taskId, start, end, chunkSize, threadNum, workerNum, num, completed;
@@ -172,33 +346,41 @@ static void *_CMthreadWork (void *dataPtr) {
     struct timeval  tValue;
     struct timezone tZone;
 
+    size_t generation = 0;
+    long long busyStart = 0;
+
     pthread_mutex_lock (&(team->SMutex));
     do {
-        pthread_cond_wait (&(team->SCond), &(team->SMutex));
+        while (team->Generation == generation) pthread_cond_wait (&(team->SCond), &(team->SMutex));
+        generation = team->Generation;
         job = team->JobPtr;
         if (job != (CMthreadJob_p) NULL) {
             pthread_mutex_unlock(&(team->SMutex));
             gettimeofday(&tValue, &tZone);
             startTime = tValue.tv_sec * 1000000 + tValue.tv_usec;
+            if (team->Profile) busyStart = _CMthreadClock ();
 
-            start = job->Groups[job->GroupID].Start;
-            end   = job->Groups[job->GroupID].End;
-            threadNum = end - start < team->ThreadNum ? end - start : team->ThreadNum;
-            chunkSize = (size_t) ceil ((double) (end - start) / (double) threadNum);
-            start = start + data->Id * chunkSize;
-            end   = start + chunkSize < end ? start + chunkSize : end;
-            for (taskId = start; taskId < end; ++taskId) {
-                job->UserFunc(data->Id, job->SortedTasks[taskId]->Id, job->CommonData);
+            if      (team->Schedule == CMthreadScheduleDataflow) _CMthreadWorkDataflow (team, data, job);
+            else if (team->Schedule == CMthreadScheduleSteal)    _CMthreadWorkSteal    (team, data, job);
+            else {
+                start = job->Groups[job->GroupID].Start;
+                end   = job->Groups[job->GroupID].End;
+                threadNum = end - start < team->ThreadNum ? end - start : team->ThreadNum;
+                chunkSize = (size_t) ceil ((double) (end - start) / (double) threadNum);
+                start = start + data->Id * chunkSize;
+                end   = start + chunkSize < end ? start + chunkSize : end;
+                for (taskId = start; taskId < end; ++taskId) {
+                    job->UserFunc(data->Id, job->SortedTasks[taskId]->Id, job->CommonData);
+                }
             }
+            if (team->Profile) data->GroupBusy = _CMthreadClock () - busyStart;
             gettimeofday(&tValue, &tZone);
             data->Time += (tValue.tv_sec * 1000000 + tValue.tv_usec - startTime);
-            pthread_mutex_lock (&(team->SMutex));
+            pthread_mutex_lock (&(team->MMutex));
             job->Completed++;
-            if (job->Completed == team->ThreadNum) {
-                pthread_mutex_lock   (&(team->MMutex));
-                pthread_cond_signal  (&(team->MCond));
-                pthread_mutex_unlock (&(team->MMutex));
-            }
+            if (job->Completed == team->ThreadNum) pthread_cond_signal (&(team->MCond));
+            pthread_mutex_unlock (&(team->MMutex));
+            pthread_mutex_lock (&(team->SMutex));
         }
     } while (job != (CMthreadJob_p) NULL);
     pthread_mutex_unlock (&(team->SMutex));
@@ -206,8 +388,8 @@ static void *_CMthreadWork (void *dataPtr) {
 }
 
 CMreturn CMthreadJobExecute (CMthreadTeam_p team, CMthreadJob_p job) {
-    size_t taskId, groupID, start, end;
-    long long startTime, localStart;
+    size_t taskId, groupID, start, end, threadId, chunkSize;
+    long long startTime, localStart, groupStart = 0;
     struct timeval  tValue;
     struct timezone tZone;
 
@@ -215,7 +397,7 @@ CMreturn CMthreadJobExecute (CMthreadTeam_p team, CMthreadJob_p job) {
     startTime = tValue.tv_sec * 1000000 + tValue.tv_usec;
 
     if (job->Sorted == false) {
-        _CMthreadJobTaskSort(job);
+        if (_CMthreadJobTaskSort(job) == CMfailed) return (CMfailed);
         gettimeofday(&tValue, &tZone);
         team->ExecTime += (tValue.tv_sec * 1000000 + tValue.tv_usec - startTime);
     }
@@ -228,26 +410,57 @@ CMreturn CMthreadJobExecute (CMthreadTeam_p team, CMthreadJob_p job) {
         for (groupID = 0; groupID < job->GroupNum; groupID++){
             start = job->Groups[groupID].Start;
             end   = job->Groups[groupID].End;
+            if (team->Profile) groupStart = _CMthreadClock ();
             for (taskId = start; taskId < end; ++taskId) job->UserFunc(0, job->SortedTasks[taskId]->Id, job->CommonData);
+            if (team->Profile) _CMthreadProfileGroup (team, _CMthreadClock () - groupStart, false);
         }
         gettimeofday(&tValue, &tZone);
         team->Time += (tValue.tv_sec * 1000000 + tValue.tv_usec - localStart);
     }
+    else if (team->Schedule == CMthreadScheduleDataflow) {
+        if ((job->Pending == (int *) NULL) && (_CMthreadJobDataflowSetup (job) == CMfailed)) return (CMfailed);
+        pthread_mutex_lock (&(team->SMutex));
+        memcpy (job->Counters, job->Pending, job->TaskNum * sizeof (int));
+        job->ReadyHead = job->ReadyTail = 0;
+        for (taskId = 0; taskId < job->TaskNum; ++taskId)
+            if (job->Pending [taskId] == 0) job->ReadyTasks [job->ReadyTail++] = taskId;
+        job->Remaining = job->TaskNum;
+        job->Completed = 0;
+        team->JobPtr = (void *) job;
+        team->Generation++;
+        if (team->Profile) groupStart = _CMthreadClock ();
+        pthread_cond_broadcast (&(team->SCond));
+        pthread_mutex_unlock   (&(team->SMutex));
+        while (job->Completed < team->ThreadNum) pthread_cond_wait (&(team->MCond), &(team->MMutex));
+        if (team->Profile) _CMthreadProfileGroup (team, _CMthreadClock () - groupStart, false);
+    }
     else {
         for (groupID = 0; groupID < job->GroupNum; groupID++) {
             start = job->Groups[groupID].Start;
             end   = job->Groups[groupID].End;
             if (end - start < team->ThreadNum) {
+                if (team->Profile) groupStart = _CMthreadClock ();
                 for (taskId = start; taskId < end; ++taskId) job->UserFunc(0, job->SortedTasks[taskId]->Id, job->CommonData);
+                if (team->Profile) _CMthreadProfileGroup (team, _CMthreadClock () - groupStart, true);
             }
             else {
                 pthread_mutex_lock     (&(team->SMutex));
+                if (team->Schedule == CMthreadScheduleSteal) {
+                    chunkSize = (size_t) ceil ((double) (end - start) / (double) team->ThreadNum);
+                    for (threadId = 0; threadId < team->ThreadNum; ++threadId) {
+                        team->Threads[threadId].Head = start + threadId * chunkSize < end ? start + threadId * chunkSize : end;
+                        team->Threads[threadId].Tail = team->Threads[threadId].Head + chunkSize < end ? team->Threads[threadId].Head + chunkSize : end;
+                    }
+                }
                 job->Completed = 0;
                 job->GroupID = groupID;
                 team->JobPtr = (void *) job;
+                team->Generation++;
+                if (team->Profile) groupStart = _CMthreadClock ();
                 pthread_cond_broadcast (&(team->SCond));
                 pthread_mutex_unlock   (&(team->SMutex));
-                pthread_cond_wait (&(team->MCond), &(team->MMutex));
+                while (job->Completed < team->ThreadNum) pthread_cond_wait (&(team->MCond), &(team->MMutex));
+                if (team->Profile) _CMthreadProfileGroup (team, _CMthreadClock () - groupStart, false);
             }
         }
     }
@@ -271,11 +484,14 @@ CMthreadTeam_p CMthreadTeamCreate (size_t threadNum) {
     gettimeofday(&tValue, &tZone);
     team->TotTime = tValue.tv_sec * 1000000 + tValue.tv_usec;
 	team->ThreadNum      = threadNum;
+	team->Schedule       = CMthreadScheduleStatic;
+	team->Generation     = 0;
 	team->JobPtr         = (void *) NULL;
     team->ExecTime       = 0;
     team->ThreadTime     = 0;
     team->Threads        = (CMthreadData_p) NULL;
     team->Time           = 0;
+    CMthreadTeamSetProfile (team, false);
 
     if (team->ThreadNum > 1) {
         if ((team->Threads = (CMthreadData_p) calloc (threadNum, sizeof(CMthreadData_t))) == (CMthreadData_p) NULL) {
@@ -290,10 +506,15 @@ CMthreadTeam_p CMthreadTeamCreate (size_t threadNum) {
         pthread_cond_init  (&(team->MCond),  NULL);
         pthread_mutex_init (&(team->SMutex), NULL);
         pthread_cond_init  (&(team->SCond),  NULL);
+        pthread_mutex_init (&(team->RMutex), NULL);
+        pthread_cond_init  (&(team->RCond),  NULL);
         for (threadId = 0; threadId < team->ThreadNum; ++threadId) {
             team->Threads[threadId].Id      = threadId;
             team->Threads[threadId].TeamPtr = (void *) team;
             team->Threads[threadId].Time    = 0;
+            team->Threads[threadId].Head    = 0;
+            team->Threads[threadId].Tail    = 0;
+            pthread_mutex_init (&(team->Threads[threadId].Mutex), NULL);
             if ((ret = pthread_create(&(team->Threads[threadId].Thread), &thread_attr, _CMthreadWork,
                                       (void *) (team->Threads + threadId))) != 0) {
                 CMmsgPrint(CMmsgSysError, "Thread creation returned with error [%d] in %s:%d", ret, __FILE__, __LINE__);
@@ -310,7 +531,46 @@ CMthreadTeam_p CMthreadTeamCreate (size_t threadNum) {
 	return (team);
 }
 
+CMreturn CMthreadTeamSetSchedule (CMthreadTeam_p team, CMthreadSchedule schedule) {
+    switch (schedule) {
+        case CMthreadScheduleStatic:
+        case CMthreadScheduleSteal:
+        case CMthreadScheduleDataflow: break;
+        default:
+            CMmsgPrint (CMmsgAppError,"Invalid thread schedule [%d] in %s:%d",(int) schedule,__FILE__,__LINE__);
+            return (CMfailed);
+    }
+    team->Schedule = schedule;
+    return (CMsucceeded);
+}
+
+void CMthreadTeamSetProfile (CMthreadTeam_p team, bool profile) {
+    size_t threadId, bin;
+
+    team->Profile    = profile;
+    team->GroupNum   = team->SerialNum = 0;
+    team->GroupTime  = team->SerialTime = 0;
+    team->MaxBusy    = team->MeanBusy = 0;
+    for (bin = 0; bin < CMthreadProfileBins; ++bin) team->GroupHist [bin] = 0;
+    if (team->Threads != (CMthreadData_p) NULL)
+        for (threadId = 0; threadId < team->ThreadNum; ++threadId)
+            team->Threads [threadId].Busy = team->Threads [threadId].Idle = team->Threads [threadId].GroupBusy = 0;
+}
+
+static double _CMthreadImbalance (CMthreadTeam_p team) {
+    return (team->MeanBusy > 0 ? (double) team->MaxBusy / (double) team->MeanBusy : 1.0);
+}
+
+static long long _CMthreadBusy (CMthreadTeam_p team, size_t threadId) {
+    return (team->ThreadNum > 1 ? team->Threads [threadId].Busy : team->GroupTime);
+}
+
+static long long _CMthreadIdle (CMthreadTeam_p team, size_t threadId) {
+    return (team->ThreadNum > 1 ? team->Threads [threadId].Idle : 0);
+}
+
 void CMthreadTeamPrintReport (CMmsgType msgType, CMthreadTeam_p team) {
+    size_t threadId, threadNum = team->ThreadNum > 1 ? team->ThreadNum : 1;
     struct timeval  tValue;
     struct timezone tZone;
 
@@ -321,6 +581,68 @@ void CMthreadTeamPrintReport (CMmsgType msgType, CMthreadTeam_p team) {
                 (float) team->ExecTime   / 1000000.0,
                 (float) team->ThreadTime / (team->ThreadNum > 0 ? (float) team->ThreadNum : 1.0) / 1000000.0,
                 (float) team->Time       / 1000000.0);
+    if (team->Profile == false) return;
+    CMmsgPrint (msgType,"Groups: %d (%.3f s), Serial Groups: %d (%.3f s), Imbalance: %.3f",
+                (int) team->GroupNum,  (double) team->GroupTime  / 1e9,
+                (int) team->SerialNum, (double) team->SerialTime / 1e9, _CMthreadImbalance (team));
+    for (threadId = 0; threadId < threadNum; ++threadId)
+        CMmsgPrint (msgType,"Thread %d Busy: %.3f s, Idle: %.3f s", (int) threadId,
+                    (double) _CMthreadBusy (team, threadId) / 1e9, (double) _CMthreadIdle (team, threadId) / 1e9);
+}
+
+// Writes the profile collected since CMthreadTeamSetProfile. Times are in seconds, histogram bins are labeled
+// with their upper bound in microseconds (the last bin is open ended).
+CMreturn CMthreadTeamWriteReport (CMthreadTeam_p team, CMthreadReportFormat format, FILE *outFile) {
+    size_t threadId, bin, binNum = 0, threadNum = team->ThreadNum > 1 ? team->ThreadNum : 1;
+
+    if (team->Profile == false) {
+        CMmsgPrint (CMmsgAppError,"Thread profiling is not enabled in %s:%d",__FILE__,__LINE__);
+        return (CMfailed);
+    }
+    switch (format) {
+        case CMthreadReportCSV:
+            fprintf (outFile,"\"Section\",\"Id\",\"Metric\",\"Value\"\n");
+            fprintf (outFile,"\"Team\",,\"ThreadNum\",%d\n",      (int) threadNum);
+            fprintf (outFile,"\"Team\",,\"Schedule\",\"%s\"\n", CMthreadScheduleStrings [team->Schedule]);
+            fprintf (outFile,"\"Team\",,\"ExecuteTime\",%.6f\n",  (double) team->ExecTime   / 1e6);
+            fprintf (outFile,"\"Team\",,\"Groups\",%d\n",         (int) team->GroupNum);
+            fprintf (outFile,"\"Team\",,\"GroupTime\",%.6f\n",    (double) team->GroupTime  / 1e9);
+            fprintf (outFile,"\"Team\",,\"SerialGroups\",%d\n",   (int) team->SerialNum);
+            fprintf (outFile,"\"Team\",,\"SerialTime\",%.6f\n",   (double) team->SerialTime / 1e9);
+            fprintf (outFile,"\"Team\",,\"Imbalance\",%.6f\n",    _CMthreadImbalance (team));
+            for (threadId = 0; threadId < threadNum; ++threadId) {
+                fprintf (outFile,"\"Thread\",%d,\"Busy\",%.6f\n", (int) threadId, (double) _CMthreadBusy (team, threadId) / 1e9);
+                fprintf (outFile,"\"Thread\",%d,\"Idle\",%.6f\n", (int) threadId, (double) _CMthreadIdle (team, threadId) / 1e9);
+            }
+            for (bin = 0; bin < CMthreadProfileBins; ++bin)
+                if (team->GroupHist [bin] > 0)
+                    fprintf (outFile,"\"GroupHistogram\",%lld,\"Count\",%d\n", 1LL << bin, (int) team->GroupHist [bin]);
+            break;
+        case CMthreadReportJSON:
+            fprintf (outFile,"{\n");
+            fprintf (outFile,"  \"threadNum\": %d,\n",      (int) threadNum);
+            fprintf (outFile,"  \"schedule\": \"%s\",\n", CMthreadScheduleStrings [team->Schedule]);
+            fprintf (outFile,"  \"executeTime\": %.6f,\n",  (double) team->ExecTime   / 1e6);
+            fprintf (outFile,"  \"groups\": %d,\n",         (int) team->GroupNum);
+            fprintf (outFile,"  \"groupTime\": %.6f,\n",    (double) team->GroupTime  / 1e9);
+            fprintf (outFile,"  \"serialGroups\": %d,\n",   (int) team->SerialNum);
+            fprintf (outFile,"  \"serialTime\": %.6f,\n",   (double) team->SerialTime / 1e9);
+            fprintf (outFile,"  \"imbalance\": %.6f,\n",    _CMthreadImbalance (team));
+            fprintf (outFile,"  \"threads\": [");
+            for (threadId = 0; threadId < threadNum; ++threadId)
+                fprintf (outFile,"%s\n    { \"id\": %d, \"busy\": %.6f, \"idle\": %.6f }", threadId > 0 ? "," : "", (int) threadId,
+                         (double) _CMthreadBusy (team, threadId) / 1e9, (double) _CMthreadIdle (team, threadId) / 1e9);
+            fprintf (outFile,"\n  ],\n  \"groupHistogram\": [");
+            for (bin = 0; bin < CMthreadProfileBins; ++bin)
+                if (team->GroupHist [bin] > 0)
+                    fprintf (outFile,"%s\n    { \"maxMicroSec\": %lld, \"count\": %d }", binNum++ > 0 ? "," : "", 1LL << bin, (int) team->GroupHist [bin]);
+            fprintf (outFile,"\n  ]\n}\n");
+            break;
+        default:
+            CMmsgPrint (CMmsgAppError,"Invalid report format [%d] in %s:%d",(int) format,__FILE__,__LINE__);
+            return (CMfailed);
+    }
+    return (ferror (outFile) ? CMfailed : CMsucceeded);
 }
 
 void CMthreadTeamDelete (CMthreadTeam_p team) {
@@ -328,18 +650,22 @@ void CMthreadTeamDelete (CMthreadTeam_p team) {
     void *status;
 
     if (team->ThreadNum > 1) {
-        team->JobPtr = (CMthreadJob_p) NULL;
         pthread_mutex_lock     (&(team->SMutex));
+        team->JobPtr = (CMthreadJob_p) NULL;
+        team->Generation++;
         pthread_cond_broadcast (&(team->SCond));
         pthread_mutex_unlock   (&(team->SMutex));
         for (threadId = 0; threadId < team->ThreadNum; ++threadId) {
             pthread_join(team->Threads[threadId].Thread, &status);
             team->ThreadTime += team->Threads[threadId].Time;
+            pthread_mutex_destroy(&(team->Threads[threadId].Mutex));
         }
         pthread_mutex_unlock (&(team->MMutex));
         pthread_mutex_destroy(&(team->MMutex));
         pthread_mutex_destroy(&(team->SMutex));
         pthread_cond_destroy (&(team->SCond));
+        pthread_mutex_destroy(&(team->RMutex));
+        pthread_cond_destroy (&(team->RCond));
         free(team->Threads);
     }
     free (team);
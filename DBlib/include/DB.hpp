@@ -102,6 +102,7 @@ bfekete@ccny.cuny.edu
 #define DBObjectFlagSelected              ((DBInt) (0x01 << 0x03))
 #define DBObjectFlagLocked                ((DBInt) (0x01 << 0x04))
 #define DBObjectFlagChanged               ((DBInt) (0x01 << 0x04))
+#define DBObjectFlagPooled                ((DBInt) (0x01 << 0x05))
 
 #define DBDataLISTFlagSmartSort           0x10000000L
 
@@ -167,19 +168,48 @@ void DBByteOrderSwapLongWord(void *);
 
 void DBByteOrderSwapCoordinate(void *);
 
+class DBObjArena {
+private:
+    char *ChunkPTR;
+    size_t UsedVAR;
+    size_t SizeVAR;
+
+    void *Grow(size_t);
+
+public:
+    DBObjArena() {
+        ChunkPTR = (char *) NULL;
+        UsedVAR = SizeVAR = 0;
+    }
+
+    ~DBObjArena();
+
+    void *Allocate(size_t size) {
+        void *ptr;
+        size = (size + 0x07) & ~((size_t) 0x07);
+        if (UsedVAR + size > SizeVAR) return (Grow(size));
+        ptr = ChunkPTR + UsedVAR;
+        UsedVAR += size;
+        return (ptr);
+    }
+};
+
 class DBVarString {
 private:
     DBShort LengthVAR;
+    DBShort PooledVAR;
     DBAddress StringPTR;
 public:
     DBVarString() {
         StringPTR = (DBAddress) NULL;
         LengthVAR = 0;
+        PooledVAR = false;
     }
 
-    ~DBVarString() { if (StringPTR != (DBAddress) NULL) free((char *) NULL + StringPTR); }
+    ~DBVarString() { if ((StringPTR != (DBAddress) NULL) && !PooledVAR) free((char *) NULL + StringPTR); }
 
     DBVarString(const DBVarString &string) {
+        PooledVAR = false;
         if ((StringPTR = (DBAddress) ((char *) malloc(string.VStrLength() + 1) - (char *) NULL)) == (DBAddress) NULL)
             perror("Memory Allocation Error in: DBVarString::String ()");
         else {
@@ -193,6 +223,10 @@ public:
     DBInt VString(const char *string, DBInt len) {
         for (; len > 0; --len) if (string[len - 1] != ' ') break;
 
+        if (PooledVAR) { // The arena owns the old string, so the new one starts a heap allocation of its own
+            StringPTR = (DBAddress) NULL;
+            PooledVAR = false;
+        }
         if ((StringPTR = (DBAddress) (realloc((void *) StringPTR, len + 1))) == (DBAddress) NULL) {
             perror("Memory Allocation Error in: DBVarString::String ()");
             return (DBFault);
@@ -209,7 +243,9 @@ public:
 
     void Swap() { DBByteOrderSwapHalfWord(&LengthVAR); }
 
-    int Read(FILE *, int);
+    int Read(FILE *file, int swap) { return (Read(file, swap, (DBObjArena *) NULL)); }
+
+    int Read(FILE *, int, DBObjArena *);
 
     int Write(FILE *);
 };
@@ -637,14 +673,20 @@ class DBObjectHeader {
 private:
     DBInt RowIdVAR;
     DBInt ListPosVAR;
+    DBUnsigned *RenamePTR; // Rename counter of the list holding the object, which keeps the list's name index current
 public:
-    DBObjectHeader() { RowIdVAR = ListPosVAR = DBFault; }
+    DBObjectHeader() { RowIdVAR = ListPosVAR = DBFault; RenamePTR = (DBUnsigned *) NULL; }
 
     DBObjectHeader(const DBObjectHeader &objHeader) {
         RowIdVAR = objHeader.RowIdVAR;
         ListPosVAR = objHeader.ListPosVAR;
+        RenamePTR = (DBUnsigned *) NULL;
     }
 
+    void RenameCounter(DBUnsigned *counter) { RenamePTR = counter; }
+
+    void Renamed() { if (RenamePTR != (DBUnsigned *) NULL) ++(*RenamePTR); }
+
     DBInt RowID(void) const { return (RowIdVAR); }
 
     void RowID(DBInt id) { RowIdVAR = id; }
@@ -692,9 +734,9 @@ public:
 
     char *Name(void) const { return (NameSTR.VString()); }
 
-    void Name(const char *name) { NameSTR.VString(name); }
+    void Name(const char *name) { NameSTR.VString(name); Renamed(); }
 
-    void Name(const char *name, DBInt len) { NameSTR.VString(name, len); }
+    void Name(const char *name, DBInt len) { NameSTR.VString(name, len); Renamed(); }
 
     DBUnsigned Size(void) const { return (SizeVAR); }
 
@@ -704,7 +746,9 @@ public:
 
     void Flags(DBUnsigned flags, DBInt set) { FlagsVAR = set ? FlagsVAR | flags : FlagsVAR & (~flags); }
 
-    int Read(FILE *, int);
+    int Read(FILE *file, int swap) { return (Read(file, swap, (DBObjArena *) NULL)); }
+
+    int Read(FILE *, int, DBObjArena *);
 
     int Write(FILE *);
 };
@@ -745,9 +789,10 @@ public:
         Rest2x16VAR = record.Rest2x16VAR;
         DataPTR = (DBAddress) ((char *) malloc(Length()) - (char *) NULL);
         memcpy((char *) NULL + DataPTR, (char *) NULL + record.DataPTR, Length());
+        Flags(DBObjectFlagPooled, DBClear);
     }
 
-    ~DBObjRecord() { if (DataPTR != (DBAddress) NULL) free((void *) DataPTR); }
+    ~DBObjRecord() { if ((DataPTR != (DBAddress) NULL) && ((Flags() & DBObjectFlagPooled) != DBObjectFlagPooled)) free((void *) DataPTR); }
 
     void *Data() const { return ((void *) DataPTR); }
 
@@ -762,6 +807,12 @@ public:
     }
 
     void Realloc(size_t size) {
+        if ((Flags() & DBObjectFlagPooled) == DBObjectFlagPooled) { // Pooled data moves to the heap before resizing
+            void *data = malloc(size > Length() ? size : Length());
+            if (data != (void *) NULL) memcpy(data, (char *) NULL + DataPTR, Length());
+            DataPTR = (DBAddress) ((char *) data - (char *) NULL);
+            Flags(DBObjectFlagPooled, DBClear);
+        }
         if (size > 0) {
             DataPTR = (DBAddress) ((char *) realloc((char *) NULL + DataPTR, size) - (char *) NULL);
             Lower32VAR = DataPTR == (DBAddress) NULL ? 0 : (size & 0xFFFFFFFFL);
@@ -775,13 +826,21 @@ public:
         }
     }
 
-    int Read(FILE *, int);
+    int Read(FILE *file, int swap) { return (Read(file, swap, (DBObjArena *) NULL)); }
+
+    int Read(FILE *, int, DBObjArena *);
 
     int Write(FILE *);
 };
 
 int _DBObjectLISTNameSort(const DBObject **, const DBObject **);
 
+DBUnsigned _DBObjectLISTNameHash(const char *);
+
+extern pthread_mutex_t _DBObjectLISTHashMutex;
+
+#define DBObjectLISTHashMin 16
+
 int _DBObjectLISTNameReversedSort(const DBObject **, const DBObject **);
 
 template<class Object>
@@ -794,6 +853,10 @@ private:
     DBInt DummyVAR;
     DBAddress ItemsPTR;
     DBAddress ListPTR;
+    DBInt *HashPTR;
+    DBInt HashSizeVAR;
+    DBUnsigned HashGenerationVAR;
+    DBUnsigned RenameVAR; // Bumped by the items when they are renamed (see DBObjectHeader::RenameCounter)
 
     void Swap() {
         DBByteOrderSwapWord(&NumVAR);
@@ -801,19 +864,93 @@ private:
         DBByteOrderSwapWord(&IndexVAR);
     }
 
+    // Only the counters are stored in files, the item arrays and the name index are rebuilt on load
+    size_t StoredSize() const { return ((size_t) ((char *) &ItemsPTR - ((char *) this + sizeof(DBObject)))); }
+
+    void HashReset() {
+        if (HashPTR != (DBInt *) NULL) free(HashPTR);
+        HashPTR = (DBInt *) NULL;
+        HashSizeVAR = 0;
+    }
+
+    void FreeAll() {
+        if (NumVAR > 0) {
+            free((void *) ItemsPTR);
+            free((void *) ListPTR);
+        }
+        ItemsPTR   = ListPTR = (DBAddress) NULL;
+        CurrentVAR = NumVAR = 0;
+        HashReset();
+    }
+
+    void HashInsert(DBInt *hash, DBInt hashSize, DBInt rowID) {
+        DBUnsigned slot;
+        const char *name = ((Object **) ((char *) NULL + ItemsPTR))[rowID]->Name();
+
+        for (slot = _DBObjectLISTNameHash(name) & (hashSize - 1); hash[slot] != DBFault; slot = (slot + 1) & (hashSize - 1))
+            if (strcmp(((Object **) ((char *) NULL + ItemsPTR))[hash[slot]]->Name(), name) == 0) return; // First row wins like the linear scan
+        hash[slot] = rowID;
+    }
+
+    bool HashReady() {
+        return ((__atomic_load_n(&HashPTR, __ATOMIC_ACQUIRE) != (DBInt *) NULL) && (HashGenerationVAR == RenameVAR));
+    }
+
+    // Lookups only read the list, so several threads may look names up at once: the index is built under a lock
+    // into a new table that is published when complete. Changing the list while others look it up is not safe.
+    DBInt HashBuild() {
+        DBInt i, hashSize, *hash, *oldHash;
+
+        pthread_mutex_lock(&_DBObjectLISTHashMutex);
+        if (!HashReady()) {
+            for (hashSize = DBObjectLISTHashMin * 2; hashSize < NumVAR * 2; hashSize <<= 1);
+            if ((hash = (DBInt *) malloc(hashSize * sizeof(DBInt))) == (DBInt *) NULL) {
+                pthread_mutex_unlock(&_DBObjectLISTHashMutex);
+                return (DBFault);
+            }
+            for (i = 0; i < hashSize; ++i) hash[i] = DBFault;
+            for (i = 0; i < NumVAR; ++i) HashInsert(hash, hashSize, i);
+            oldHash = HashPTR;
+            __atomic_store_n(&HashPTR, (DBInt *) NULL, __ATOMIC_RELEASE);
+            HashSizeVAR = hashSize;
+            HashGenerationVAR = RenameVAR;
+            __atomic_store_n(&HashPTR, hash, __ATOMIC_RELEASE);
+            if (oldHash != (DBInt *) NULL) free(oldHash);
+        }
+        pthread_mutex_unlock(&_DBObjectLISTHashMutex);
+        return (DBSuccess);
+    }
+
+    DBInt HashFind(const char *name) {
+        DBUnsigned slot;
+
+        for (slot = _DBObjectLISTNameHash(name) & (HashSizeVAR - 1); HashPTR[slot] != DBFault; slot = (slot + 1) & (HashSizeVAR - 1))
+            if (strcmp(((Object **) ((char *) NULL + ItemsPTR))[HashPTR[slot]]->Name(), name) == 0) return (HashPTR[slot]);
+        return (NumVAR);
+    }
+
 public:
     DBObjectLIST(const char *name) : DBObject(name, sizeof(DBObjectLIST)) {
         ItemsPTR = ListPTR = (DBAddress) NULL;
         NumVAR = CurrentVAR = 0;
+        HashPTR = (DBInt *) NULL;
+        HashSizeVAR = 0;
+        HashGenerationVAR = RenameVAR = 0;
     }
 
     DBObjectLIST(const char *name, DBUnsigned size) : DBObject(name, size) {
         ItemsPTR = ListPTR = (DBAddress) NULL;
         NumVAR = CurrentVAR = 0;
+        HashPTR = (DBInt *) NULL;
+        HashSizeVAR = 0;
+        HashGenerationVAR = RenameVAR = 0;
     }
 
     DBObjectLIST(const DBObjectLIST &objList) : DBObject(objList) {
         DBInt i;
+        HashPTR = (DBInt *) NULL;
+        HashSizeVAR = 0;
+        HashGenerationVAR = RenameVAR = 0;
         NumVAR = objList.NumVAR;
         CurrentVAR = objList.CurrentVAR;
         IndexVAR = objList.IndexVAR;
@@ -828,10 +965,14 @@ public:
             ((Object **) ((char *) NULL + ListPTR))[i] = new Object(
                     *(((Object **) ((char *) NULL + objList.ItemsPTR))[i]));
             ((Object **) ((char *) NULL + ListPTR))[i]->ListPos(i);
+            ((Object **) ((char *) NULL + ListPTR))[i]->RenameCounter(&RenameVAR);
         }
     }
 
-    ~DBObjectLIST() { DeleteAll(); }
+    ~DBObjectLIST() {
+        DeleteAll();
+        HashReset();
+    }
 
     Object *Item() {
         return (CurrentVAR != NumVAR ? ((Object **) ((char *) NULL + ItemsPTR))[CurrentVAR] : (Object *) NULL);
@@ -848,7 +989,14 @@ public:
     Object *Item(const char *name, DBInt setCurrent) {
         DBInt i;
         if (name == (char *) NULL) return ((Object *) NULL);
-        for (i = 0; i < NumVAR; ++i) if (strcmp(((Object **) ((char *) NULL + ItemsPTR))[i]->Name(), name) == 0) break;
+        if (NumVAR < DBObjectLISTHashMin) {
+            for (i = 0; i < NumVAR; ++i) if (strcmp(((Object **) ((char *) NULL + ItemsPTR))[i]->Name(), name) == 0) break;
+        }
+        else if (HashReady() || (HashBuild() == DBSuccess))
+            i = HashFind(name);
+        else {
+            for (i = 0; i < NumVAR; ++i) if (strcmp(((Object **) ((char *) NULL + ItemsPTR))[i]->Name(), name) == 0) break;
+        }
         if (i < (DBInt) NumVAR) {
             if (setCurrent) CurrentVAR = (DBUnsigned) i;
             return (((Object **) ((char *) NULL + ItemsPTR))[i]);
@@ -879,7 +1027,12 @@ public:
                                                                                  ListPTR))[CurrentVAR] = object;
             ((DBObject *) object)->RowID(NumVAR);
             ((DBObject *) object)->ListPos(NumVAR);
+            ((DBObject *) object)->RenameCounter(&RenameVAR);
             NumVAR = NumVAR + 1;
+            if (HashPTR != (DBInt *) NULL) {
+                if (NumVAR * 2 > HashSizeVAR) HashReset(); // Rebuilt larger on the next lookup
+                else HashInsert(HashPTR, HashSizeVAR, NumVAR - 1);
+            }
         }
         else NumVAR = CurrentVAR = 0;
         Flags(DBObjectFlagIdle, (NumVAR > 0) ? DBClear : DBSet);
@@ -891,6 +1044,8 @@ public:
         if (object == (Object *) NULL) return;
         rowID = object->RowID();
         if ((rowID < 0) || (rowID > (DBInt) NumVAR - 1)) return;
+        HashReset();
+        object->RenameCounter((DBUnsigned *) NULL);
 
         for (i = rowID; i < (DBInt) NumVAR - 1; ++i) {
             ((Object **) ((char *) NULL + ItemsPTR))[i] = ((Object **) ((char *) NULL + ItemsPTR))[i + 1];
@@ -927,12 +1082,9 @@ public:
     void Remove() { Remove(Item()); }
 
     void RemoveAll() {
-        if (NumVAR > 0) {
-            free((void *) ItemsPTR);
-            free((void *) ListPTR);
-        }
-        ItemsPTR   = ListPTR = (DBAddress) NULL;
-        CurrentVAR = NumVAR = 0;
+        DBInt i;
+        for (i = 0; i < (DBInt) NumVAR; ++i) ((Object **) ItemsPTR) [i]->RenameCounter((DBUnsigned *) NULL);
+        FreeAll();
     }
 
     void Delete(Object *object) {
@@ -947,7 +1099,7 @@ public:
     void DeleteAll() {
         DBInt i;
         for (i = 0; i < (DBInt) NumVAR; ++i) delete ((Object **) ItemsPTR) [i];
-        RemoveAll();
+        FreeAll();
     }
 
     Object *First(DBInt *indexVAR, DBInt startVal) {
@@ -982,8 +1134,8 @@ public:
 
         if (DBObject::Read(file, swap) != DBSuccess) return (DBFault);
 
-        if (fread((char *) this + sizeof(DBObject), sizeof(DBObjectLIST) - sizeof(DBObject) - 2 * sizeof(DBAddress), 1,
-                  file) != 1) {
+        HashReset();
+        if (fread((char *) this + sizeof(DBObject), StoredSize(), 1, file) != 1) {
             perror("File Reading Error in: DBObjectLIST::Read ()");
             return (DBFault);
         }
@@ -1003,6 +1155,7 @@ public:
                 ((Object **) ((char *) NULL + ItemsPTR))[i] = ((Object **) ((char *) NULL + ListPTR))[i] = new Object();
                 ((Object **) ((char *) NULL + ItemsPTR))[i]->RowID(i);
                 ((Object **) ((char *) NULL + ItemsPTR))[i]->ListPos(i);
+                ((Object **) ((char *) NULL + ItemsPTR))[i]->RenameCounter(&RenameVAR);
             }
         }
         else ItemsPTR = ListPTR = (DBAddress) NULL;
@@ -1010,14 +1163,14 @@ public:
     }
 
     int ReadItem(FILE *file, DBInt id, int swap) {
+        HashReset();
         return (((Object **) ((char *) NULL + ItemsPTR))[id]->Read(file, swap));
     }
 
     int Write(FILE *file) {
         if (DBObject::Write(file) != DBSuccess) return (DBFault);
 
-        if (fwrite((char *) this + sizeof(DBObject), sizeof(DBObjectLIST) - sizeof(DBObject) - 2 * sizeof(DBAddress), 1,
-                   file) != 1) {
+        if (fwrite((char *) this + sizeof(DBObject), StoredSize(), 1, file) != 1) {
             perror("File Writing Error in: DBObjectLIST::Write ()");
             return (DBFault);
         }
@@ -1028,6 +1181,7 @@ public:
 
     void ItemSort() {
         DBInt i;
+        HashReset();
         for (i = 0; i < (DBInt) NumVAR; ++i)
             ((Object **) ((char *) NULL + ListPTR))[(((Object **) ((char *) NULL +
                                                                    ItemsPTR))[i])->ListPos()] = ((Object **) (
@@ -1345,6 +1499,7 @@ private:
     DBInt RecordLengthVAR;
     DBObjectLIST<DBObjTableField> *FieldPTR;
     DBObjectLIST<DBObjRecord> *MethodPTR;
+    DBObjArena *ArenaPTR;
 
     const char *RecordName(DBInt id) {
         static char string[DBStringLength];
@@ -1357,12 +1512,14 @@ public:
         FieldPTR  = new DBObjectLIST<DBObjTableField>("Table Fields", sizeof(DBObjectLIST<DBObjTableField>));
         MethodPTR = new DBObjectLIST<DBObjRecord>("Method List", sizeof(DBObjectLIST<DBObjRecord>));
         RecordLengthVAR = 0;
+        ArenaPTR = (DBObjArena *) NULL;
     };
 
     DBObjTable(const char *name) : DBObjectLIST<DBObjRecord>(name, sizeof(DBObjTable)) {
         FieldPTR  = new DBObjectLIST<DBObjTableField>("Table Fields", sizeof(DBObjectLIST<DBObjTableField>));
         MethodPTR = new DBObjectLIST<DBObjRecord>("Method List", sizeof(DBObjectLIST<DBObjRecord>));
         RecordLengthVAR = 0;
+        ArenaPTR = (DBObjArena *) NULL;
     };
 
     DBObjTable(const char *name, DBTableFieldDefinition *fieldDefs) : DBObjectLIST<DBObjRecord>(name,
@@ -1371,6 +1528,7 @@ public:
         FieldPTR = new DBObjectLIST<DBObjTableField>("Table Fields", sizeof(DBObjectLIST<DBObjTableField>));
         MethodPTR = new DBObjectLIST<DBObjRecord>("Method List", sizeof(DBObjectLIST<DBObjRecord>));
         RecordLengthVAR = 0;
+        ArenaPTR = (DBObjArena *) NULL;
         while (fieldDefs[i++].Name() != NULL)
             AddField(new DBObjTableField(fieldDefs[i - 1].Name(), fieldDefs[i - 1].Type(), fieldDefs[i - 1].Format(),
                                          fieldDefs[i - 1].Length(), fieldDefs[i - 1].Required()));
@@ -1379,6 +1537,7 @@ public:
     DBObjTable(const char *name, DBUnsigned size) : DBObjectLIST<DBObjRecord>(name, size) {
         FieldPTR = new DBObjectLIST<DBObjTableField>("Table Fields", sizeof(DBObjectLIST<DBObjTableField>));
         RecordLengthVAR = 0;
+        ArenaPTR = (DBObjArena *) NULL;
     };
 
     DBObjTable(DBObjTable &);
@@ -1389,6 +1548,11 @@ public:
         delete MethodPTR;
     }
 
+    void DeleteAll() {
+        DBObjectLIST<DBObjRecord>::DeleteAll();
+        if (ArenaPTR != (DBObjArena *) NULL) { delete ArenaPTR; ArenaPTR = (DBObjArena *) NULL; }
+    }
+
     void AddField(DBObjTableField *);
 
     void RedefineField(DBObjTableField *, DBObjTableField *);
@@ -1491,6 +1655,37 @@ DBInt DBTableFieldIsOptional(const DBObject *);
 
 DBInt DBTableFieldMatch(const DBObjTableField *, const DBObjRecord *, const DBObjTableField *, const DBObjRecord *);
 
+// Hash index over the records of one table that answers the same question as DBTableFieldMatch for every
+// field pair of a (possibly multi field) join, so joins cost O(n + m) instead of O(n * m).
+class DBTableFieldMatchIndex {
+private:
+    DBInt FieldNumVAR;
+    DBInt IndexSideVAR;
+    DBObjTableField **Fields0PTR;
+    DBObjTableField **Fields1PTR;
+    DBObjTable *TablePTR;
+    DBInt NeverVAR;
+    DBInt *SlotsPTR;
+    DBInt SlotNumVAR;
+    size_t *KeysPTR;
+    char *KeyBufferPTR;
+    size_t KeyLengthVAR;
+    size_t KeySizeVAR;
+    char *ProbePTR;
+    size_t ProbeSizeVAR;
+
+    DBInt KeyAppend(char **, size_t *, size_t *, DBInt, const DBObjRecord *, DBInt);
+
+public:
+    DBTableFieldMatchIndex(DBInt, DBObjTableField **, DBObjTableField **, DBInt);
+
+    ~DBTableFieldMatchIndex();
+
+    DBInt Build(DBObjTable *, DBInt, DBInt);
+
+    DBObjRecord *Find(const DBObjRecord *);
+};
+
 /***********************************************************************************************************/
 
 class DBDataHeader {
@@ -1990,6 +2185,9 @@ private:
         DBObject *ObjPTR;
         DBObjTableField *FldPTR;
     } Var;
+
+    friend class DBMathProgram;
+
 public:
     DBMathOperand(DBMathExpression *expr) {
         OprTypeVAR = DBMathOperandCond;
@@ -2016,6 +2214,9 @@ private:
     DBInt TypeVAR;
     DBMathOperand *LeftPTR;
     DBMathOperand *RightPTR;
+
+    friend class DBMathProgram;
+
 public:
     DBMathExpression(char *, char *, DBInt);
 
@@ -2042,6 +2243,68 @@ public:
     DBFloat Float(DBObjRecord *rec);
 };
 
+#define DBMathProgramStackMax 64
+
+// Configured operand tree flattened into postfix code that is evaluated with a small value stack. It returns the
+// same values as DBMathOperand::String, Int or Float (whichever it was compiled for) without walking the tree.
+class DBMathProgram {
+private:
+    union Value {
+        DBInt Int;
+        DBFloat Float;
+        char *String;
+    };
+
+    class Instruction {
+    public:
+        DBShort Code;
+        DBShort Mode;
+        DBInt Oper;
+        union {
+            DBInt Int;
+            DBFloat Float;
+            char *String;
+            DBObjTableField *FldPTR;
+            double (*Function)(double);
+        } Var;
+    };
+
+    Instruction *CodePTR;
+    DBInt CodeNumVAR;
+    DBInt CodeSizeVAR;
+    DBInt ModeVAR;
+    DBInt DepthVAR;
+    DBInt MaxDepthVAR;
+
+    Instruction *Emit(DBInt, DBInt, DBInt);
+
+    DBInt CompileOperand(DBMathOperand *, DBInt);
+
+    DBInt CompileExpression(DBMathExpression *, DBInt);
+
+    Value Execute(DBObjRecord *);
+
+public:
+    DBMathProgram() {
+        CodePTR = (Instruction *) NULL;
+        CodeNumVAR = CodeSizeVAR = 0;
+        ModeVAR = DBFault;
+        DepthVAR = MaxDepthVAR = 0;
+    }
+
+    ~DBMathProgram() { if (CodePTR != (Instruction *) NULL) free(CodePTR); }
+
+    DBInt Compile(DBMathOperand *, DBInt);
+
+    DBInt Mode() const { return (ModeVAR); }
+
+    char *String(DBObjRecord *record) { return (Execute(record).String); }
+
+    DBInt Int(DBObjRecord *record) { return (Execute(record).Int); }
+
+    DBFloat Float(DBObjRecord *record) { return (Execute(record).Float); }
+};
+
 void DBPauseSetFunction(int (*)(int));
 
 int DBPause(int);
@@ -350,6 +350,152 @@ char *DBMathExpression::String(DBObjRecord *record) {
     return ((char *) NULL);
 }
 
+static DBInt _DBMathIntOperation(DBInt oper, const char *lVar, const char *rVar) {
+    DBInt comp;
+
+    if ((lVar == (char *) NULL) || (rVar == (char *) NULL)) return (DBDefaultMissingIntVal);
+    comp = strcmp(lVar, rVar);
+    switch (oper) {
+        case (DBMathOperatorGrt):
+            return (comp > 0 ? true : false);
+        case (DBMathOperatorGrt | DBMathOperatorEqu):
+            return (comp >= 0 ? true : false);
+        case (DBMathOperatorEqu):
+            return (comp == 0 ? true : false);
+        case (DBMathOperatorSml | DBMathOperatorGrt):
+            return (comp != 0 ? true : false);
+        case (DBMathOperatorSml | DBMathOperatorEqu):
+            return (comp <= 0 ? true : false);
+        case (DBMathOperatorSml):
+            return (comp < 0 ? true : false);
+        default:
+            break;
+    }
+    return (DBDefaultMissingIntVal);
+}
+
+static DBInt _DBMathIntOperation(DBInt oper, DBInt lVar, DBInt rVar) {
+    if ((oper != DBMathOperatorEqu) && (oper != (DBMathOperatorSml | DBMathOperatorGrt)) &&
+        ((lVar == DBDefaultMissingIntVal) || (rVar == DBDefaultMissingIntVal)))
+        return (DBDefaultMissingIntVal);
+    switch (oper) {
+        case (DBMathOperatorOr):
+            return (lVar || rVar);
+        case (DBMathOperatorAnd):
+            return (lVar && rVar);
+        case (DBMathOperatorGrt):
+            return (lVar > rVar ? true : false);
+        case (DBMathOperatorGrt | DBMathOperatorEqu):
+            return (lVar >= rVar ? true : false);
+        case (DBMathOperatorEqu):
+            return (lVar == rVar ? true : false);
+        case (DBMathOperatorSml | DBMathOperatorGrt):
+            return (lVar != rVar ? true : false);
+        case (DBMathOperatorSml | DBMathOperatorEqu):
+            return (lVar <= rVar ? true : false);
+        case (DBMathOperatorSml):
+            return (lVar < rVar ? true : false);
+        case (DBMathOperatorAdd):
+            return (lVar + rVar);
+        case (DBMathOperatorSub):
+            return (lVar - rVar);
+        case (DBMathOperatorMul):
+            return (lVar * rVar);
+        case (DBMathOperatorMod):
+            return (lVar % rVar);
+        case (DBMathOperatorDiv):
+            return (lVar / rVar);
+        case (DBMathOperatorExp):
+            return ((DBInt) (pow((double) lVar, (double) rVar)));
+        default:
+            break;
+    }
+    return (DBDefaultMissingIntVal);
+}
+
+static DBInt _DBMathIntOperation(DBInt oper, DBFloat lVar, DBFloat rVar) {
+    if ((oper != DBMathOperatorEqu) && (oper != (DBMathOperatorSml | DBMathOperatorGrt)) &&
+        ((CMmathEqualValues(lVar, DBDefaultMissingFloatVal) ||
+          CMmathEqualValues(rVar, DBDefaultMissingFloatVal))))
+        return (DBDefaultMissingIntVal);
+    switch (oper) {
+        case (DBMathOperatorGrt):
+            return (lVar > rVar ? true : false);
+        case (DBMathOperatorGrt | DBMathOperatorEqu):
+            return (lVar >= rVar ? true : false);
+        case (DBMathOperatorEqu):
+            return (CMmathEqualValues(lVar, rVar));
+        case (DBMathOperatorSml | DBMathOperatorGrt):
+            return (!CMmathEqualValues(lVar, rVar));
+        case (DBMathOperatorSml | DBMathOperatorEqu):
+            return (lVar <= rVar ? true : false);
+        case (DBMathOperatorSml):
+            return (lVar < rVar ? true : false);
+        case (DBMathOperatorAdd):
+            return ((DBInt) (lVar + rVar));
+        case (DBMathOperatorSub):
+            return ((DBInt) (lVar - rVar));
+        case (DBMathOperatorMul):
+            return ((DBInt) (lVar * rVar));
+        case (DBMathOperatorMod):
+            return ((DBInt) (fmod(lVar, rVar)));
+        case (DBMathOperatorDiv):
+            return ((DBInt) (lVar / rVar));
+        case (DBMathOperatorExp):
+            return ((DBInt) (pow(lVar, rVar)));
+        default:
+            break;
+    }
+    return (DBDefaultMissingIntVal);
+}
+
+static DBFloat _DBMathFloatOperation(DBInt oper, DBInt lVar, DBInt rVar) {
+    if ((oper != DBMathOperatorEqu) && (oper != (DBMathOperatorSml | DBMathOperatorGrt)) &&
+        ((lVar == DBDefaultMissingIntVal) || (rVar == DBDefaultMissingIntVal)))
+        return (DBDefaultMissingFloatVal);
+    switch (oper) {
+        case (DBMathOperatorAdd):
+            return ((DBFloat) lVar + (DBFloat) rVar);
+        case (DBMathOperatorSub):
+            return ((DBFloat) lVar - (DBFloat) rVar);
+        case (DBMathOperatorMul):
+            return ((DBFloat) lVar * (DBFloat) rVar);
+        case (DBMathOperatorMod):
+            return ((DBFloat) (lVar % rVar));
+        case (DBMathOperatorDiv):
+            return ((DBFloat) lVar / (DBFloat) rVar);
+        case (DBMathOperatorExp):
+            return ((DBFloat) pow((double) lVar, (double) rVar));
+        default:
+            break;
+    }
+    return (DBDefaultMissingFloatVal);
+}
+
+static DBFloat _DBMathFloatOperation(DBInt oper, DBFloat lVar, DBFloat rVar) {
+    if ((oper != DBMathOperatorEqu) && (oper != (DBMathOperatorSml | DBMathOperatorGrt)) &&
+        (CMmathEqualValues(lVar, DBDefaultMissingFloatVal) ||
+         CMmathEqualValues(rVar, DBDefaultMissingFloatVal)))
+        return (DBDefaultMissingFloatVal);
+    switch (oper) {
+        case (DBMathOperatorAdd):
+            return (lVar + rVar);
+        case (DBMathOperatorSub):
+            return (lVar - rVar);
+        case (DBMathOperatorMul):
+            return (lVar * rVar);
+        case (DBMathOperatorMod):
+            return ((DBFloat) (fmod(lVar, rVar)));
+        case (DBMathOperatorDiv):
+            return (lVar / rVar);
+        case (DBMathOperatorExp):
+            return (pow(lVar, rVar));
+        default:
+            break;
+    }
+    return (DBDefaultMissingFloatVal);
+}
+
 DBInt DBMathExpression::Int(DBObjRecord *record) {
     if (OperVAR == DBMathOperatorArgs) return (DBDefaultMissingIntVal);
     if (OperVAR == DBMathOperatorFunc) {
@@ -362,111 +508,26 @@ DBInt DBMathExpression::Int(DBObjRecord *record) {
 
     switch (TypeVAR) {
         case DBVariableString: {
-            char *lVar, *rVar;
-            DBInt comp;
+            const char *lVar, *rVar;
 
             lVar = LeftPTR->String(record);
             rVar = RightPTR->String(record);
-            if ((lVar == (char *) NULL) || (rVar == (char *) NULL)) return (DBDefaultMissingIntVal);
-            comp = strcmp(lVar, rVar);
-            switch (OperVAR) {
-                case (DBMathOperatorGrt):
-                    return (comp > 0 ? true : false);
-                case (DBMathOperatorGrt | DBMathOperatorEqu):
-                    return (comp >= 0 ? true : false);
-                case (DBMathOperatorEqu):
-                    return (comp == 0 ? true : false);
-                case (DBMathOperatorSml | DBMathOperatorGrt):
-                    return (comp != 0 ? true : false);
-                case (DBMathOperatorSml | DBMathOperatorEqu):
-                    return (comp <= 0 ? true : false);
-                case (DBMathOperatorSml):
-                    return (comp < 0 ? true : false);
-                default:
-                    break;
-            }
+            return (_DBMathIntOperation(OperVAR, lVar, rVar));
         }
-            break;
         case DBVariableInt: {
             DBInt lVar, rVar;
 
             lVar = LeftPTR->Int(record);
             rVar = RightPTR->Int(record);
-            if ((OperVAR != DBMathOperatorEqu) && (OperVAR != (DBMathOperatorSml | DBMathOperatorGrt)) &&
-                ((lVar == DBDefaultMissingIntVal) || (rVar == DBDefaultMissingIntVal)))
-                return (DBDefaultMissingIntVal);
-            switch (OperVAR) {
-                case (DBMathOperatorOr):
-                    return (lVar || rVar);
-                case (DBMathOperatorAnd):
-                    return (lVar && rVar);
-                case (DBMathOperatorGrt):
-                    return (lVar > rVar ? true : false);
-                case (DBMathOperatorGrt | DBMathOperatorEqu):
-                    return (lVar >= rVar ? true : false);
-                case (DBMathOperatorEqu):
-                    return (lVar == rVar ? true : false);
-                case (DBMathOperatorSml | DBMathOperatorGrt):
-                    return (lVar != rVar ? true : false);
-                case (DBMathOperatorSml | DBMathOperatorEqu):
-                    return (lVar <= rVar ? true : false);
-                case (DBMathOperatorSml):
-                    return (lVar < rVar ? true : false);
-                case (DBMathOperatorAdd):
-                    return (lVar + rVar);
-                case (DBMathOperatorSub):
-                    return (lVar - rVar);
-                case (DBMathOperatorMul):
-                    return (lVar * rVar);
-                case (DBMathOperatorMod):
-                    return (lVar % rVar);
-                case (DBMathOperatorDiv):
-                    return (lVar / rVar);
-                case (DBMathOperatorExp):
-                    return ((DBInt) (pow((double) lVar, (double) rVar)));
-                default:
-                    break;
-            }
+            return (_DBMathIntOperation(OperVAR, lVar, rVar));
         }
-            break;
         case DBVariableFloat: {
             DBFloat lVar, rVar;
+
             lVar = LeftPTR->Float(record);
             rVar = RightPTR->Float(record);
-            if ((OperVAR != DBMathOperatorEqu) && (OperVAR != (DBMathOperatorSml | DBMathOperatorGrt)) &&
-                ((CMmathEqualValues(lVar, DBDefaultMissingFloatVal) ||
-                  CMmathEqualValues(rVar, DBDefaultMissingFloatVal))))
-                return (DBDefaultMissingIntVal);
-            switch (OperVAR) {
-                case (DBMathOperatorGrt):
-                    return (lVar > rVar ? true : false);
-                case (DBMathOperatorGrt | DBMathOperatorEqu):
-                    return (lVar >= rVar ? true : false);
-                case (DBMathOperatorEqu):
-                    return (CMmathEqualValues(lVar, rVar));
-                case (DBMathOperatorSml | DBMathOperatorGrt):
-                    return (!CMmathEqualValues(lVar, rVar));
-                case (DBMathOperatorSml | DBMathOperatorEqu):
-                    return (lVar <= rVar ? true : false);
-                case (DBMathOperatorSml):
-                    return (lVar < rVar ? true : false);
-                case (DBMathOperatorAdd):
-                    return ((DBInt) (lVar + rVar));
-                case (DBMathOperatorSub):
-                    return ((DBInt) (lVar - rVar));
-                case (DBMathOperatorMul):
-                    return ((DBInt) (lVar * rVar));
-                case (DBMathOperatorMod):
-                    return ((DBInt) (fmod(lVar, rVar)));
-                case (DBMathOperatorDiv):
-                    return ((DBInt) (lVar / rVar));
-                case (DBMathOperatorExp):
-                    return ((DBInt) (pow(lVar, rVar)));
-                default:
-                    break;
-            }
+            return (_DBMathIntOperation(OperVAR, lVar, rVar));
         }
-            break;
     }
     return (DBDefaultMissingIntVal);
 }
@@ -487,55 +548,18 @@ DBFloat DBMathExpression::Float(DBObjRecord *record) {
     switch (TypeVAR) {
         case DBVariableInt: {
             DBInt lVar, rVar;
+
             lVar = LeftPTR->Int(record);
             rVar = RightPTR->Int(record);
-            if ((OperVAR != DBMathOperatorEqu) && (OperVAR != (DBMathOperatorSml | DBMathOperatorGrt)) &&
-                ((lVar == DBDefaultMissingIntVal) || (rVar == DBDefaultMissingIntVal)))
-                return (DBDefaultMissingFloatVal);
-            switch (OperVAR) {
-                case (DBMathOperatorAdd):
-                    return ((DBFloat) lVar + (DBFloat) rVar);
-                case (DBMathOperatorSub):
-                    return ((DBFloat) lVar - (DBFloat) rVar);
-                case (DBMathOperatorMul):
-                    return ((DBFloat) lVar * (DBFloat) rVar);
-                case (DBMathOperatorMod):
-                    return ((DBFloat) (lVar % rVar));
-                case (DBMathOperatorDiv):
-                    return ((DBFloat) lVar / (DBFloat) rVar);
-                case (DBMathOperatorExp):
-                    return ((DBFloat) pow((double) lVar, (double) rVar));
-                default:
-                    break;
-            }
+            return (_DBMathFloatOperation(OperVAR, lVar, rVar));
         }
-            break;
         case DBVariableFloat: {
             DBFloat lVar, rVar;
+
             lVar = LeftPTR->Float(record);
             rVar = RightPTR->Float(record);
-            if ((OperVAR != DBMathOperatorEqu) && (OperVAR != (DBMathOperatorSml | DBMathOperatorGrt)) &&
-                (CMmathEqualValues(lVar, DBDefaultMissingFloatVal) ||
-                 CMmathEqualValues(rVar, DBDefaultMissingFloatVal)))
-                return (DBDefaultMissingFloatVal);
-            switch (OperVAR) {
-                case (DBMathOperatorAdd):
-                    return (lVar + rVar);
-                case (DBMathOperatorSub):
-                    return (lVar - rVar);
-                case (DBMathOperatorMul):
-                    return (lVar * rVar);
-                case (DBMathOperatorMod):
-                    return ((DBFloat) (fmod(lVar, rVar)));
-                case (DBMathOperatorDiv):
-                    return (lVar / rVar);
-                case (DBMathOperatorExp):
-                    return (pow(lVar, rVar));
-                default:
-                    break;
-            }
+            return (_DBMathFloatOperation(OperVAR, lVar, rVar));
         }
-            break;
     }
     return (DBDefaultMissingFloatVal);
 }
@@ -845,3 +869,265 @@ DBFloat DBMathOperand::Float(DBObjRecord *record) {
     }
     return (DBDefaultMissingFloatVal);
 }
+
+#define _DBMathCodeConst     0x01
+#define _DBMathCodeField     0x02
+#define _DBMathCodeRowID     0x03
+#define _DBMathCodeFunc      0x04
+#define _DBMathCodeJumpFalse 0x05
+#define _DBMathCodeJump      0x06
+#define _DBMathCodeIntString 0x07
+#define _DBMathCodeIntInt    0x08
+#define _DBMathCodeIntFloat  0x09
+#define _DBMathCodeFloatInt  0x0a
+#define _DBMathCodeFloatFlt  0x0b
+
+#define _DBMathStoreInt      0x01
+#define _DBMathStoreFloat    0x02
+#define _DBMathStoreFloat4   0x03
+
+DBMathProgram::Instruction *DBMathProgram::Emit(DBInt code, DBInt mode, DBInt push) {
+    Instruction *instruction;
+
+    if (CodeNumVAR == CodeSizeVAR) {
+        CodeSizeVAR = CodeSizeVAR > 0 ? CodeSizeVAR * 2 : 16;
+        if ((instruction = (Instruction *) realloc(CodePTR, CodeSizeVAR * sizeof(Instruction))) == (Instruction *) NULL) {
+            CMmsgPrint(CMmsgSysError, "Memory allocation error in: %s %d", __FILE__, __LINE__);
+            return ((Instruction *) NULL);
+        }
+        CodePTR = instruction;
+    }
+    instruction = CodePTR + CodeNumVAR++;
+    instruction->Code = code;
+    instruction->Mode = mode;
+    instruction->Oper = DBFault;
+    instruction->Var.Float = 0.0;
+    DepthVAR += push;
+    if (MaxDepthVAR < DepthVAR) MaxDepthVAR = DepthVAR;
+    return (instruction);
+}
+
+/* Every node is compiled for the accessor (String, Int or Float) its parent calls on it in the tree evaluation, so
+ * the conversions the tree does on the fly (constants, nodata) are resolved here once. */
+
+DBInt DBMathProgram::CompileOperand(DBMathOperand *operand, DBInt mode) {
+    Instruction *instruction;
+
+    switch (operand->OprTypeVAR) {
+        case DBMathOperandConst:
+            if ((instruction = Emit(_DBMathCodeConst, mode, 1)) == (Instruction *) NULL) return (DBFault);
+            switch (mode) {
+                case DBVariableString:
+                    instruction->Var.String = operand->VarTypeVAR == DBVariableString ? operand->Var.String : (char *) NULL;
+                    break;
+                case DBVariableInt:
+                    switch (operand->VarTypeVAR) {
+                        case DBVariableString: instruction->Var.Int = DBDefaultMissingIntVal; break;
+                        case DBVariableInt:    instruction->Var.Int = operand->Var.Int; break;
+                        case DBVariableFloat:
+                            instruction->Var.Int = CMmathEqualValues(operand->Var.Float, DBDefaultMissingFloatVal) ?
+                                                   DBDefaultMissingIntVal : (DBInt) operand->Var.Float;
+                            break;
+                    }
+                    break;
+                case DBVariableFloat:
+                    switch (operand->VarTypeVAR) {
+                        case DBVariableString: instruction->Var.Float = DBDefaultMissingFloatVal; break;
+                        case DBVariableInt:
+                            instruction->Var.Float = operand->Var.Int == DBDefaultMissingIntVal ?
+                                                     DBDefaultMissingFloatVal : (DBFloat) operand->Var.Int;
+                            break;
+                        case DBVariableFloat:  instruction->Var.Float = operand->Var.Float; break;
+                    }
+                    break;
+            }
+            break;
+        case DBMathOperandVar:
+            if ((instruction = Emit(_DBMathCodeField, mode, 1)) == (Instruction *) NULL) return (DBFault);
+            instruction->Var.FldPTR = operand->Var.FldPTR;
+            // Plain numeric fields are read straight from the record data instead of through the generic accessors
+            if ((operand->Var.FldPTR->Type() == DBTableFieldInt) && (operand->Var.FldPTR->Length() == sizeof(DBInt)))
+                instruction->Oper = _DBMathStoreInt;
+            else if (operand->Var.FldPTR->Type() == DBTableFieldFloat)
+                switch (operand->Var.FldPTR->Length()) {
+                    case sizeof(DBFloat):  instruction->Oper = _DBMathStoreFloat;  break;
+                    case sizeof(DBFloat4): instruction->Oper = _DBMathStoreFloat4; break;
+                }
+            if (mode == DBVariableString) instruction->Oper = DBFault;
+            break;
+        case DBMathOperandExpr:
+            if (mode == DBVariableString) {
+                if ((instruction = Emit(_DBMathCodeConst, mode, 1)) == (Instruction *) NULL) return (DBFault);
+                instruction->Var.String = (char *) NULL;
+                break;
+            }
+        case DBMathOperandCond:
+            return (CompileExpression(operand->Var.ExpPTR, mode));
+        case DBMathOperandRowID:
+            if (mode != DBVariableString) {
+                if (Emit(_DBMathCodeRowID, mode, 1) == (Instruction *) NULL) return (DBFault);
+                break;
+            }
+        default:
+            if ((instruction = Emit(_DBMathCodeConst, mode, 1)) == (Instruction *) NULL) return (DBFault);
+            switch (mode) {
+                case DBVariableString: instruction->Var.String = (char *) NULL; break;
+                case DBVariableInt:    instruction->Var.Int = DBDefaultMissingIntVal; break;
+                case DBVariableFloat:  instruction->Var.Float = DBDefaultMissingFloatVal; break;
+            }
+            break;
+    }
+    return (DBSuccess);
+}
+
+DBInt DBMathProgram::CompileExpression(DBMathExpression *expression, DBInt mode) {
+    DBInt jumpFalse, jump;
+    Instruction *instruction;
+
+    if (expression->OperVAR == DBMathOperatorCond) {
+        DBMathExpression *args = (DBMathExpression *) expression->RightPTR;
+
+        if (CompileOperand(expression->LeftPTR, DBVariableInt) == DBFault) return (DBFault);
+        jumpFalse = CodeNumVAR;
+        if (Emit(_DBMathCodeJumpFalse, DBVariableInt, -1) == (Instruction *) NULL) return (DBFault);
+        if (CompileOperand(args->LeftPTR, mode) == DBFault) return (DBFault);
+        jump = CodeNumVAR;
+        if (Emit(_DBMathCodeJump, mode, -1) == (Instruction *) NULL) return (DBFault);
+        CodePTR[jumpFalse].Oper = CodeNumVAR;
+        if (CompileOperand(args->RightPTR, mode) == DBFault) return (DBFault);
+        CodePTR[jump].Oper = CodeNumVAR;
+        return (DBSuccess);
+    }
+    if ((expression->OperVAR == DBMathOperatorFunc) && (mode != DBVariableString)) {
+        if (CompileOperand(expression->LeftPTR, mode) == DBFault) return (DBFault);
+        if ((instruction = Emit(_DBMathCodeFunc, mode, 0)) == (Instruction *) NULL) return (DBFault);
+        instruction->Var.Function = (double (*)(double)) expression->RightPTR;
+        return (DBSuccess);
+    }
+    if ((expression->OperVAR != DBMathOperatorArgs) && (expression->OperVAR != DBMathOperatorFunc) &&
+        (((mode == DBVariableInt)   && ((expression->TypeVAR == DBVariableString) ||
+                                        (expression->TypeVAR == DBVariableInt) ||
+                                        (expression->TypeVAR == DBVariableFloat))) ||
+         ((mode == DBVariableFloat) && ((expression->TypeVAR == DBVariableInt) ||
+                                        (expression->TypeVAR == DBVariableFloat))))) {
+        if (CompileOperand(expression->LeftPTR,  expression->TypeVAR) == DBFault) return (DBFault);
+        if (CompileOperand(expression->RightPTR, expression->TypeVAR) == DBFault) return (DBFault);
+        switch (expression->TypeVAR) {
+            case DBVariableString: instruction = Emit(_DBMathCodeIntString, mode, -1); break;
+            case DBVariableInt:    instruction = Emit(mode == DBVariableInt ? _DBMathCodeIntInt   : _DBMathCodeFloatInt, mode, -1); break;
+            default:               instruction = Emit(mode == DBVariableInt ? _DBMathCodeIntFloat : _DBMathCodeFloatFlt, mode, -1); break;
+        }
+        if (instruction == (Instruction *) NULL) return (DBFault);
+        instruction->Oper = expression->OperVAR;
+        return (DBSuccess);
+    }
+    if ((instruction = Emit(_DBMathCodeConst, mode, 1)) == (Instruction *) NULL) return (DBFault);
+    switch (mode) {
+        case DBVariableString: instruction->Var.String = (char *) NULL; break;
+        case DBVariableInt:    instruction->Var.Int = DBDefaultMissingIntVal; break;
+        case DBVariableFloat:  instruction->Var.Float = DBDefaultMissingFloatVal; break;
+    }
+    return (DBSuccess);
+}
+
+DBInt DBMathProgram::Compile(DBMathOperand *operand, DBInt mode) {
+    CodeNumVAR = 0;
+    DepthVAR = MaxDepthVAR = 0;
+    ModeVAR = DBFault;
+    if ((mode != DBVariableString) && (mode != DBVariableInt) && (mode != DBVariableFloat)) return (DBFault);
+    if (CompileOperand(operand, mode) == DBFault) return (DBFault);
+    if (MaxDepthVAR > DBMathProgramStackMax) return (DBFault);
+    ModeVAR = mode;
+    return (DBSuccess);
+}
+
+DBMathProgram::Value DBMathProgram::Execute(DBObjRecord *record) {
+    DBInt pc = 0, top = -1;
+    Value stack[DBMathProgramStackMax];
+    const Instruction *instruction;
+
+    while (pc < CodeNumVAR) {
+        instruction = CodePTR + pc++;
+        switch (instruction->Code) {
+            case _DBMathCodeConst:
+                switch (instruction->Mode) {
+                    case DBVariableString: stack[++top].String = instruction->Var.String; break;
+                    case DBVariableInt:    stack[++top].Int = instruction->Var.Int; break;
+                    default:               stack[++top].Float = instruction->Var.Float; break;
+                }
+                break;
+            case _DBMathCodeField:
+                if ((instruction->Oper != DBFault) && (record != (DBObjRecord *) NULL)) {
+                    const char *data = (const char *) record->Data() + instruction->Var.FldPTR->StartByte();
+                    DBInt intVal;
+                    DBFloat floatVal;
+                    DBFloat4 float4Val;
+
+                    switch (instruction->Oper) {
+                        case _DBMathStoreInt:
+                            memcpy(&intVal, data, sizeof(DBInt));
+                            if (instruction->Mode == DBVariableInt) stack[++top].Int = intVal;
+                            else stack[++top].Float = (DBFloat) intVal;
+                            break;
+                        case _DBMathStoreFloat:
+                            memcpy(&floatVal, data, sizeof(DBFloat));
+                            if (instruction->Mode == DBVariableInt) stack[++top].Int = (DBInt) floatVal;
+                            else stack[++top].Float = floatVal;
+                            break;
+                        default:
+                            memcpy(&float4Val, data, sizeof(DBFloat4));
+                            if (instruction->Mode == DBVariableInt) stack[++top].Int = (DBInt) ((DBFloat) float4Val);
+                            else stack[++top].Float = (DBFloat) float4Val;
+                            break;
+                    }
+                    break;
+                }
+                switch (instruction->Mode) {
+                    case DBVariableString: stack[++top].String = instruction->Var.FldPTR->String(record); break;
+                    case DBVariableInt:    stack[++top].Int = instruction->Var.FldPTR->Int(record); break;
+                    default:               stack[++top].Float = instruction->Var.FldPTR->Float(record); break;
+                }
+                break;
+            case _DBMathCodeRowID:
+                if (instruction->Mode == DBVariableInt) stack[++top].Int = record->RowID() + 1;
+                else stack[++top].Float = (DBFloat) record->RowID() + 1;
+                break;
+            case _DBMathCodeFunc:
+                if (instruction->Mode == DBVariableInt) {
+                    if (stack[top].Int != DBDefaultMissingIntVal)
+                        stack[top].Int = (DBInt) ((*instruction->Var.Function)((double) stack[top].Int));
+                }
+                else if (!CMmathEqualValues(stack[top].Float, DBDefaultMissingFloatVal))
+                    stack[top].Float = (DBFloat) ((*instruction->Var.Function)((double) stack[top].Float));
+                break;
+            case _DBMathCodeIntString:
+                --top;
+                stack[top].Int = _DBMathIntOperation(instruction->Oper, (const char *) stack[top].String,
+                                                     (const char *) stack[top + 1].String);
+                break;
+            case _DBMathCodeIntInt:
+                --top;
+                stack[top].Int = _DBMathIntOperation(instruction->Oper, stack[top].Int, stack[top + 1].Int);
+                break;
+            case _DBMathCodeIntFloat:
+                --top;
+                stack[top].Int = _DBMathIntOperation(instruction->Oper, stack[top].Float, stack[top + 1].Float);
+                break;
+            case _DBMathCodeFloatInt:
+                --top;
+                stack[top].Float = _DBMathFloatOperation(instruction->Oper, stack[top].Int, stack[top + 1].Int);
+                break;
+            case _DBMathCodeFloatFlt:
+                --top;
+                stack[top].Float = _DBMathFloatOperation(instruction->Oper, stack[top].Float, stack[top + 1].Float);
+                break;
+            case _DBMathCodeJumpFalse:
+                if (stack[top--].Int == 0) pc = instruction->Oper;
+                break;
+            case _DBMathCodeJump:
+                pc = instruction->Oper;
+                break;
+        }
+    }
+    return (stack[0]);
+}
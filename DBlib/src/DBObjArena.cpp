@@ -0,0 +1,40 @@
+/******************************************************************************
+
+GHAAS Database library V3.0
+Global Hydrological Archive and Analysis System
+Copyright 1994-2024, UNH - CCNY
+
+DBObjArena.cpp
+
+bfekete@ccny.cuny.edu
+
+*******************************************************************************/
+
+#include <DB.hpp>
+
+#define DBObjArenaChunkSize (1024 * 1024)
+
+DBObjArena::~DBObjArena() {
+    char *chunk;
+
+    while ((chunk = ChunkPTR) != (char *) NULL) {
+        ChunkPTR = *((char **) chunk);
+        free(chunk);
+    }
+}
+
+void *DBObjArena::Grow(size_t size) {
+    size_t chunkSize = size + sizeof(char *) > DBObjArenaChunkSize ? size + sizeof(char *) : DBObjArenaChunkSize;
+    char *chunk;
+
+    if ((chunk = (char *) malloc(chunkSize)) == (char *) NULL) {
+        CMmsgPrint(CMmsgSysError, "Memory Allocation Error in: %s %d", __FILE__, __LINE__);
+        return ((void *) NULL);
+    }
+    // Every chunk starts with the link to the previous one so the destructor can walk the chain
+    *((char **) chunk) = ChunkPTR;
+    ChunkPTR = chunk;
+    UsedVAR  = sizeof(char *) + size;
+    SizeVAR  = chunkSize;
+    return ((void *) (chunk + sizeof(char *)));
+}
@@ -20,3 +20,12 @@ int _DBObjectLISTNameSort(const DBObject **obj0, const DBObject **obj1) {
 int _DBObjectLISTNameReversedSort(const DBObject **obj0, const DBObject **obj1) {
     return (strcmp((*obj1)->Name(), (*obj0)->Name()));
 }
+
+pthread_mutex_t _DBObjectLISTHashMutex = PTHREAD_MUTEX_INITIALIZER;
+
+DBUnsigned _DBObjectLISTNameHash(const char *name) {
+    DBUnsigned hash = 2166136261U;
+
+    for (; *name != '\0'; ++name) hash = (hash ^ (unsigned char) *name) * 16777619U;
+    return (hash);
+}
@@ -14,13 +14,14 @@ bfekete@ccny.cuny.edu
 #include <time.h>
 #include <pwd.h>
 
-int DBVarString::Read(FILE *file, int swap) {
+int DBVarString::Read(FILE *file, int swap, DBObjArena *arena) {
     if (fread(&LengthVAR, sizeof(LengthVAR), 1, file) != 1) {
         CMmsgPrint(CMmsgSysError, "File Reading Error in: %s %d", __FILE__, __LINE__);
         return (DBFault);
     }
     if (swap) Swap();
-    if ((StringPTR = (DBAddress) ((char *) malloc(LengthVAR + 1) - (char *) NULL)) == (DBAddress) NULL) {
+    PooledVAR = arena != (DBObjArena *) NULL;
+    if ((StringPTR = (DBAddress) ((char *) (PooledVAR ? arena->Allocate(LengthVAR + 1) : malloc(LengthVAR + 1)) - (char *) NULL)) == (DBAddress) NULL) {
         CMmsgPrint(CMmsgSysError, "Memory Allocation Error in: %s %d", __FILE__, __LINE__);
         return (DBFault);
     }
@@ -43,29 +44,35 @@ int DBVarString::Write(FILE *file) {
     return (DBSuccess);
 }
 
-int DBObject::Read(FILE *file, int swap) {
-    if (NameSTR.Read(file, swap) != DBSuccess) return (DBFault);
+int DBObject::Read(FILE *file, int swap, DBObjArena *arena) {
+    if (NameSTR.Read(file, swap, arena) != DBSuccess) return (DBFault);
     if (fread((char *) this + sizeof(DBObjectHeader), sizeof(DBObject) - sizeof(DBObjectHeader) - sizeof(NameSTR), 1,
               file) != 1) {
         CMmsgPrint(CMmsgSysError, "File Reading Error in: %s %d", __FILE__, __LINE__);
         return (DBFault);
     }
     if (swap) Swap();
+    Flags(DBObjectFlagPooled, DBClear);
     return (DBSuccess);
 }
 
 int DBObject::Write(FILE *file) {
+    DBInt flags = FlagsVAR;
+    DBInt ret = DBSuccess;
+
     if (NameSTR.Write(file) != DBSuccess) return (DBFault);
+    Flags(DBObjectFlagPooled, DBClear); // Arena ownership is a property of the loaded table, not of the file
     if (fwrite((char *) this + sizeof(DBObjectHeader), sizeof(DBObject) - sizeof(DBObjectHeader) - sizeof(NameSTR), 1,
                file) != 1) {
         CMmsgPrint(CMmsgSysError, "File Writing Error in: %s %d", __FILE__, __LINE__);
-        return (DBFault);
+        ret = DBFault;
     }
-    return (DBSuccess);
+    FlagsVAR = flags;
+    return (ret);
 }
 
-int DBObjRecord::Read(FILE *file, int swap) {
-    if (DBObject::Read(file, swap) != DBSuccess) return (DBFault);
+int DBObjRecord::Read(FILE *file, int swap, DBObjArena *arena) {
+    if (DBObject::Read(file, swap, arena) != DBSuccess) return (DBFault);
 
     if (fread((char *) this + sizeof(DBObject), sizeof(DBObjRecord) - sizeof(DBObject) - sizeof(DBAddress), 1, file) !=
         1) {
@@ -74,7 +81,8 @@ int DBObjRecord::Read(FILE *file, int swap) {
     }
     if (swap) Swap();
 
-    if ((DataPTR = (DBAddress) ((char *) malloc(Length()) - (char *) NULL)) == (DBAddress) NULL) {
+    Flags(DBObjectFlagPooled, arena != (DBObjArena *) NULL ? DBSet : DBClear);
+    if ((DataPTR = (DBAddress) ((char *) (arena != (DBObjArena *) NULL ? arena->Allocate(Length()) : malloc(Length())) - (char *) NULL)) == (DBAddress) NULL) {
         CMmsgPrint(CMmsgSysError, "Memory Allocation Error in: %s %d", __FILE__, __LINE__);
         return (DBFault);
     }
@@ -164,9 +172,11 @@ int DBObjTable::Read(FILE *file, int swap) {
         RecordLengthVAR = RecordLengthVAR > field->StartByte() + field->Length() ?
                           RecordLengthVAR : field->StartByte() + field->Length();
 
+    // Record names and data come from a single arena, so the table is allocated and freed in bulk
+    if ((ItemNum() > 0) && (ArenaPTR == (DBObjArena *) NULL)) ArenaPTR = new DBObjArena();
     for (id = 0; id < ItemNum(); ++id) {
-        if (ReadItem(file, id, swap) == DBFault) return (DBFault);
         record = Item(id);
+        if (record->Read(file, swap, ArenaPTR) == DBFault) return (DBFault);
         if (swap == false) continue;
         for (field = FieldPTR->First(); field != (DBObjTableField *) NULL; field = FieldPTR->Next())
             switch (field->Type()) {
@@ -634,6 +634,7 @@ DBObjTable::DBObjTable(DBObjTable &tableObj) : DBObjectLIST<DBObjRecord>(*((DBOb
     RecordLengthVAR = tableObj.RecordLengthVAR;
     FieldPTR  = new DBObjectLIST<DBObjTableField>(*(tableObj.FieldPTR));
     MethodPTR = new DBObjectLIST<DBObjRecord>(*(tableObj.MethodPTR));
+    ArenaPTR  = (DBObjArena *) NULL;
 }
 
 void DBObjTable::AddField(DBObjTableField *field) {
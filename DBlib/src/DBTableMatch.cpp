@@ -0,0 +1,179 @@
+/******************************************************************************
+
+GHAAS Database library V3.0
+Global Hydrological Archive and Analysis System
+Copyright 1994-2024, UNH - CCNY
+
+DBTableMatch.cpp
+
+bfekete@ccny.cuny.edu
+
+*******************************************************************************/
+
+#include <DB.hpp>
+
+/* The index is built on the records of table side indexSide (0 or 1 in the DBTableFieldMatch argument order) and
+ * probed with records of the other side.  Every field pair turns a record into a key part that is equal on both sides
+ * exactly when DBTableFieldMatch would report a match, so a join compares composite keys instead of record pairs. */
+
+DBTableFieldMatchIndex::DBTableFieldMatchIndex(DBInt fieldNum, DBObjTableField **fields0, DBObjTableField **fields1,
+                                               DBInt indexSide) {
+    DBInt i;
+
+    FieldNumVAR  = fieldNum;
+    IndexSideVAR = indexSide;
+    Fields0PTR = (DBObjTableField **) calloc(fieldNum > 0 ? fieldNum : 1, sizeof(DBObjTableField *));
+    Fields1PTR = (DBObjTableField **) calloc(fieldNum > 0 ? fieldNum : 1, sizeof(DBObjTableField *));
+    if ((Fields0PTR != (DBObjTableField **) NULL) && (Fields1PTR != (DBObjTableField **) NULL))
+        for (i = 0; i < fieldNum; ++i) {
+            Fields0PTR[i] = fields0[i];
+            Fields1PTR[i] = fields1[i];
+        }
+    TablePTR = (DBObjTable *) NULL;
+    NeverVAR = false;
+    SlotsPTR = (DBInt *) NULL;
+    SlotNumVAR = 0;
+    KeysPTR = (size_t *) NULL;
+    KeyBufferPTR = ProbePTR = (char *) NULL;
+    KeyLengthVAR = KeySizeVAR = ProbeSizeVAR = 0;
+}
+
+DBTableFieldMatchIndex::~DBTableFieldMatchIndex() {
+    if (Fields0PTR != (DBObjTableField **) NULL) free(Fields0PTR);
+    if (Fields1PTR != (DBObjTableField **) NULL) free(Fields1PTR);
+    if (SlotsPTR != (DBInt *) NULL) free(SlotsPTR);
+    if (KeysPTR != (size_t *) NULL) free(KeysPTR);
+    if (KeyBufferPTR != (char *) NULL) free(KeyBufferPTR);
+    if (ProbePTR != (char *) NULL) free(ProbePTR);
+}
+
+static DBInt _DBTableMatchPut(char **buffer, size_t *size, size_t *length, const char *string, size_t len) {
+    char *ptr;
+
+    if (*length + len + 1 > *size) {
+        if ((ptr = (char *) realloc(*buffer, (*length + len + 1) * 2)) == (char *) NULL) {
+            CMmsgPrint(CMmsgSysError, "Memory Allocation Error in: %s %d", __FILE__, __LINE__);
+            return (DBFault);
+        }
+        *buffer = ptr;
+        *size = (*length + len + 1) * 2;
+    }
+    memcpy(*buffer + *length, string, len);
+    *length += len;
+    (*buffer)[*length] = '\0';
+    return (DBSuccess);
+}
+
+static const char *_DBTableMatchStrip(const char *string) {
+    while ((*string == ' ') || (*string == '\t')) string++;
+    return (string);
+}
+
+// Appends the key part of field pair fieldID for a record of the given side, returns false when the pair never matches
+DBInt DBTableFieldMatchIndex::KeyAppend(char **buffer, size_t *size, size_t *length, DBInt fieldID,
+                                        const DBObjRecord *record, DBInt side) {
+    const DBObjTableField *field0 = Fields0PTR[fieldID], *field1 = Fields1PTR[fieldID];
+    const char *string = (char *) NULL;
+    char part[32];
+    DBInt value;
+
+    if ((field0 != (DBObjTableField *) NULL) && (field1 != (DBObjTableField *) NULL))
+        switch (field0->Type()) {
+            case DBTableFieldString:
+                string = _DBTableMatchStrip(side == 0 ? field0->String(record) : field1->String(record));
+                break;
+            case DBTableFieldInt:
+                value = side == 0 ? field0->Int(record) : field1->Int(record);
+                break;
+            default:
+                return (false);
+        }
+    else if ((field0 == (DBObjTableField *) NULL) && (field1 != (DBObjTableField *) NULL))
+        switch (field1->Type()) {
+            case DBTableFieldString:
+                string = _DBTableMatchStrip(side == 0 ? record->Name() : field1->String(record));
+                break;
+            case DBTableFieldInt:
+                value = side == 0 ? record->RowID() + 1 : field1->Int(record);
+                break;
+            default:
+                return (false);
+        }
+    else if ((field0 != (DBObjTableField *) NULL) && (field1 == (DBObjTableField *) NULL))
+        switch (field0->Type()) {
+            case DBTableFieldString: // DBTableFieldMatch compares the first record name with itself here
+                return (true);
+            case DBTableFieldInt:
+                value = side == 0 ? field0->Int(record) : record->RowID() + 1;
+                break;
+            default:
+                return (false);
+        }
+    else value = record->RowID();
+
+    if (string != (char *) NULL) {
+        snprintf(part, sizeof(part), "s%d:", (int) strlen(string));
+        if (_DBTableMatchPut(buffer, size, length, part, strlen(part)) != DBSuccess) return (DBFault);
+        return (_DBTableMatchPut(buffer, size, length, string, strlen(string)) == DBSuccess ? true : DBFault);
+    }
+    snprintf(part, sizeof(part), "i%d;", (int) value);
+    return (_DBTableMatchPut(buffer, size, length, part, strlen(part)) == DBSuccess ? true : DBFault);
+}
+
+// Indexes the records of table (skipping idle ones when requested); with firstWins the lowest matching row is kept,
+// otherwise the highest one, mirroring the break or overwrite behaviour of the nested loop it replaces.
+DBInt DBTableFieldMatchIndex::Build(DBObjTable *table, DBInt skipIdle, DBInt firstWins) {
+    DBInt recID, fieldID, ret;
+    DBUnsigned slot;
+    size_t start;
+    DBObjRecord *record;
+
+    if ((Fields0PTR == (DBObjTableField **) NULL) || (Fields1PTR == (DBObjTableField **) NULL)) return (DBFault);
+    TablePTR = table;
+    for (SlotNumVAR = 64; SlotNumVAR < table->ItemNum() * 2; SlotNumVAR <<= 1);
+    if (((SlotsPTR = (DBInt *) malloc(SlotNumVAR * sizeof(DBInt))) == (DBInt *) NULL) ||
+        ((KeysPTR = (size_t *) malloc((table->ItemNum() + 1) * sizeof(size_t))) == (size_t *) NULL)) {
+        CMmsgPrint(CMmsgSysError, "Memory Allocation Error in: %s %d", __FILE__, __LINE__);
+        return (DBFault);
+    }
+    for (slot = 0; slot < (DBUnsigned) SlotNumVAR; ++slot) SlotsPTR[slot] = DBFault;
+
+    for (recID = 0; recID < table->ItemNum(); ++recID) {
+        record = table->Item(recID);
+        KeysPTR[recID] = start = KeyLengthVAR;
+        if (skipIdle && ((record->Flags() & DBObjectFlagIdle) == DBObjectFlagIdle)) continue;
+        for (fieldID = 0; fieldID < FieldNumVAR; ++fieldID) {
+            if ((ret = KeyAppend(&KeyBufferPTR, &KeySizeVAR, &KeyLengthVAR, fieldID, record, IndexSideVAR)) == DBFault)
+                return (DBFault);
+            if (ret == false) {
+                NeverVAR = true;
+                return (DBSuccess);
+            }
+        }
+        if (_DBTableMatchPut(&KeyBufferPTR, &KeySizeVAR, &KeyLengthVAR, "", 0) != DBSuccess) return (DBFault);
+        KeyLengthVAR++; // Keeps the terminating zero of the key
+        for (slot = _DBObjectLISTNameHash(KeyBufferPTR + start) & (SlotNumVAR - 1); SlotsPTR[slot] != DBFault;
+             slot = (slot + 1) & (SlotNumVAR - 1))
+            if (strcmp(KeyBufferPTR + KeysPTR[SlotsPTR[slot]], KeyBufferPTR + start) == 0) break;
+        if ((SlotsPTR[slot] == DBFault) || (firstWins == false)) SlotsPTR[slot] = recID;
+    }
+    if (table->ItemNum() == 0) NeverVAR = true;
+    return (DBSuccess);
+}
+
+DBObjRecord *DBTableFieldMatchIndex::Find(const DBObjRecord *record) {
+    DBInt fieldID, ret;
+    DBUnsigned slot;
+    size_t length = 0;
+
+    if (NeverVAR || (SlotsPTR == (DBInt *) NULL)) return ((DBObjRecord *) NULL);
+    if (_DBTableMatchPut(&ProbePTR, &ProbeSizeVAR, &length, "", 0) != DBSuccess) return ((DBObjRecord *) NULL);
+    for (fieldID = 0; fieldID < FieldNumVAR; ++fieldID)
+        if ((ret = KeyAppend(&ProbePTR, &ProbeSizeVAR, &length, fieldID, record, 1 - IndexSideVAR)) != true)
+            return ((DBObjRecord *) NULL);
+
+    for (slot = _DBObjectLISTNameHash(ProbePTR) & (SlotNumVAR - 1); SlotsPTR[slot] != DBFault;
+         slot = (slot + 1) & (SlotNumVAR - 1))
+        if (strcmp(KeyBufferPTR + KeysPTR[SlotsPTR[slot]], ProbePTR) == 0) return (TablePTR->Item(SlotsPTR[slot]));
+    return ((DBObjRecord *) NULL);
+}
@@ -19,6 +19,7 @@ extern "C" {
 #include <stdbool.h>
 #endif
 
+#include <math.h>
 #include <cm.h>
 
 enum {
@@ -62,6 +63,46 @@ void MFSwapHalfWord(void *);
 void MFSwapWord(void *);
 void MFSwapLongWord(void *);
 
+typedef struct MFdsHeader_s {
+    short Swap, Type;
+    int ItemNum;
+    union {
+        int Int;
+        double Float;
+    } Missing;
+    char Date[MFDateStringLength];
+} MFdsHeader_t, *MFdsHeader_p;
+
+enum { MFdsEmpty, MFdsFull, MFdsEnd, MFdsError };
+
+/* Flags carried in the high bits of MFdsHeader_t Type. Compressed records store their data as a block: the block size,
+   then one deflated byte plane per item byte (least significant first), each preceded by its size and stored as is
+   when it would barely shrink. The filters are undone after inflating, so decoded records are always in native order. */
+#define MFdsTypeMask    0x00ff
+#define MFdsCompressed  0x0100
+#define MFdsShuffle     0x0200 // Bytes of the items grouped into planes
+#define MFdsDelta       0x0400 // Items stored as the (integer) difference from the previous item
+
+/* Date index of a data stream file, kept next to it as <file>.idx: the date and the offset of every record, so readers
+   can seek to a date instead of reading through the records before it. Indices are written when file outputs are
+   closed (or by dsIndex) and ignored once the data file no longer has the size they were built for. */
+#define MFdsIndexExt ".idx"
+#define MFdsIndexTag "MFDSINDX"
+
+typedef struct MFdsIndex_s {
+    int RecordNum, RecordMax;
+    long long DataSize;
+    char (*Dates) [MFDateStringLength];
+    long long *Offsets;
+} MFdsIndex_t, *MFdsIndex_p;
+
+MFdsIndex_p MFdsIndexLoad (const char *);
+MFdsIndex_p MFdsIndexScan (FILE *);
+CMreturn    MFdsIndexSave (MFdsIndex_p, const char *);
+int         MFdsIndexFind (MFdsIndex_p, const char *);
+CMreturn    MFdsIndexSeek (MFdsIndex_p, FILE *, const char *);
+void        MFdsIndexFree (MFdsIndex_p);
+
 typedef struct MFDataStream_s {
     int Type;
     union {
@@ -69,27 +110,57 @@ typedef struct MFDataStream_s {
         int    Int;
         double Float;
     } Handle;
-    pthread_t Thread;
+    pthread_t Thread;       // Background reader filling Buffer with the next record (see MFDataStreamSetPrefetch)
     pthread_mutex_t Mutex;
     pthread_cond_t Cond;
+    bool Prefetch, Stop, WriteBehind;
+    int  State;             // MFdsEmpty, MFdsFull, MFdsEnd or MFdsError
+    int  ItemNum;           // Items of the prefetched records, or the number of values of const: streams
+    short ItemType;
+    MFdsHeader_t Header;
+    void *Buffer;
+    void *Shuffle;          // Record in file order when the domain cells are renumbered (see MFDataStreamSetOrder)
+    bool Compress;          // Records are written as compressed blocks (zfile: streams)
+    int  Filters;           // Flags of the last record header read, or of the records written
+    void *Codec;
+    char *Path;             // File of the stream, for its date index
+    MFdsIndex_p Index;      // Loaded date index of file inputs, or the index being built for file outputs
+    long long Offset;       // Start of the input record last taken by the variable (-1 when not seekable)
+    long long NextOffset;   // Start of the record waiting in the prefetch buffer
+    int  MemberNum;         // Per member files of MFEnsemble outputs (see MFDataStreamSetMembers)
+    struct MFDataStream_s **Members;
 } MFDataStream_t, *MFDataStream_p;
 
-typedef struct MFdsHeader_s {
-    short Swap, Type;
-    int ItemNum;
-    union {
-        int Int;
-        double Float;
-    } Missing;
-    char Date[MFDateStringLength];
-} MFdsHeader_t, *MFdsHeader_p;
-
 #define MFconstStr "const:"
 #define MFfileStr  "file:"
 #define MFpipeStr  "pipe:"
+#define MFzfileStr "zfile:"
+#define MFyearStr  "%Y"    // Replaced with the simulated year in per-year file templates
+#define MFmemberStr "%M"   // Replaced with the member number (1, 2, ...) in per-member output templates of ensembles
+
+enum { MFConst, MFFile, MFPipe, MFEnsemble };
+
+#define MFaggrAvgStr "avg:"
+#define MFaggrSumStr "sum:"
 
-enum { MFConst, MFFile, MFPipe };
+enum { MFAggrMonth, MFAggrYear, MFAggrNum };
 
+// Monthly or annual output accumulated during the run, matching dsAggregate of the time step output
+typedef struct MFAggregate_s {
+    int  Step;              // MFAggrMonth or MFAggrYear
+    bool Sum;               // Period sums rescaled to the longest record of the period instead of means
+    char Date[MFDateStringLength];
+    int  ItemNum, MaxObs;
+    float  Missing;
+    double *Values;
+    int    *ObsNum;
+    float  *Record;
+    MFDataStream_t *Stream;
+} MFAggregate_t, *MFAggregate_p;
+
+/* Ensemble runs (MFModelRun -N) hold the members of a cell next to each other, itemID = cell * members + member,
+   so the same model functions step every member. Inputs read from files are read once and shared (Share), their
+   buffer holding one item per cell; const: lists with one value per member give each member its own parameter. */
 typedef struct MFVariable_s {
     int  ID;
     char Name[MFNameLength];
@@ -104,9 +175,14 @@ typedef struct MFVariable_s {
     } Missing;
     short TStep;
     void *Buffer;
+    void *Scalar;           // Single item of const: inputs, read by every cell while Broadcast is set (see MFVarExpand)
+    bool  Broadcast;
+    int   Share;            // Ensemble members reading each item of Buffer: the member number for inputs they share, else 1
     char *InputPath, *OutputPath, *StatePath;
     int   NStep;
     MFDataStream_t *InStream, *OutStream;
+    char *AggrPath [MFAggrNum];
+    MFAggregate_t *Aggregate [MFAggrNum];
     bool   Read;
 } MFVariable_t, *MFVariable_p;
 
@@ -114,10 +190,25 @@ typedef void (*MFFunction)(int);
 
 MFDataStream_t *MFDataStreamOpen(const char *, const char *);
 int MFDataStreamClose (MFDataStream_t *);
+void MFDataStreamSetPrefetch (bool);
+void MFDataStreamSetWriteBehind (bool);
+void MFDataStreamSetOrder (const int *);
+void MFDataStreamSetMembers (int, int);
+void MFDataStreamSetFilters (int);
+CMreturn MFDataStreamFlush ();
+CMreturn MFDataStreamSeek   (MFDataStream_t *, long long);
+CMreturn MFDataStreamResume (MFDataStream_t *, long long);
+#define MFdsWriteBehindLimit (256 * 1024 * 1024) // Bytes of records allowed to wait for the writer thread
 CMreturn MFdsHeaderRead    (MFdsHeader_t *,FILE *);
 CMreturn MFdsHeaderWrite   (MFdsHeader_t *,FILE *);
+CMreturn MFdsRecordSkip    (MFdsHeader_t *,FILE *);
 CMreturn MFdsRecordRead    (MFVariable_t *);
 CMreturn MFdsRecordWrite   (MFVariable_t *);
+CMreturn MFdsRecordWriteData (MFDataStream_t *, MFdsHeader_t *, const void *);
+
+MFAggregate_t *MFAggregateOpen (MFVariable_t *, int, const char *, const char *);
+CMreturn MFAggregateUpdate (MFVariable_t *, MFAggregate_t *);
+CMreturn MFAggregateClose  (MFAggregate_t *);
 
 int MFVarGetID(char *, char *, int, bool, bool);
 MFVariable_t *MFVarGetByID(int);
@@ -130,6 +221,54 @@ int    MFVarGetTStep(int);
 bool   MFVarTestMissingVal(int, int);
 void   MFVarSetMissingVal(int, int);
 char  *MFVarTypeString(int);
+
+/* Fast per-cell access for module hot loops. The MFVariable_p returned by MFVarGetByID stays valid for the whole
+   run, so modules can look it up once in their definition function. The accessors below skip the ID lookup, the
+   bounds check and the unset warning, but keep the missing value and flux (NStep) handling of MFVarGetFloat and
+   MFVarSetFloat; variables that are not stored as MFFloat fall back to those functions. */
+static inline bool _MFVarFastIsMissing (double val, double missing) {
+    if (isnan (val) || isnan (missing)) return (isnan (val) && isnan (missing));
+    if (fabs (val) + fabs (missing) == (double) 0.0) return (true);
+    return (fabs (val - missing) / (fabs (val) + fabs (missing)) < CMmathEpsilon);
+}
+
+/* Routed variable access tracking. MFModelRun uses it to find the functions that never touch a routed variable, so
+   they can run as a flat parallel sweep ahead of the routing order. */
+extern bool _MFVarRouteTrack;
+void MFVarRouteTrack (bool);
+bool MFVarRouteTouched ();
+void _MFVarRouteTouch ();
+
+static inline double MFVarFastGetFloat (MFVariable_t *var, int itemID, double missingVal) {
+    double val;
+    if (var->Route && _MFVarRouteTrack) _MFVarRouteTouch ();
+    if (var->Type != MFFloat) return (MFVarGetFloat (var->ID, itemID, missingVal));
+    if (__atomic_load_n (&(var->Broadcast), __ATOMIC_ACQUIRE)) val = (double) *((float *) var->Scalar);
+    else val = (double) ((float *) var->Buffer) [var->Share > 1 ? itemID / var->Share : itemID];
+    if (_MFVarFastIsMissing (val, var->Missing.Float)) return (missingVal);
+    return (var->Flux ? val / (double) var->NStep : val);
+}
+
+static inline void MFVarFastSetFloat (MFVariable_t *var, int itemID, double val) {
+    if (var->Route && _MFVarRouteTrack) _MFVarRouteTouch ();
+    if ((var->Type != MFFloat) || __atomic_load_n (&(var->Broadcast), __ATOMIC_ACQUIRE) || (var->Share > 1)) { MFVarSetFloat (var->ID, itemID, val); return; }
+    if (!var->Set) var->Set = true;
+    if (var->Flux) val = val * (double) var->NStep;
+    ((float *) var->Buffer) [itemID] = (float) val;
+}
+
+/* Raw view of the current MFFloat buffer, valid for the current time step only (input streams swap buffers
+   between steps). Values are as stored: flux variables hold value * NStep and missing values are not filtered.
+   const: inputs are expanded to a per-cell buffer on the first request; MFVarGetFloatView reads them without
+   expanding, returning their single value with a zero stride (view [itemID * stride] holds the value of any cell). Inputs the
+   members of an ensemble share have no per item buffer and are only read with the accessors. */
+float *MFVarGetFloatBuffer (int);
+const float *MFVarGetFloatView (int, size_t *);
+
+/* const: inputs are held as one item and broadcast to every cell. The first write into such a variable (a module
+   setting an input it also reads) gives it a per-cell buffer filled with the constant; MFVarExpand does that. */
+CMreturn MFVarExpand (MFVariable_t *);
+
 int    MFOptionParse(int, char *[]);
 const char *MFOptionGet(const char *);
 void   MFOptionPrintList();
@@ -148,6 +287,8 @@ float MFModelGetLength(int);
 float MFModelGet_dt();
 void _MFDefEntering(const char *, const char *);
 void _MFDefLeaving(const char *, const char *);
+const char *_MFDefCurrent();
+#define MFDefLevelMax 32
 #define MFDefEntering(msg) _MFDefEntering(msg,__FILE__)
 #define MFDefLeaving(msg)  _MFDefLeaving(msg,__FILE__)
 
@@ -166,14 +307,45 @@ typedef struct MFDomain_s {
     short Swap, Type;
     int ObjNum;
     MFObject_t *Objects;
+    void  *Image;   // Flat domains: file image holding the objects and the link arrays
+    size_t ImageSize;
+    bool   Mapped;  // Image is memory-mapped (otherwise it was read into an allocated block)
 } MFDomain_t, *MFDomain_p;
 
+/* Flat domain files start with this tag, followed by the header counts, the object records and the link and weight
+   arrays back to back, so the whole file can be mapped and used in place. Files without the tag are read as linked
+   (per-object) domains. */
+#define MFDomainFlatTag "MFDOMFLT"
+
 MFDomain_t *MFDomainRead (FILE *);
 int  MFDomainWrite(MFDomain_t *, FILE *);
+int  MFDomainWriteFlat(MFDomain_t *, FILE *);
 int  MFDomainSetBifurcations(MFDomain_t *, const char *);
 #define MFBifurcationOpt "bifurcations"
 void MFDomainFree(MFDomain_t *);
 
+/* Cell orders for MFDomainOrder: the order of the domain file, grouped by travel (longest path to the outlet, the
+   order the routing job runs the cells in), depth first from each basin outlet, or along a Hilbert curve over the
+   cell coordinates. */
+enum { MFDomainOrderFile, MFDomainOrderTravel, MFDomainOrderBasin, MFDomainOrderHilbert };
+extern const char *MFDomainOrderStrings [];
+
+int *MFDomainOrder(MFDomain_t *, int);
+int  MFDomainPermute(MFDomain_t *, const int *);
+
+/* Upstream topology of a domain as one compressed sparse row operator: the upstream cells of object i are
+   Links [Offsets [i]] .. Links [Offsets [i + 1] - 1] with the matching Weights. Built once the domain is final
+   (i.e. after the bifurcations are applied). */
+typedef struct MFUpstream_s {
+    int ObjNum;
+    size_t *Offsets;
+    int    *Links;
+    float  *Weights;
+} MFUpstream_t, *MFUpstream_p;
+
+MFUpstream_p MFUpstreamCreate(MFDomain_t *);
+void MFUpstreamFree(MFUpstream_p);
+
 enum { MFsamplePoint, MFsampleZone };
 
 typedef struct MFMapper_s {
@@ -0,0 +1,126 @@
+/******************************************************************************
+
+GHAAS Water Balance Model Library V1.0
+Global Hydrological Archive and Analysis System
+Copyright 1994-2024, UNH - CCNY
+
+MFAggregate.c
+
+bfekete@ccny.cuny.edu
+
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cm.h>
+#include <MF.h>
+
+static const int _MFAggrDateLength [MFAggrNum] = { 7, 4 }; // "yyyy-mm" and "yyyy" as written by dsAggregate
+
+static void _MFAggregateReset (MFAggregate_p aggr) {
+	int i;
+
+	for (i = 0; i < aggr->ItemNum; ++i) aggr->Values [i] = 0.0;
+	for (i = 0; i < aggr->ItemNum; ++i) aggr->ObsNum [i] = 0;
+	aggr->MaxObs = 0;
+}
+
+static CMreturn _MFAggregateWrite (MFAggregate_p aggr) {
+	int i;
+	MFdsHeader_t header;
+
+	memset (&header, 0, sizeof (header));
+	header.Type          = MFFloat;
+	header.ItemNum       = aggr->ItemNum;
+	header.Missing.Float = aggr->Missing;
+	strcpy (header.Date, aggr->Date);
+	if (aggr->Sum)
+		for (i = 0; i < aggr->ItemNum; ++i) aggr->Record [i] = aggr->ObsNum [i] > 0 ? aggr->Values [i] * ((double) aggr->MaxObs / (double) aggr->ObsNum [i]) : aggr->Missing;
+	else
+		for (i = 0; i < aggr->ItemNum; ++i) aggr->Record [i] = aggr->ObsNum [i] > 0 ? aggr->Values [i] / (double) aggr->ObsNum [i] : aggr->Missing;
+	return (MFdsRecordWriteData (aggr->Stream, &header, aggr->Record));
+}
+
+MFAggregate_p MFAggregateOpen (MFVariable_p var, int step, const char *path, const char *mode) {
+	MFAggregate_p aggr;
+
+	if ((aggr = (MFAggregate_p) calloc (1, sizeof (MFAggregate_t))) == (MFAggregate_p) NULL) {
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+		return ((MFAggregate_p) NULL);
+	}
+	aggr->Step    = step;
+	aggr->ItemNum = var->ItemNum;
+	aggr->Sum     = var->Flux;
+	aggr->Missing = (var->Type == MFFloat) || (var->Type == MFDouble) ? var->Missing.Float : MFDefaultMissingFloat;
+	if      (strncmp (path, MFaggrAvgStr, strlen (MFaggrAvgStr)) == 0) { aggr->Sum = false; path += strlen (MFaggrAvgStr); }
+	else if (strncmp (path, MFaggrSumStr, strlen (MFaggrSumStr)) == 0) { aggr->Sum = true;  path += strlen (MFaggrSumStr); }
+	if (((aggr->Values = (double *) calloc (aggr->ItemNum, sizeof (double))) == (double *) NULL) ||
+	    ((aggr->ObsNum = (int *)    calloc (aggr->ItemNum, sizeof (int)))    == (int *)    NULL) ||
+	    ((aggr->Record = (float *)  calloc (aggr->ItemNum, sizeof (float)))  == (float *)  NULL)) {
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+		MFAggregateClose (aggr);
+		return ((MFAggregate_p) NULL);
+	}
+	if ((aggr->Stream = MFDataStreamOpen (path,mode)) == (MFDataStream_p) NULL) {
+		MFAggregateClose (aggr);
+		return ((MFAggregate_p) NULL);
+	}
+	return (aggr);
+}
+
+CMreturn MFAggregateUpdate (MFVariable_p var, MFAggregate_p aggr) {
+	int i, stride = var->Broadcast ? 0 : 1;
+	const void *data = var->Broadcast ? var->Scalar : var->Buffer;
+
+	if (strncmp (aggr->Date, var->OutDate, _MFAggrDateLength [aggr->Step]) != 0) {
+		if ((aggr->Date [0] != '\0') && (_MFAggregateWrite (aggr) == CMfailed)) return (CMfailed);
+		memset (aggr->Date, 0, sizeof (aggr->Date));
+		strncpy (aggr->Date, var->OutDate, _MFAggrDateLength [aggr->Step]);
+		_MFAggregateReset (aggr);
+	}
+	switch (var->Type) {
+		case MFByte:
+			for (i = 0; i < aggr->ItemNum; ++i)
+				if (((char *) data) [i * stride] != var->Missing.Int) { aggr->Values [i] += ((char *) data) [i * stride]; aggr->ObsNum [i] += 1; }
+			break;
+		case MFShort:
+			for (i = 0; i < aggr->ItemNum; ++i)
+				if (((short *) data) [i * stride] != var->Missing.Int) { aggr->Values [i] += ((short *) data) [i * stride]; aggr->ObsNum [i] += 1; }
+			break;
+		case MFInt:
+			for (i = 0; i < aggr->ItemNum; ++i)
+				if (((int *) data) [i * stride] != var->Missing.Int) { aggr->Values [i] += ((int *) data) [i * stride]; aggr->ObsNum [i] += 1; }
+			break;
+		case MFFloat:
+			for (i = 0; i < aggr->ItemNum; ++i)
+				if (!_MFVarFastIsMissing (((float *) data) [i * stride], var->Missing.Float)) { aggr->Values [i] += ((float *) data) [i * stride]; aggr->ObsNum [i] += 1; }
+			break;
+		case MFDouble:
+			for (i = 0; i < aggr->ItemNum; ++i)
+				if (!_MFVarFastIsMissing (((double *) data) [i * stride], var->Missing.Float)) { aggr->Values [i] += ((double *) data) [i * stride]; aggr->ObsNum [i] += 1; }
+			break;
+		default:
+			CMmsgPrint (CMmsgAppError,"Error: Invalid variable [%s] type in: %s:%d",var->Name,__FILE__,__LINE__);
+			return (CMfailed);
+	}
+	// Counts grow by at most one per step, so the first cell above the previous maximum holds the new one
+	for (i = 0; i < aggr->ItemNum; ++i) if (aggr->ObsNum [i] > aggr->MaxObs) { aggr->MaxObs = aggr->ObsNum [i]; break; }
+	return (CMsucceeded);
+}
+
+// Writes the pending (possibly incomplete) period like dsAggregate does at the end of its input
+CMreturn MFAggregateClose (MFAggregate_p aggr) {
+	CMreturn ret = CMsucceeded;
+
+	if (aggr->Stream != (MFDataStream_p) NULL) {
+		if (aggr->Date [0] != '\0') ret = _MFAggregateWrite (aggr);
+		if (MFDataStreamClose (aggr->Stream) == CMfailed) ret = CMfailed;
+		free (aggr->Stream);
+	}
+	if (aggr->Values != (double *) NULL) free (aggr->Values);
+	if (aggr->ObsNum != (int *)    NULL) free (aggr->ObsNum);
+	if (aggr->Record != (float *)  NULL) free (aggr->Record);
+	free (aggr);
+	return (ret);
+}
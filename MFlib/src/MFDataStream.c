@@ -12,17 +12,759 @@ bfekete@ccny.cuny.edu
 
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
 #include <cm.h>
 #include <MF.h>
 
+static bool _MFdsPrefetch    = true;
+static bool _MFdsWriteBehind = true;
+
+void MFDataStreamSetPrefetch    (bool prefetch)    { _MFdsPrefetch    = prefetch; }
+void MFDataStreamSetWriteBehind (bool writeBehind) { _MFdsWriteBehind = writeBehind; }
+
+// Cell order of a renumbered domain (cell i holds item _MFdsOrder [i] of the records on disk), NULL when the
+// domain keeps the file order. Records are permuted on the way in and out, so data files never change.
+static const int *_MFdsOrder = (const int *) NULL;
+
+void MFDataStreamSetOrder (const int *order) { _MFdsOrder = order; }
+
+static void _MFdsPermute (void *dst, const void *src, int itemNum, size_t itemSize, bool toFile) {
+	int i;
+
+#define _MFdsPermuteLoop(type) \
+	if (toFile) for (i = 0; i < itemNum; ++i) ((type *) dst) [_MFdsOrder [i]] = ((const type *) src) [i]; \
+	else        for (i = 0; i < itemNum; ++i) ((type *) dst) [i] = ((const type *) src) [_MFdsOrder [i]];
+	switch (itemSize) {
+		case 1: _MFdsPermuteLoop (char);      break;
+		case 2: _MFdsPermuteLoop (short);     break;
+		case 4: _MFdsPermuteLoop (int);       break;
+		case 8: _MFdsPermuteLoop (long long); break;
+	}
+#undef _MFdsPermuteLoop
+}
+
+// Ensemble runs hold the members of each cell next to each other (item = cell * _MFdsMemberNum + member), member
+// outputs are written to their own files (MFmemberStr templates) with _MFdsCellNum items per record.
+static int _MFdsMemberNum = 1;
+static int _MFdsCellNum   = 0;
+
+void MFDataStreamSetMembers (int memberNum, int cellNum) { _MFdsMemberNum = memberNum; _MFdsCellNum = cellNum; }
+
+static void _MFdsMemberGather (void *dst, const void *src, int member, size_t itemSize) {
+	int cell;
+
+#define _MFdsGatherLoop(type) \
+	for (cell = 0; cell < _MFdsCellNum; ++cell) ((type *) dst) [cell] = ((const type *) src) [cell * _MFdsMemberNum + member];
+	switch (itemSize) {
+		case 1: _MFdsGatherLoop (char);      break;
+		case 2: _MFdsGatherLoop (short);     break;
+		case 4: _MFdsGatherLoop (int);       break;
+		case 8: _MFdsGatherLoop (long long); break;
+	}
+#undef _MFdsGatherLoop
+}
+
+static void *_MFdsShuffle (MFDataStream_p dStream, size_t size) {
+	if ((dStream->Shuffle == (void *) NULL) && ((dStream->Shuffle = malloc (size)) == (void *) NULL))
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+	return (dStream->Shuffle);
+}
+
+// Compressed record blocks (zfile: streams). Each stream keeps its own codec state and buffers: a stream is only
+// encoded by one thread (the caller or the write-behind thread) and only decoded by one (the caller or its prefetch).
+typedef struct MFdsCodec_s {
+	bool Deflating, Inflating;
+	z_stream Deflate, Inflate;
+	unsigned char *Planes, *Block;
+	size_t PlaneSize, BlockSize;
+} MFdsCodec_t, *MFdsCodec_p;
+
+static int _MFdsFilters = MFdsShuffle | MFdsDelta;
+
+void MFDataStreamSetFilters (int filters) { _MFdsFilters = filters & (MFdsShuffle | MFdsDelta); }
+
+static MFdsCodec_p _MFdsCodec (MFDataStream_p dStream, size_t dataSize) {
+	MFdsCodec_p codec = (MFdsCodec_p) dStream->Codec;
+	size_t blockSize = sizeof (unsigned int) * 9 + dataSize; // Block size and up to eight planes, none larger than stored
+
+	if ((codec == (MFdsCodec_p) NULL) && ((dStream->Codec = codec = (MFdsCodec_p) calloc (1, sizeof (MFdsCodec_t))) == (MFdsCodec_p) NULL)) {
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+		return ((MFdsCodec_p) NULL);
+	}
+	if (codec->PlaneSize < dataSize) {
+		if ((codec->Planes = (unsigned char *) realloc (codec->Planes, dataSize)) == (unsigned char *) NULL) {
+			CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+			codec->PlaneSize = 0;
+			return ((MFdsCodec_p) NULL);
+		}
+		codec->PlaneSize = dataSize;
+	}
+	if (codec->BlockSize < blockSize) {
+		if ((codec->Block = (unsigned char *) realloc (codec->Block, blockSize)) == (unsigned char *) NULL) {
+			CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+			codec->BlockSize = 0;
+			return ((MFdsCodec_p) NULL);
+		}
+		codec->BlockSize = blockSize;
+	}
+	return (codec);
+}
+
+static void _MFdsCodecFree (MFDataStream_p dStream) {
+	MFdsCodec_p codec = (MFdsCodec_p) dStream->Codec;
+
+	if (codec == (MFdsCodec_p) NULL) return;
+	if (codec->Deflating) deflateEnd (&(codec->Deflate));
+	if (codec->Inflating) inflateEnd (&(codec->Inflate));
+	if (codec->Planes != (unsigned char *) NULL) free (codec->Planes);
+	if (codec->Block  != (unsigned char *) NULL) free (codec->Block);
+	free (codec);
+	dStream->Codec = (void *) NULL;
+}
+
+// Filters the items' integer image (least significant byte first, so blocks do not depend on the byte order) into
+// byte planes, or into a single plane of interleaved items without the shuffle filter
+static void _MFdsPlanesSplit (unsigned char *planes, const void *data, int itemNum, size_t itemSize, int filters) {
+	int i;
+	size_t k;
+	bool delta = (filters & MFdsDelta) != 0;
+
+#define _MFdsSplitLoop(type) { \
+	type item, prev = 0, diff; \
+	for (i = 0; i < itemNum; ++i) { \
+		diff = delta ? (type) ((item = ((const type *) data) [i]) - prev) : (item = ((const type *) data) [i]); \
+		prev = item; \
+		if (filters & MFdsShuffle) for (k = 0; k < sizeof (type); ++k) planes [k * itemNum + i] = (unsigned char) (diff >> (8 * k)); \
+		else for (k = 0; k < sizeof (type); ++k) planes [i * sizeof (type) + k] = (unsigned char) (diff >> (8 * k)); \
+	} }
+	switch (itemSize) {
+		case 1: _MFdsSplitLoop (unsigned char);      break;
+		case 2: _MFdsSplitLoop (unsigned short);     break;
+		case 4: _MFdsSplitLoop (unsigned int);       break;
+		case 8: _MFdsSplitLoop (unsigned long long); break;
+	}
+#undef _MFdsSplitLoop
+}
+
+static void _MFdsPlanesJoin (void *data, const unsigned char *planes, int itemNum, size_t itemSize, int filters) {
+	int i;
+	size_t k;
+	bool delta = (filters & MFdsDelta) != 0;
+
+#define _MFdsJoinLoop(type) { \
+	type item, prev = 0; \
+	for (i = 0; i < itemNum; ++i) { \
+		item = 0; \
+		if (filters & MFdsShuffle) for (k = 0; k < sizeof (type); ++k) item |= (type) planes [k * itemNum + i] << (8 * k); \
+		else for (k = 0; k < sizeof (type); ++k) item |= (type) planes [i * sizeof (type) + k] << (8 * k); \
+		((type *) data) [i] = prev = delta ? (type) (item + prev) : item; \
+	} }
+	switch (itemSize) {
+		case 1: _MFdsJoinLoop (unsigned char);      break;
+		case 2: _MFdsJoinLoop (unsigned short);     break;
+		case 4: _MFdsJoinLoop (unsigned int);       break;
+		case 8: _MFdsJoinLoop (unsigned long long); break;
+	}
+#undef _MFdsJoinLoop
+}
+
+// Encodes the record into codec->Block and returns the block length (0 on failure)
+static size_t _MFdsEncode (MFdsCodec_p codec, const void *data, int itemNum, size_t itemSize, int filters) {
+	size_t k, planeNum = filters & MFdsShuffle ? itemSize : 1, planeSize = itemNum * itemSize / planeNum, blockLen = sizeof (unsigned int);
+	unsigned int len;
+
+	_MFdsPlanesSplit (codec->Planes, data, itemNum, itemSize, filters);
+	if (!codec->Deflating) {
+		if (deflateInit2 (&(codec->Deflate), Z_BEST_SPEED, Z_DEFLATED, 15, 8, Z_RLE) != Z_OK) {
+			CMmsgPrint (CMmsgAppError,"Compression initialization error in: %s:%d",__FILE__,__LINE__);
+			return (0);
+		}
+		codec->Deflating = true;
+	}
+	for (k = 0; k < planeNum; ++k) {
+		deflateReset (&(codec->Deflate));
+		codec->Deflate.next_in   = codec->Planes + k * planeSize;
+		codec->Deflate.avail_in  = (uInt) planeSize;
+		codec->Deflate.next_out  = codec->Block + blockLen + sizeof (unsigned int);
+		codec->Deflate.avail_out = (uInt) (planeSize - planeSize / 32); // Planes saving less are faster to store as they are
+		if ((deflate (&(codec->Deflate), Z_FINISH) == Z_STREAM_END) && (codec->Deflate.total_out < planeSize))
+			len = (unsigned int) codec->Deflate.total_out;
+		else {
+			memcpy (codec->Block + blockLen + sizeof (unsigned int), codec->Planes + k * planeSize, planeSize);
+			len = (unsigned int) planeSize;
+		}
+		memcpy (codec->Block + blockLen, &len, sizeof (unsigned int));
+		blockLen += sizeof (unsigned int) + len;
+	}
+	len = (unsigned int) (blockLen - sizeof (unsigned int));
+	memcpy (codec->Block, &len, sizeof (unsigned int));
+	return (blockLen);
+}
+
+static CMreturn _MFdsDecode (MFdsCodec_p codec, void *data, const unsigned char *block, size_t blockLen, int itemNum, size_t itemSize, int filters, bool swap) {
+	size_t k, pos = 0, planeNum = filters & MFdsShuffle ? itemSize : 1, planeSize = itemNum * itemSize / planeNum;
+	unsigned int len;
+
+	if (!codec->Inflating) {
+		if (inflateInit (&(codec->Inflate)) != Z_OK) {
+			CMmsgPrint (CMmsgAppError,"Decompression initialization error in: %s:%d",__FILE__,__LINE__);
+			return (CMfailed);
+		}
+		codec->Inflating = true;
+	}
+	for (k = 0; k < planeNum; ++k) {
+		if (pos + sizeof (unsigned int) > blockLen) return (CMfailed);
+		memcpy (&len, block + pos, sizeof (unsigned int));
+		if (swap) MFSwapWord (&len);
+		pos += sizeof (unsigned int);
+		if ((len > planeSize) || (pos + len > blockLen)) return (CMfailed);
+		if (len == planeSize) memcpy (codec->Planes + k * planeSize, block + pos, planeSize);
+		else {
+			inflateReset (&(codec->Inflate));
+			codec->Inflate.next_in   = (unsigned char *) block + pos;
+			codec->Inflate.avail_in  = len;
+			codec->Inflate.next_out  = codec->Planes + k * planeSize;
+			codec->Inflate.avail_out = (uInt) planeSize;
+			if ((inflate (&(codec->Inflate), Z_FINISH) != Z_STREAM_END) || (codec->Inflate.total_out != planeSize)) return (CMfailed);
+		}
+		pos += len;
+	}
+	_MFdsPlanesJoin (data, codec->Planes, itemNum, itemSize, filters);
+	return (CMsucceeded);
+}
+
+// Reads the header of the next record, keeping its compression flags in the stream and the item type in the header
+static CMreturn _MFdsHeaderRead (MFDataStream_p dStream, MFdsHeader_p header) {
+	if (MFdsHeaderRead (header, dStream->Handle.File) == CMfailed) return (CMfailed);
+	dStream->Filters = header->Type & ~MFdsTypeMask;
+	header->Type    &= MFdsTypeMask;
+	return (CMsucceeded);
+}
+
+// Reads the data of the record whose header was read last. Compressed records are decoded in native byte order,
+// which is reported by resetting the header's swap flag.
+static CMreturn _MFdsDataRead (MFDataStream_p dStream, MFdsHeader_p header, void *data) {
+	size_t itemSize = MFVarItemSize (header->Type);
+	unsigned int blockLen;
+	MFdsCodec_p codec;
+
+	if ((dStream->Filters & MFdsCompressed) == 0)
+		return ((int) fread (data, itemSize, header->ItemNum, dStream->Handle.File) == header->ItemNum ? CMsucceeded : CMfailed);
+	if (fread (&blockLen, sizeof (unsigned int), 1, dStream->Handle.File) != 1) return (CMfailed);
+	if (header->Swap != 1) MFSwapWord (&blockLen);
+	if (((codec = _MFdsCodec (dStream, itemSize * header->ItemNum)) == (MFdsCodec_p) NULL) || (blockLen > codec->BlockSize)) return (CMfailed);
+	if (fread (codec->Block, 1, blockLen, dStream->Handle.File) != blockLen) return (CMfailed);
+	if (_MFdsDecode (codec, data, codec->Block, blockLen, header->ItemNum, itemSize, dStream->Filters, header->Swap != 1) == CMfailed) {
+		CMmsgPrint (CMmsgAppError,"Corrupt compressed record [%s] in: %s:%d",header->Date,__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	header->Swap = 1;
+	return (CMsucceeded);
+}
+
+// Skips the data of the record whose header was read last, reading through it when the file is not seekable
+CMreturn MFdsRecordSkip (MFdsHeader_p header,FILE *inFile) {
+	char buffer [4096];
+	unsigned int blockLen;
+	size_t size, len;
+
+	if (header->Type & MFdsCompressed) {
+		if (fread (&blockLen,sizeof (unsigned int),1,inFile) != 1) return (CMfailed);
+		if (header->Swap != 1) MFSwapWord (&blockLen);
+		size = blockLen;
+	}
+	else if ((size = MFVarItemSize (header->Type & MFdsTypeMask) * header->ItemNum) == 0) return (CMfailed);
+	if (fseeko (inFile,(off_t) size,SEEK_CUR) == 0) return (CMsucceeded);
+	for ( ; size > 0; size -= len) {
+		len = size < sizeof (buffer) ? size : sizeof (buffer);
+		if (fread (buffer,1,len,inFile) != len) return (CMfailed);
+	}
+	return (CMsucceeded);
+}
+
+typedef struct MFdsIndexHeader_s {
+	char  Tag [8];
+	short Swap;
+	int   RecordNum;
+	long long DataSize;
+} MFdsIndexHeader_t;
+
+static char *_MFdsIndexPath (const char *dsFile) {
+	char *indexPath;
+
+	if ((indexPath = (char *) malloc (strlen (dsFile) + strlen (MFdsIndexExt) + 1)) == (char *) NULL) {
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+		return ((char *) NULL);
+	}
+	sprintf (indexPath,"%s%s",dsFile,MFdsIndexExt);
+	return (indexPath);
+}
+
+static MFdsIndex_p _MFdsIndexCreate (int recordMax) {
+	MFdsIndex_p index;
+
+	if ((index = (MFdsIndex_p) calloc (1,sizeof (MFdsIndex_t))) == (MFdsIndex_p) NULL) {
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+		return ((MFdsIndex_p) NULL);
+	}
+	if (recordMax > 0) {
+		index->Dates   = (char (*) [MFDateStringLength]) calloc (recordMax,MFDateStringLength);
+		index->Offsets = (long long *) calloc (recordMax,sizeof (long long));
+		if ((index->Dates == NULL) || (index->Offsets == (long long *) NULL)) {
+			CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+			MFdsIndexFree (index);
+			return ((MFdsIndex_p) NULL);
+		}
+		index->RecordMax = recordMax;
+	}
+	return (index);
+}
+
+static CMreturn _MFdsIndexAdd (MFdsIndex_p index, const char *date, long long offset) {
+	int recordMax;
+	void *ptr;
+
+	if (index->RecordNum == index->RecordMax) {
+		recordMax = index->RecordMax > 0 ? index->RecordMax * 2 : 366;
+		if ((ptr = realloc (index->Dates,recordMax * MFDateStringLength)) == (void *) NULL) {
+			CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+			return (CMfailed);
+		}
+		index->Dates = (char (*) [MFDateStringLength]) ptr;
+		if ((ptr = realloc (index->Offsets,recordMax * sizeof (long long))) == (void *) NULL) {
+			CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+			return (CMfailed);
+		}
+		index->Offsets   = (long long *) ptr;
+		index->RecordMax = recordMax;
+	}
+	strncpy (index->Dates [index->RecordNum],date,MFDateStringLength - 1);
+	index->Dates [index->RecordNum][MFDateStringLength - 1] = '\0';
+	index->Offsets [index->RecordNum++] = offset;
+	return (CMsucceeded);
+}
+
+void MFdsIndexFree (MFdsIndex_p index) {
+	if (index == (MFdsIndex_p) NULL) return;
+	if (index->Dates   != NULL)               free (index->Dates);
+	if (index->Offsets != (long long *) NULL) free (index->Offsets);
+	free (index);
+}
+
+// Loads the index of a data stream file. Missing indices are not an error, stale or damaged ones are ignored with a warning.
+MFdsIndex_p MFdsIndexLoad (const char *dsFile) {
+	int i;
+	char *indexPath;
+	FILE *inFile;
+	struct stat dsStat;
+	MFdsIndexHeader_t header;
+	MFdsIndex_p index = (MFdsIndex_p) NULL;
+
+	if ((stat (dsFile,&dsStat) != 0) || !S_ISREG (dsStat.st_mode)) return ((MFdsIndex_p) NULL);
+	if ((indexPath = _MFdsIndexPath (dsFile)) == (char *) NULL) return ((MFdsIndex_p) NULL);
+	if ((inFile = fopen (indexPath,"r")) == (FILE *) NULL) { free (indexPath); return ((MFdsIndex_p) NULL); }
+	if ((fread (&header,sizeof (MFdsIndexHeader_t),1,inFile) != 1) || (strncmp (header.Tag,MFdsIndexTag,sizeof (header.Tag)) != 0)) goto Invalid;
+	if (header.Swap != 1) { MFSwapWord (&(header.RecordNum)); MFSwapLongWord (&(header.DataSize)); }
+	if ((header.DataSize != (long long) dsStat.st_size) || (header.RecordNum < 1)) goto Invalid;
+	if ((index = _MFdsIndexCreate (header.RecordNum)) == (MFdsIndex_p) NULL) goto Invalid;
+	if ((fread (index->Dates,  MFDateStringLength,header.RecordNum,inFile) != (size_t) header.RecordNum) ||
+	    (fread (index->Offsets,sizeof (long long),header.RecordNum,inFile) != (size_t) header.RecordNum)) goto Invalid;
+	index->RecordNum = header.RecordNum;
+	index->DataSize  = header.DataSize;
+	for (i = 0; i < index->RecordNum; ++i) {
+		if (header.Swap != 1) MFSwapLongWord (index->Offsets + i);
+		index->Dates [i][MFDateStringLength - 1] = '\0';
+		if ((index->Offsets [i] < 0) || (index->Offsets [i] >= index->DataSize)) goto Invalid;
+		if ((i > 0) && ((index->Offsets [i] <= index->Offsets [i - 1]) || (strcmp (index->Dates [i - 1],index->Dates [i]) > 0))) goto Invalid;
+	}
+	fclose (inFile);
+	free (indexPath);
+	return (index);
+Invalid:
+	CMmsgPrint (CMmsgWarning,"Warning: Ignoring stale or damaged date index [%s]",indexPath);
+	MFdsIndexFree (index);
+	fclose (inFile);
+	free (indexPath);
+	return ((MFdsIndex_p) NULL);
+}
+
+// Builds the index of a data stream file by reading through its record headers
+MFdsIndex_p MFdsIndexScan (FILE *inFile) {
+	off_t offset;
+	MFdsHeader_t header;
+	MFdsIndex_p index;
+
+	if (fseeko (inFile,0,SEEK_SET) != 0) {
+		CMmsgPrint (CMmsgUsrError,"Data stream is not seekable!");
+		return ((MFdsIndex_p) NULL);
+	}
+	if ((index = _MFdsIndexCreate (0)) == (MFdsIndex_p) NULL) return ((MFdsIndex_p) NULL);
+	while (((offset = ftello (inFile)) != -1) && (MFdsHeaderRead (&header,inFile) == CMsucceeded)) {
+		if ((_MFdsIndexAdd (index,header.Date,(long long) offset) == CMfailed) || (MFdsRecordSkip (&header,inFile) == CMfailed)) {
+			CMmsgPrint (CMmsgUsrError,"Truncated data stream record [%s]!",header.Date);
+			MFdsIndexFree (index);
+			return ((MFdsIndex_p) NULL);
+		}
+	}
+	index->DataSize = (long long) offset;
+	return (index);
+}
+
+CMreturn MFdsIndexSave (MFdsIndex_p index, const char *dsFile) {
+	bool written;
+	char *indexPath;
+	FILE *outFile;
+	MFdsIndexHeader_t header;
+
+	if ((indexPath = _MFdsIndexPath (dsFile)) == (char *) NULL) return (CMfailed);
+	memset (&header,0,sizeof (MFdsIndexHeader_t));
+	memcpy (header.Tag,MFdsIndexTag,sizeof (header.Tag));
+	header.Swap      = 1;
+	header.RecordNum = index->RecordNum;
+	header.DataSize  = index->DataSize;
+	if ((outFile = fopen (indexPath,"w")) == (FILE *) NULL) {
+		CMmsgPrint (CMmsgSysError,"Date index [%s] opening error!",indexPath);
+		free (indexPath);
+		return (CMfailed);
+	}
+	written = (fwrite (&header,sizeof (MFdsIndexHeader_t),1,outFile) == 1) &&
+	          (fwrite (index->Dates,  MFDateStringLength,index->RecordNum,outFile) == (size_t) index->RecordNum) &&
+	          (fwrite (index->Offsets,sizeof (long long),index->RecordNum,outFile) == (size_t) index->RecordNum);
+	if ((fclose (outFile) != 0) || !written) {
+		CMmsgPrint (CMmsgSysError,"Date index [%s] writing error!",indexPath);
+		unlink (indexPath);
+		free (indexPath);
+		return (CMfailed);
+	}
+	free (indexPath);
+	return (CMsucceeded);
+}
+
+// First record that is not before the date (RecordNum when there is none)
+int MFdsIndexFind (MFdsIndex_p index, const char *date) {
+	int low = 0, high = index->RecordNum, mid;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (MFDateCompare (index->Dates [mid],date) < 0) low = mid + 1;
+		else high = mid;
+	}
+	return (low);
+}
+
+// Moves the file forward to the first record that is not before the date. The header found there must carry the
+// indexed date, otherwise the index does not belong to the file: the position is restored and the call fails.
+CMreturn MFdsIndexSeek (MFdsIndex_p index, FILE *inFile, const char *date) {
+	int recordID;
+	off_t offset;
+	MFdsHeader_t header;
+
+	if ((index == (MFdsIndex_p) NULL) || ((recordID = MFdsIndexFind (index,date)) >= index->RecordNum)) return (CMsucceeded);
+	if (((offset = ftello (inFile)) == -1) || (index->Offsets [recordID] <= (long long) offset)) return (CMsucceeded);
+	if ((fseeko (inFile,(off_t) index->Offsets [recordID],SEEK_SET) == 0) &&
+	    (MFdsHeaderRead (&header,inFile) == CMsucceeded) && (strcmp (header.Date,index->Dates [recordID]) == 0) &&
+	    (fseeko (inFile,(off_t) index->Offsets [recordID],SEEK_SET) == 0)) return (CMsucceeded);
+	fseeko (inFile,offset,SEEK_SET);
+	return (CMfailed);
+}
+
+// Writes a record, encoding its data for zfile: streams. Compressed records carry the codec flags in the header type
+// and the block length ahead of the block, so readers can skip them without decoding.
+static CMreturn _MFdsRecordPut (MFDataStream_p dStream, MFdsHeader_p header, const void *data) {
+	size_t itemSize = MFVarItemSize (header->Type), blockLen;
+	MFdsHeader_t blockHeader;
+	MFdsCodec_p codec;
+
+	if ((dStream->Index != (MFdsIndex_p) NULL) && (_MFdsIndexAdd (dStream->Index, header->Date, (long long) ftello (dStream->Handle.File)) == CMfailed)) {
+		MFdsIndexFree (dStream->Index); // The records are still written, only without an index
+		dStream->Index = (MFdsIndex_p) NULL;
+	}
+	if (!dStream->Compress) {
+		if (MFdsHeaderWrite (header, dStream->Handle.File) != CMsucceeded) return (CMfailed);
+		if ((int) fwrite (data, itemSize, header->ItemNum, dStream->Handle.File) != header->ItemNum) {
+			CMmsgPrint (CMmsgSysError,"Data writing error (%s:%d)!",__FILE__,__LINE__);
+			return (CMfailed);
+		}
+		return (CMsucceeded);
+	}
+	if ((codec = _MFdsCodec (dStream, itemSize * header->ItemNum)) == (MFdsCodec_p) NULL) return (CMfailed);
+	if (dStream->Filters == 0) { // The first record decides whether the delta filter pays off for the variable
+		dStream->Filters = MFdsCompressed | _MFdsFilters;
+		if ((dStream->Filters & MFdsDelta) &&
+		    (_MFdsEncode (codec, data, header->ItemNum, itemSize, dStream->Filters & ~MFdsDelta) <
+		     _MFdsEncode (codec, data, header->ItemNum, itemSize, dStream->Filters))) dStream->Filters &= ~MFdsDelta;
+	}
+	if ((blockLen = _MFdsEncode (codec, data, header->ItemNum, itemSize, dStream->Filters)) == 0) return (CMfailed);
+	memcpy (&blockHeader, header, sizeof (MFdsHeader_t));
+	blockHeader.Type |= dStream->Filters;
+	if (MFdsHeaderWrite (&blockHeader, dStream->Handle.File) != CMsucceeded) return (CMfailed);
+	if (fwrite (codec->Block, 1, blockLen, dStream->Handle.File) != blockLen) {
+		CMmsgPrint (CMmsgSysError,"Data writing error (%s:%d)!",__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	return (CMsucceeded);
+}
+
+typedef struct MFdsRecord_s {
+	MFDataStream_p Stream;
+	MFdsHeader_t   Header;
+	void  *Data;
+	size_t Size, Capacity;
+	struct MFdsRecord_s *Next;
+} MFdsRecord_t, *MFdsRecord_p;
+
+// Single writer thread draining the records queued by MFdsRecordWrite for write-behind streams. Written
+// records go back to the Free list, so steady state runs without allocations; Bytes caps what is queued.
+// MFDataStreamFlush stops and joins the thread, which the next queued record starts again.
+static struct MFdsWriter_s {
+	bool Started, Stop;
+	CMreturn Status;
+	size_t Bytes;
+	pthread_t Thread;
+	pthread_mutex_t Mutex;
+	pthread_cond_t  Cond;
+	MFdsRecord_p Head, Tail, Free;
+} _MFdsWriter = { false, false, CMsucceeded, 0, (pthread_t) 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                  (MFdsRecord_p) NULL, (MFdsRecord_p) NULL, (MFdsRecord_p) NULL };
+
+static void *_MFdsWriterWork (void *dataPtr) {
+	MFdsRecord_p record;
+	CMreturn status;
+
+	(void) dataPtr;
+	pthread_mutex_lock (&(_MFdsWriter.Mutex));
+	for (;;) {
+		while ((_MFdsWriter.Head == (MFdsRecord_p) NULL) && !_MFdsWriter.Stop) pthread_cond_wait (&(_MFdsWriter.Cond), &(_MFdsWriter.Mutex));
+		if ((record = _MFdsWriter.Head) == (MFdsRecord_p) NULL) break;
+		pthread_mutex_unlock (&(_MFdsWriter.Mutex));
+
+		status = _MFdsRecordPut (record->Stream, &(record->Header), record->Data);
+
+		pthread_mutex_lock (&(_MFdsWriter.Mutex));
+		if (status == CMfailed) _MFdsWriter.Status = CMfailed;
+		if ((_MFdsWriter.Head = record->Next) == (MFdsRecord_p) NULL) _MFdsWriter.Tail = (MFdsRecord_p) NULL;
+		_MFdsWriter.Bytes -= record->Size;
+		record->Next = _MFdsWriter.Free;
+		_MFdsWriter.Free = record;
+		pthread_cond_broadcast (&(_MFdsWriter.Cond));
+	}
+	pthread_mutex_unlock (&(_MFdsWriter.Mutex));
+	return ((void *) NULL);
+}
+
+static CMreturn _MFdsWriterQueue (MFDataStream_p dStream, MFdsHeader_p header, const void *data, size_t size) {
+	MFdsRecord_p record;
+	void *buffer;
+
+	pthread_mutex_lock (&(_MFdsWriter.Mutex));
+	if (!_MFdsWriter.Started) {
+		if (pthread_create (&(_MFdsWriter.Thread), NULL, _MFdsWriterWork, (void *) NULL) != 0) {
+			pthread_mutex_unlock (&(_MFdsWriter.Mutex));
+			CMmsgPrint (CMmsgSysError,"Writer thread creation error in: %s:%d",__FILE__,__LINE__);
+			return (CMfailed);
+		}
+		_MFdsWriter.Started = true;
+	}
+	while ((_MFdsWriter.Head != (MFdsRecord_p) NULL) && (_MFdsWriter.Bytes + size > MFdsWriteBehindLimit))
+		pthread_cond_wait (&(_MFdsWriter.Cond), &(_MFdsWriter.Mutex));
+	if (_MFdsWriter.Status == CMfailed) { pthread_mutex_unlock (&(_MFdsWriter.Mutex)); return (CMfailed); }
+	if ((record = _MFdsWriter.Free) != (MFdsRecord_p) NULL) _MFdsWriter.Free = record->Next;
+	pthread_mutex_unlock (&(_MFdsWriter.Mutex));
+
+	if ((record == (MFdsRecord_p) NULL) && ((record = (MFdsRecord_p) calloc (1, sizeof (MFdsRecord_t))) == (MFdsRecord_p) NULL)) {
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	if (record->Capacity < size) {
+		if ((buffer = realloc (record->Data, size)) == (void *) NULL) {
+			CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+			if (record->Data != (void *) NULL) free (record->Data);
+			free (record);
+			return (CMfailed);
+		}
+		record->Data     = buffer;
+		record->Capacity = size;
+	}
+	record->Stream = dStream;
+	record->Size   = size;
+	record->Next   = (MFdsRecord_p) NULL;
+	memcpy (&(record->Header), header, sizeof (MFdsHeader_t));
+	memcpy (record->Data, data, size);
+
+	pthread_mutex_lock (&(_MFdsWriter.Mutex));
+	if (_MFdsWriter.Tail == (MFdsRecord_p) NULL) _MFdsWriter.Head = record;
+	else _MFdsWriter.Tail->Next = record;
+	_MFdsWriter.Tail   = record;
+	_MFdsWriter.Bytes += size;
+	pthread_cond_broadcast (&(_MFdsWriter.Cond));
+	pthread_mutex_unlock   (&(_MFdsWriter.Mutex));
+	return (CMsucceeded);
+}
+
+// Records of broadcast variables are the same for every member and go to each member file unchanged
+static CMreturn _MFdsRecordSend (MFDataStream_p dStream, MFdsHeader_p header, const void *data) {
+	int member;
+
+	if (dStream->Type == MFEnsemble) {
+		for (member = 0; member < dStream->MemberNum; ++member)
+			if (_MFdsRecordSend (dStream->Members [member], header, data) == CMfailed) return (CMfailed);
+		return (CMsucceeded);
+	}
+	if (dStream->WriteBehind)
+		return (_MFdsWriterQueue (dStream, header, data, (size_t) MFVarItemSize (header->Type) * header->ItemNum));
+	return (_MFdsRecordPut (dStream, header, data));
+}
+
+// Waits for the queued records, joins the writer thread and reports a write error once, so a failed run
+// does not fail the later ones of the same process
+CMreturn MFDataStreamFlush () {
+	CMreturn status;
+	bool started;
+
+	pthread_mutex_lock (&(_MFdsWriter.Mutex));
+	while (_MFdsWriter.Head != (MFdsRecord_p) NULL) pthread_cond_wait (&(_MFdsWriter.Cond), &(_MFdsWriter.Mutex));
+	if ((started = _MFdsWriter.Started)) {
+		_MFdsWriter.Stop = true;
+		pthread_cond_broadcast (&(_MFdsWriter.Cond));
+	}
+	pthread_mutex_unlock (&(_MFdsWriter.Mutex));
+	if (started) pthread_join (_MFdsWriter.Thread, (void **) NULL);
+
+	pthread_mutex_lock (&(_MFdsWriter.Mutex));
+	status = _MFdsWriter.Status;
+	_MFdsWriter.Status  = CMsucceeded;
+	_MFdsWriter.Started = _MFdsWriter.Stop = false;
+	pthread_mutex_unlock (&(_MFdsWriter.Mutex));
+	return (status);
+}
+
+// Puts a newly opened input file back to a record start saved from its Offset, so reading resumes there
+CMreturn MFDataStreamSeek (MFDataStream_p dStream, long long offset) {
+	MFdsHeader_t header;
+
+	if ((dStream->Type != MFFile) || (offset < 0)) return (CMsucceeded); // Pipes are read through again
+	if ((fseeko (dStream->Handle.File,(off_t) offset,SEEK_SET) == 0) && (MFdsHeaderRead (&header,dStream->Handle.File) == CMsucceeded) &&
+	    (fseeko (dStream->Handle.File,(off_t) offset,SEEK_SET) == 0)) return (CMsucceeded);
+	CMmsgPrint (CMmsgAppError,"Error: No data stream record at offset %lld in: %s:%d",offset,__FILE__,__LINE__);
+	return (CMfailed);
+}
+
+// Continues an output file opened with "r+" after its first offset bytes: the records there are kept (and indexed
+// again), anything written past them is dropped. The records must end exactly at the offset.
+CMreturn MFDataStreamResume (MFDataStream_p dStream, long long offset) {
+	off_t pos = 0;
+	MFdsHeader_t header;
+
+	if ((dStream->Type != MFFile) || (offset < 0)) return (CMsucceeded);
+	if (fseeko (dStream->Handle.File,0,SEEK_SET) != 0) return (CMfailed);
+	while ((long long) pos < offset) {
+		if ((MFdsHeaderRead (&header,dStream->Handle.File) == CMfailed) || (MFdsRecordSkip (&header,dStream->Handle.File) == CMfailed)) break;
+		// Compressed outputs keep the filters the first record settled on
+		if (dStream->Compress && (pos == 0)) dStream->Filters = header.Type & ~MFdsTypeMask;
+		if ((dStream->Index != (MFdsIndex_p) NULL) && (_MFdsIndexAdd (dStream->Index,header.Date,(long long) pos) == CMfailed)) {
+			MFdsIndexFree (dStream->Index);
+			dStream->Index = (MFdsIndex_p) NULL;
+		}
+		if ((pos = ftello (dStream->Handle.File)) == -1) break;
+	}
+	if ((long long) pos != offset) {
+		CMmsgPrint (CMmsgAppError,"Error: Data stream ends at %lld instead of %lld in: %s:%d",(long long) pos,offset,__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	if ((fflush (dStream->Handle.File) != 0) || (ftruncate (fileno (dStream->Handle.File),(off_t) offset) != 0) ||
+	    (fseeko (dStream->Handle.File,(off_t) offset,SEEK_SET) != 0)) {
+		CMmsgPrint (CMmsgSysError,"Error: Data stream truncation error in: %s:%d",__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	return (CMsucceeded);
+}
+
+static char *_MFdsMemberPath (const char *path, int member) {
+	char *memberPath, *next, number [16];
+	size_t pos = 0;
+
+	snprintf (number, sizeof (number), "%d", member);
+	if ((memberPath = (char *) malloc (strlen (path) * (strlen (number) + 1) + 1)) == (char *) NULL) {
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+		return ((char *) NULL);
+	}
+	while ((next = strstr (path, MFmemberStr)) != (char *) NULL) {
+		memcpy (memberPath + pos, path, next - path);
+		pos += next - path;
+		memcpy (memberPath + pos, number, strlen (number));
+		pos += strlen (number);
+		path = next + strlen (MFmemberStr);
+	}
+	strcpy (memberPath + pos, path);
+	return (memberPath);
+}
+
+// Output split into one stream per ensemble member (see MFdsRecordWriteData)
+static MFDataStream_p _MFdsMembersOpen (const char *path, const char *mode) {
+	int member;
+	char *memberPath;
+	MFDataStream_p dStream;
+
+	if (_MFdsMemberNum == 1) {
+		if ((memberPath = _MFdsMemberPath (path, 1)) == (char *) NULL) return ((MFDataStream_p) NULL);
+		dStream = MFDataStreamOpen (memberPath, mode);
+		free (memberPath);
+		return (dStream);
+	}
+	if (strcmp (mode,"r") == 0) {
+		CMmsgPrint (CMmsgAppError,"Error: Per member (%s) inputs [%s] are not supported, members share their inputs!",MFmemberStr,path);
+		return ((MFDataStream_p) NULL);
+	}
+	if (((dStream = (MFDataStream_p) calloc (1, sizeof (MFDataStream_t))) == (MFDataStream_p) NULL) ||
+	    ((dStream->Members = (MFDataStream_p *) calloc (_MFdsMemberNum, sizeof (MFDataStream_p))) == (MFDataStream_p *) NULL)) {
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d\n",__FILE__,__LINE__);
+		if (dStream != (MFDataStream_p) NULL) free (dStream);
+		return ((MFDataStream_p) NULL);
+	}
+	dStream->Type   = MFEnsemble;
+	dStream->Offset = dStream->NextOffset = -1;
+	for (member = 0; member < _MFdsMemberNum; ++member) {
+		if ((memberPath = _MFdsMemberPath (path, member + 1)) != (char *) NULL) {
+			dStream->Members [member] = MFDataStreamOpen (memberPath, mode);
+			free (memberPath);
+		}
+		if (dStream->Members [member] == (MFDataStream_p) NULL) {
+			MFDataStreamClose (dStream);
+			free (dStream);
+			return ((MFDataStream_p) NULL);
+		}
+		dStream->MemberNum = member + 1;
+	}
+	return (dStream);
+}
+
 MFDataStream_p MFDataStreamOpen (const char *path, const char *mode) {
+	char *indexPath;
 	MFDataStream_p dStream;
 
 	if (path == (char *) NULL) return ((MFDataStream_p) NULL);
+	if (strstr (path, MFmemberStr) != (char *) NULL) return (_MFdsMembersOpen (path, mode));
 	if ((dStream = (MFDataStream_p) malloc (sizeof (MFDataStream_t))) == (MFDataStream_p) NULL) {
 		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d\n",__FILE__,__LINE__);
 		return (MFDataStream_p) NULL;
 	}
+	dStream->Prefetch = false;
+	dStream->WriteBehind = false;
+	dStream->Stop     = false;
+	dStream->State    = MFdsEmpty;
+	dStream->Buffer   = (void *) NULL;
+	dStream->Shuffle  = (void *) NULL;
+	dStream->Compress = false;
+	dStream->Filters  = 0;
+	dStream->Codec    = (void *) NULL;
+	dStream->Path     = (char *) NULL;
+	dStream->Index    = (MFdsIndex_p) NULL;
+	dStream->Offset   = dStream->NextOffset = -1;
+	dStream->ItemNum  = 0;
+	dStream->MemberNum = 0;
+	dStream->Members  = (MFDataStream_p *) NULL;
 	if      (strncmp (path,MFconstStr,strlen (MFconstStr)) == 0) {
 		if (strcmp (mode,"r") == 0) { dStream->Type = MFConst; return (dStream); }
 		CMmsgPrint (CMmsgAppError,"Error: Invalid output data stream [%s] in: %s:%d\n",path + strlen (MFconstStr),__FILE__,__LINE__);
@@ -45,22 +787,170 @@ MFDataStream_p MFDataStreamOpen (const char *path, const char *mode) {
 			dStream = (MFDataStream_p) NULL;
 		}
 	}
+	else if (strncmp (path,MFzfileStr, strlen (MFzfileStr)) == 0) {
+		// Compressed records are recognised from their headers, so zfile: only matters for writing
+		dStream->Type     = MFFile;
+		dStream->Compress = true;
+		if ((dStream->Handle.File = fopen (path + strlen (MFzfileStr),mode)) == (FILE *) NULL) {
+			CMmsgPrint (CMmsgSysError,"Error: Opening datastream file [%s] in: %s:%d\n",path + strlen (MFzfileStr),__FILE__,__LINE__);
+			free (dStream);
+			dStream = (MFDataStream_p) NULL;
+		}
+	}
 	else {
 		CMmsgPrint (CMmsgAppError,"Error: Unknown datastream type [%s]!\n",path);
 		free (dStream);
 		dStream = (MFDataStream_p) NULL;
 	}
+	if ((dStream != (MFDataStream_p) NULL) && (strcmp (mode,"r") != 0)) dStream->WriteBehind = _MFdsWriteBehind;
+	if ((dStream != (MFDataStream_p) NULL) && (dStream->Type == MFFile)) {
+		path = strchr (path,':') + 1;
+		if (strcmp (mode,"r") == 0) dStream->Index = MFdsIndexLoad (path);
+		else if ((indexPath = _MFdsIndexPath (path)) != (char *) NULL) {
+			unlink (indexPath); // The index of an earlier run would not describe the new records
+			free (indexPath);
+			if ((dStream->Path = strdup (path)) != (char *) NULL) dStream->Index = _MFdsIndexCreate (0);
+		}
+	}
 	return (dStream);
 }
 
+static void *_MFdsPrefetchWork (void *dataPtr) {
+	int i, state;
+	long long offset;
+	MFDataStream_p dStream = (MFDataStream_p) dataPtr;
+	MFdsHeader_t header;
+
+	pthread_mutex_lock (&(dStream->Mutex));
+	do {
+		while ((dStream->State == MFdsFull) && !dStream->Stop) pthread_cond_wait (&(dStream->Cond), &(dStream->Mutex));
+		if (dStream->Stop) break;
+		pthread_mutex_unlock (&(dStream->Mutex));
+
+		offset = (long long) ftello (dStream->Handle.File);
+		if (_MFdsHeaderRead (dStream, &header) == CMfailed) state = MFdsEnd;
+		else if ((header.ItemNum != dStream->ItemNum) || (header.Type != dStream->ItemType)) state = MFdsError;
+		else if (_MFdsDataRead (dStream, &header, _MFdsOrder != (const int *) NULL ? dStream->Shuffle : dStream->Buffer) == CMfailed) state = MFdsError;
+		else {
+			if (_MFdsOrder != (const int *) NULL) _MFdsPermute (dStream->Buffer, dStream->Shuffle, header.ItemNum, MFVarItemSize (header.Type), false);
+			if (header.Swap != 1)
+				switch (header.Type) {
+					case MFShort:  for (i = 0; i < header.ItemNum; ++i) MFSwapHalfWord((short *)  (dStream->Buffer) + i); break;
+					case MFInt:    for (i = 0; i < header.ItemNum; ++i) MFSwapWord((int *)        (dStream->Buffer) + i); break;
+					case MFFloat:  for (i = 0; i < header.ItemNum; ++i) MFSwapWord((float *)      (dStream->Buffer) + i); break;
+					case MFDouble: for (i = 0; i < header.ItemNum; ++i) MFSwapLongWord((double *) (dStream->Buffer) + i); break;
+					default: break;
+				}
+			state = MFdsFull;
+		}
+
+		pthread_mutex_lock (&(dStream->Mutex));
+		memcpy (&(dStream->Header), &header, sizeof (MFdsHeader_t));
+		dStream->NextOffset = offset;
+		dStream->State = state;
+		pthread_cond_broadcast (&(dStream->Cond));
+	} while (state == MFdsFull);
+	pthread_mutex_unlock (&(dStream->Mutex));
+	return ((void *) NULL);
+}
+
+static CMreturn _MFdsPrefetchStart (MFVariable_p var) {
+	MFDataStream_p dStream = var->InStream;
+
+	if ((dStream->Buffer = malloc (var->ItemNum * MFVarItemSize (var->Type))) == (void *) NULL) {
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	if ((_MFdsOrder != (const int *) NULL) && (_MFdsShuffle (dStream, var->ItemNum * MFVarItemSize (var->Type)) == (void *) NULL)) {
+		free (dStream->Buffer);
+		dStream->Buffer = (void *) NULL;
+		return (CMfailed);
+	}
+	dStream->ItemNum  = var->ItemNum;
+	dStream->ItemType = var->Type;
+	dStream->State    = MFdsEmpty;
+	dStream->Stop     = false;
+	pthread_mutex_init (&(dStream->Mutex), NULL);
+	pthread_cond_init  (&(dStream->Cond),  NULL);
+	if (pthread_create (&(dStream->Thread), NULL, _MFdsPrefetchWork, (void *) dStream) != 0) {
+		CMmsgPrint (CMmsgWarning,"Warning: Reading [%s] without prefetch in: %s:%d",var->Name,__FILE__,__LINE__);
+		pthread_mutex_destroy (&(dStream->Mutex));
+		pthread_cond_destroy  (&(dStream->Cond));
+		free (dStream->Buffer);
+		dStream->Buffer = (void *) NULL;
+		return (CMfailed);
+	}
+	dStream->Prefetch = true;
+	return (CMsucceeded);
+}
+
+// Hands the prefetched record to the variable by swapping buffers, so the reader can fill the old one.
+static int _MFdsPrefetchTake (MFVariable_p var, MFdsHeader_p header) {
+	int state;
+	void *buffer;
+	MFDataStream_p dStream = var->InStream;
+
+	pthread_mutex_lock (&(dStream->Mutex));
+	while (dStream->State == MFdsEmpty) pthread_cond_wait (&(dStream->Cond), &(dStream->Mutex));
+	if ((state = dStream->State) == MFdsFull) {
+		memcpy (header, &(dStream->Header), sizeof (MFdsHeader_t));
+		dStream->Offset = dStream->NextOffset;
+		buffer          = var->Buffer;
+		var->Buffer     = dStream->Buffer;
+		dStream->Buffer = buffer;
+		dStream->State  = MFdsEmpty;
+		pthread_cond_broadcast (&(dStream->Cond));
+	}
+	pthread_mutex_unlock (&(dStream->Mutex));
+	return (state);
+}
+
 int MFDataStreamClose (MFDataStream_p dStream)
 	{
+	int member, ret = CMsucceeded;
+
+	if ((dStream != (MFDataStream_p) NULL) && (dStream->Type == MFEnsemble)) {
+		for (member = 0; member < dStream->MemberNum; ++member) {
+			if (MFDataStreamClose (dStream->Members [member]) == CMfailed) ret = CMfailed;
+			free (dStream->Members [member]);
+		}
+		if (dStream->Members != (MFDataStream_p *) NULL) free (dStream->Members);
+		if (dStream->Shuffle != (void *) NULL) free (dStream->Shuffle);
+		dStream->Members   = (MFDataStream_p *) NULL;
+		dStream->Shuffle   = (void *) NULL;
+		dStream->MemberNum = 0;
+		return (ret);
+	}
 	if ((dStream == (MFDataStream_p) NULL) || (dStream->Handle.File == (FILE *) NULL)) return (CMsucceeded);
+	if (dStream->Prefetch) {
+		pthread_mutex_lock     (&(dStream->Mutex));
+		dStream->Stop = true;
+		pthread_cond_broadcast (&(dStream->Cond));
+		pthread_mutex_unlock   (&(dStream->Mutex));
+		pthread_join (dStream->Thread, (void **) NULL);
+		pthread_mutex_destroy (&(dStream->Mutex));
+		pthread_cond_destroy  (&(dStream->Cond));
+		free (dStream->Buffer);
+		dStream->Buffer   = (void *) NULL;
+		dStream->Prefetch = false;
+	}
+	// The write-behind thread may still be encoding records of this stream
+	if (dStream->WriteBehind && (MFDataStreamFlush () == CMfailed)) ret = CMfailed;
+	if (dStream->Shuffle != (void *) NULL) { free (dStream->Shuffle); dStream->Shuffle = (void *) NULL; }
+	_MFdsCodecFree (dStream);
+	if ((dStream->Path != (char *) NULL) && (dStream->Index != (MFdsIndex_p) NULL) && (fflush (dStream->Handle.File) == 0))
+		dStream->Index->DataSize = (long long) ftello (dStream->Handle.File);
 	switch (dStream->Type) {
-		case MFFile: return (fclose (dStream->Handle.File));
-		case MFPipe: return (pclose (dStream->Handle.File));
+		case MFFile: if (fclose (dStream->Handle.File) != 0) ret = CMfailed; dStream->Handle.File = (FILE *) NULL; break;
+		case MFPipe: if (pclose (dStream->Handle.File) == -1) ret = CMfailed; dStream->Handle.File = (FILE *) NULL; break;
 	}
-	return (CMsucceeded);
+	// Single record outputs (states) are not worth an index
+	if ((ret == CMsucceeded) && (dStream->Path != (char *) NULL) && (dStream->Index != (MFdsIndex_p) NULL) && (dStream->Index->RecordNum > 1))
+		MFdsIndexSave (dStream->Index, dStream->Path);
+	if (dStream->Path != (char *) NULL) { free (dStream->Path); dStream->Path = (char *) NULL; }
+	MFdsIndexFree (dStream->Index);
+	dStream->Index = (MFdsIndex_p) NULL;
+	return (ret);
 }
 
 CMreturn MFdsHeaderRead (MFdsHeader_p header,FILE *inFile) {
@@ -72,7 +962,7 @@ CMreturn MFdsHeaderRead (MFdsHeader_p header,FILE *inFile) {
 	if (header->Swap != 1) {
 		MFSwapHalfWord (&(header->Type));
 		MFSwapWord     (&(header->ItemNum));
-		switch (header->Type) {
+		switch (header->Type & MFdsTypeMask) {
 			case MFByte:
 			case MFShort:
 			case MFInt:		MFSwapWord     (&(header->Missing.Int));   break;
@@ -95,12 +985,63 @@ CMreturn MFdsHeaderWrite (MFdsHeader_p header,FILE *outFile) {
 	return (CMsucceeded);
 }
 
+static void _MFdsConstFill (MFVariable_p var, void *data, int itemNum) {
+	int i, member, memberNum = var->InStream->ItemNum;
+
+	switch (var->Type) {
+		case MFByte:  for (i = 0; i < itemNum; ++i) ((char *)  data) [i] = (char)  (var->InStream->Handle.Int);   break;
+		case MFShort: for (i = 0; i < itemNum; ++i) ((short *) data) [i] = (short) (var->InStream->Handle.Int);   break;
+		case MFInt:   for (i = 0; i < itemNum; ++i) ((int *)   data) [i] = (int)   (var->InStream->Handle.Int);   break;
+		case MFFloat:
+			if (memberNum > 1) // Per member list, the members of a cell are next to each other
+				for (i = 0; i < itemNum; i += memberNum)
+					for (member = 0; member < memberNum; ++member) ((float *) data) [i + member] = ((float *) var->Scalar) [member];
+			else for (i = 0; i < itemNum; ++i) ((float *) data) [i] = (float) (var->InStream->Handle.Float);
+			break;
+		default: break;
+	}
+}
+
+// const: lists give one value to each ensemble member, so they are held per item instead of broadcast
+static CMreturn _MFdsConstList (MFVariable_p var) {
+	int member, valueNum = 1;
+	const char *value = var->InputPath + strlen (MFconstStr);
+	char *end;
+
+	for (end = strchr (value,','); end != (char *) NULL; end = strchr (end + 1,',')) valueNum++;
+	if (valueNum != _MFdsMemberNum) {
+		CMmsgPrint (CMmsgUsrError,"Error: Constant [%s] lists %d values for %d ensemble members!",var->Name,valueNum,_MFdsMemberNum);
+		return (CMfailed);
+	}
+	var->Type = MFFloat;
+	var->Missing.Float = MFDefaultMissingFloat;
+	if (((var->Scalar = (void *) calloc (valueNum, sizeof (float)))         == (void *) NULL) ||
+	    ((var->Buffer = (void *) malloc (var->ItemNum * sizeof (float))) == (void *) NULL)) {
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	for (member = 0; member < valueNum; ++member) {
+		((float *) var->Scalar) [member] = (float) strtod (value, &end);
+		if ((end == value) || (*end != (member + 1 < valueNum ? ',' : '\0'))) {
+			CMmsgPrint (CMmsgAppError,"Error: Reading constant [%s]!\n",var->Name);
+			return (CMfailed);
+		}
+		value = end + 1;
+	}
+	var->InStream->ItemNum = valueNum;
+	return (CMsucceeded);
+}
+
 CMreturn MFdsRecordRead (MFVariable_p var) {
 	int i, sLen, readNum = 0;
+	long long offset;
 	MFdsHeader_t header;
 
     if (var->InStream->Type == MFConst) {
-		if (var->Buffer == (void *) NULL) {
+		if ((var->Scalar == (void *) NULL) && (strchr (var->InputPath,',') != (char *) NULL)) {
+			if (_MFdsConstList (var) == CMfailed) return (CMfailed);
+		}
+		else if (var->Scalar == (void *) NULL) {
 			sLen = strlen (var->InputPath);
 			for (i = strlen (MFconstStr);i < sLen;++i) if (var->InputPath [i] == '.') break;
 			if (i == sLen) {
@@ -131,37 +1072,51 @@ CMreturn MFdsRecordRead (MFVariable_p var) {
 				var->Missing.Float = CMmathEqualValues (var->InStream->Handle.Float,MFDefaultMissingFloat) ?
 									 (float) 0.0 : MFDefaultMissingFloat;
 			}
- 			if ((var->Buffer = (void *) calloc (var->ItemNum,MFVarItemSize (var->Type))) == (void *) NULL) {
+ 			if ((var->Scalar = (void *) calloc (1,MFVarItemSize (var->Type))) == (void *) NULL) {
 				CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
 				return (CMfailed);
 			}
+			_MFdsConstFill (var, var->Scalar, 1);
+			var->Broadcast = true;
 		}
-		switch (var->Type) {
-			case MFByte:
-				for (i = 0; i < var->ItemNum; ++i)
-					((char *)  (var->Buffer)) [i]  = (char)   (var->InStream->Handle.Int);
-				break;
-			case MFShort:
-				for (i = 0; i < var->ItemNum; ++i)
-					((short *) (var->Buffer)) [i ] = (short)  (var->InStream->Handle.Int);
-				break;
-			case MFInt:
-				for (i = 0; i < var->ItemNum; ++i)
-					((int *)   (var->Buffer)) [i]  = (int)    (var->InStream->Handle.Int);
-				break;
-			case MFFloat:
-				for (i = 0; i < var->ItemNum; ++i)
-					((float *) (var->Buffer)) [i]  = (float)  (var->InStream->Handle.Float);
-				break;
-            default:
-                break;
-		}
+		// Variables written by a module were expanded and get their constant restored every step
+		if (!var->Broadcast) _MFdsConstFill (var, var->Buffer, var->ItemNum);
 	}
 	else {
 		if (var->InStream->Handle.File == (FILE *) NULL) return (CMfailed);
-		if (MFDateCompare(var->CurDate, var->InDate) != 0) {
+		if (var->InStream->Prefetch && (MFDateCompare(var->CurDate, var->InDate) != 0)) {
+			do {
+				switch (_MFdsPrefetchTake (var, &header)) {
+					case MFdsError:
+						CMmsgPrint(CMmsgSysError, "Data stream (%s %s %s) reading error", var->Name, var->CurDate, var->InDate);
+						return (CMfailed);
+					case MFdsEnd:
+						if (readNum < 1) {
+							CMmsgPrint(CMmsgSysError, "Data stream (%s %s %s) reading error", var->Name, var->CurDate, var->InDate);
+							return (CMfailed);
+						}
+						break;
+					default:
+						readNum++;
+						strcpy (var->CurDate, header.Date);
+						continue;
+				}
+				break;
+			} while (MFDateCompare(header.Date, var->InDate) < 0);
+			if ((var->NStep = MFDateTimeStepLength(var->InDate, var->TStep)) == 0) {
+				CMmsgPrint(CMmsgUsrError, "Invalid data stream [%s %s] in: %s, %d",var->Name, var->InDate, __FILE__, __LINE__);
+				return (CMfailed);
+			}
+		}
+		else if (MFDateCompare(var->CurDate, var->InDate) != 0) {
+			if (MFdsIndexSeek (var->InStream->Index, var->InStream->Handle.File, var->InDate) == CMfailed) {
+				CMmsgPrint (CMmsgWarning, "Warning: Ignoring mismatching date index of [%s]", var->Name);
+				MFdsIndexFree (var->InStream->Index);
+				var->InStream->Index = (MFdsIndex_p) NULL;
+			}
 			do {
-				if (MFdsHeaderRead(&header, var->InStream->Handle.File) == CMfailed) {
+				offset = (long long) ftello (var->InStream->Handle.File);
+				if (_MFdsHeaderRead(var->InStream, &header) == CMfailed) {
 					if (readNum < 1) {
 						CMmsgPrint(CMmsgSysError, "Data stream (%s %s %s) reading error", var->Name, var->CurDate, var->InDate);
 						return (CMfailed);
@@ -224,13 +1179,18 @@ CMreturn MFdsRecordRead (MFVariable_p var) {
 							   __FILE__, __LINE__);
 					return (CMfailed);
 				}
-				if ((int) fread(var->Buffer, MFVarItemSize(var->Type), var->ItemNum, var->InStream->Handle.File) !=
-					var->ItemNum) {
+				if (_MFdsDataRead(var->InStream, &header, var->Buffer) == CMfailed) {
 					CMmsgPrint(CMmsgSysError, "Data Reading error (%s:%d)!", __FILE__, __LINE__);
 					return (CMfailed);
 				}
 				strcpy (var->CurDate, header.Date);
+				var->InStream->Offset = offset;
 			} while (MFDateCompare(header.Date, var->InDate) < 0);
+			if (_MFdsOrder != (const int *) NULL) {
+				if (_MFdsShuffle (var->InStream, var->ItemNum * MFVarItemSize (var->Type)) == (void *) NULL) return (CMfailed);
+				memcpy (var->InStream->Shuffle, var->Buffer, var->ItemNum * MFVarItemSize (var->Type));
+				_MFdsPermute (var->Buffer, var->InStream->Shuffle, var->ItemNum, MFVarItemSize (var->Type), false);
+			}
 			if (header.Swap != 1)
 				switch (var->Type) {
 					case MFShort:  for (i = 0; i < var->ItemNum; ++i) MFSwapHalfWord((short *)  (var->Buffer) + i); break;
@@ -243,14 +1203,19 @@ CMreturn MFdsRecordRead (MFVariable_p var) {
 				CMmsgPrint(CMmsgUsrError, "Invalid data stream [%s %s] in: %s, %d",var->Name, var->InDate, __FILE__, __LINE__);
 				return (CMfailed);
 			}
+			if (_MFdsPrefetch && !var->Initial && (var->InStream->State == MFdsEmpty) && (_MFdsPrefetchStart (var) == CMfailed))
+				var->InStream->State = MFdsError; // Stays synchronous
 		}
 	}
 	return (CMsucceeded);
 }
 
 CMreturn MFdsRecordWrite (MFVariable_p var) {
+	int i;
 	MFdsHeader_t header;
+	const void *data = var->Buffer;
 
+	memset (&header, 0, sizeof (header));
 	header.Type    = var->Type;
 	header.ItemNum = var->ItemNum;
 	header.Swap    = 1;
@@ -263,10 +1228,51 @@ CMreturn MFdsRecordWrite (MFVariable_p var) {
 		case MFDouble: header.Missing.Float = var->Missing.Float; break;
 		default:	break;
 	}
-	if (MFdsHeaderWrite (&(header),var->OutStream->Handle.File) != CMsucceeded) return (CMfailed);
-	if (fwrite (var->Buffer, (size_t) MFVarItemSize (var->Type), var->ItemNum, var->OutStream->Handle.File) != var->ItemNum) {
-		CMmsgPrint (CMmsgSysError,"Data writing error (%s:%d)!",__FILE__,__LINE__);
+	if (!var->Broadcast) return (MFdsRecordWriteData (var->OutStream, &header, data));
+
+	if (_MFdsMemberNum > 1) header.ItemNum = _MFdsCellNum;
+	if ((data = _MFdsShuffle (var->OutStream, (size_t) MFVarItemSize (var->Type) * header.ItemNum)) == (void *) NULL) return (CMfailed);
+	for (i = 0; i < header.ItemNum; ++i) memcpy ((char *) var->OutStream->Shuffle + i * MFVarItemSize (var->Type), var->Scalar, MFVarItemSize (var->Type));
+	return (_MFdsRecordSend (var->OutStream, &header, data));
+}
+
+// Writes a record given in model cell order. Ensemble records are split into the member files, while records of
+// the inputs the members share (one item per cell) are written to each of them.
+CMreturn MFdsRecordWriteData (MFDataStream_p dStream, MFdsHeader_p header, const void *data) {
+	int member;
+	size_t itemSize = MFVarItemSize (header->Type);
+	MFdsHeader_t memberHeader;
+
+	if (dStream->Type == MFEnsemble) {
+		if (header->ItemNum == _MFdsCellNum) {
+			for (member = 0; member < dStream->MemberNum; ++member)
+				if (MFdsRecordWriteData (dStream->Members [member], header, data) == CMfailed) return (CMfailed);
+			return (CMsucceeded);
+		}
+		if (header->ItemNum != _MFdsCellNum * _MFdsMemberNum) {
+			CMmsgPrint (CMmsgAppError,"Error: Invalid ensemble record [%s] in: %s:%d",header->Date,__FILE__,__LINE__);
+			return (CMfailed);
+		}
+		if (_MFdsShuffle (dStream, itemSize * _MFdsCellNum) == (void *) NULL) return (CMfailed);
+		memcpy (&memberHeader, header, sizeof (MFdsHeader_t));
+		memberHeader.ItemNum = _MFdsCellNum;
+		for (member = 0; member < dStream->MemberNum; ++member) {
+			_MFdsMemberGather (dStream->Shuffle, data, member, itemSize);
+			if (MFdsRecordWriteData (dStream->Members [member], &memberHeader, dStream->Shuffle) == CMfailed) return (CMfailed);
+		}
+		return (CMsucceeded);
+	}
+	if ((_MFdsMemberNum > 1) && (header->ItemNum != _MFdsCellNum)) {
+		CMmsgPrint (CMmsgAppError,"Error: Ensemble record [%s] needs per member (%s) output files!",header->Date,MFmemberStr);
 		return (CMfailed);
 	}
-	return (CMsucceeded);
+
+	if (_MFdsOrder != (const int *) NULL) {
+		if (_MFdsShuffle (dStream, itemSize * header->ItemNum) == (void *) NULL) return (CMfailed);
+		_MFdsPermute (dStream->Shuffle, data, header->ItemNum, itemSize, true);
+		data = dStream->Shuffle;
+	}
+	if (dStream->WriteBehind)
+		return (_MFdsWriterQueue (dStream, header, data, itemSize * header->ItemNum));
+	return (_MFdsRecordPut (dStream, header, data));
 }
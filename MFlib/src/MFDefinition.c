@@ -15,12 +15,22 @@ bfekete@ccny.cuny.edu
 #include <MF.h>
 
 static int _MFDefLevel = 0;
+static char _MFDefNames [MFDefLevelMax][MFNameLength]; // Modules being defined, for naming the functions they add
+
+const char *_MFDefCurrent () {
+	if (_MFDefLevel < 1) return ("Unknown");
+	return (_MFDefNames [(_MFDefLevel > MFDefLevelMax ? MFDefLevelMax : _MFDefLevel) - 1]);
+}
 
 void _MFDefEntering (const char *text,const char *path) {
 	char formatStr [MFNameLength];
 
 	snprintf (formatStr, sizeof(formatStr), "%c%ds %cs (%s)",'%',_MFDefLevel * 3 + (int) strlen ("Entering"),'%',CMfileName(path));
 	CMmsgPrint (CMmsgInfo,formatStr,"Entering:",text);
+	if (_MFDefLevel < MFDefLevelMax) {
+		strncpy (_MFDefNames [_MFDefLevel], text, MFNameLength - 1);
+		_MFDefNames [_MFDefLevel][MFNameLength - 1] = '\0';
+	}
 	_MFDefLevel++;
 }
 
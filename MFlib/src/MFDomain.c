@@ -12,13 +12,28 @@ bfekete@ccny.cuny.edu
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <cm.h>
 #include <MF.h>
 
+typedef struct MFDomainFlatHeader_s {
+	char   Tag [8];
+	short  Swap, Type;
+	int    ObjNum;
+	size_t DLinkNum, ULinkNum;
+} MFDomainFlatHeader_t;
+
 void MFDomainFree (MFDomain_p domain) {
 	int objID;
 
-	if (domain->Objects != (MFObject_p) NULL) {
+	if (domain->Image != (void *) NULL) {
+		// The objects and their link arrays live in the flat image
+		if (domain->Mapped) munmap (domain->Image, domain->ImageSize); else free (domain->Image);
+	}
+	else if (domain->Objects != (MFObject_p) NULL) {
 		for (objID = 0;objID < domain->ObjNum;++objID) {
 			if (domain->Objects [objID].DLinks != (size_t *) NULL) free (domain->Objects [objID].DLinks);
 			if (domain->Objects [objID].ULinks != (size_t *) NULL) free (domain->Objects [objID].ULinks);
@@ -30,18 +45,23 @@ void MFDomainFree (MFDomain_p domain) {
 	free (domain);	
 }
 
+static MFDomain_p _MFDomainReadFlat (FILE *, MFDomain_p);
+
 MFDomain_p MFDomainRead (FILE *inFile) {
 	int objID, i;
 	MFDomain_p domain;
 
 	if ((domain = (MFDomain_p) calloc (1,sizeof (MFDomain_t))) == (MFDomain_p) NULL) return ((MFDomain_p) NULL);
 	domain->Objects = (MFObject_p) NULL;
+	domain->Image   = (void *) NULL;
 
-	if (fread (domain,sizeof (MFDomain_t) - sizeof (MFObject_p),1,inFile) != 1) {
+	// The linked header and the flat tag have the same length, so the first read tells the two formats apart
+	if (fread (domain,offsetof (MFDomain_t, Objects),1,inFile) != 1) {
 		CMmsgPrint (CMmsgSysError,"File Reading Error in: %s:%d",__FILE__,__LINE__);
 		MFDomainFree (domain);
 		return ((MFDomain_p) NULL);
 	}
+	if (memcmp (domain, MFDomainFlatTag, offsetof (MFDomain_t, Objects)) == 0) return (_MFDomainReadFlat (inFile, domain));
 	if (domain->Swap != 1) {
         MFSwapHalfWord (&(domain->Swap));
 		MFSwapHalfWord (&(domain->Type));
@@ -137,6 +157,8 @@ MFDomain_p MFDomainRead (FILE *inFile) {
 	return (domain);
 }
 
+static int _MFDomainUnflatten (MFDomain_p);
+
 int MFDomainSetBifurcations(MFDomain_p domain, const char *path) {
     char line[1024];
     int fromID, toID, dlink, link, ulink, objID;
@@ -148,6 +170,11 @@ int MFDomainSetBifurcations(MFDomain_p domain, const char *path) {
 		CMmsgPrint (CMmsgSysError,"Bifurfaction file [%s] Opening error!",CMfileName (path));
 		return (CMfailed);
     }
+    // Bifurcations resize the per-object link arrays, which requires them to be individually allocated
+    if ((domain->Image != (void *) NULL) && (_MFDomainUnflatten (domain) == CMfailed)) {
+        fclose (inFile);
+        return (CMfailed);
+    }
 
     while (fscanf(inFile, "%d,%d,%f", &fromID, &toID, &weight) == 3) {
         CMmsgPrint(CMmsgDebug, "Read BIFURCATION: fromID: %d, toID: %d, weight: %f", fromID, toID, weight);
@@ -311,7 +338,7 @@ int MFDomainWrite (MFDomain_p domain,FILE *outFile) {
 	int objID;
 
 	domain->Swap = 1;
-	if (fwrite (domain,sizeof (MFDomain_t) - sizeof (MFObject_p),1,outFile) != 1) {
+	if (fwrite (domain,offsetof (MFDomain_t, Objects),1,outFile) != 1) {
 		CMmsgPrint (CMmsgSysError,"File Writing Error in: %s:%d",__FILE__,__LINE__);
 		return (CMfailed);
 	}
@@ -336,3 +363,413 @@ int MFDomainWrite (MFDomain_p domain,FILE *outFile) {
 	}
 	return (CMsucceeded);
 }
+
+static MFDomain_p _MFDomainReadFlat (FILE *inFile, MFDomain_p domain) {
+	int objID, i;
+	size_t dLink = 0, uLink = 0, linkNum;
+	char *image;
+	struct stat fileStat;
+	MFDomainFlatHeader_t header;
+	MFObject_p object;
+	size_t *dLinks, *uLinks;
+	float *dWeights, *uWeights;
+
+	memcpy (header.Tag, MFDomainFlatTag, sizeof (header.Tag));
+	if (fread (header.Tag + sizeof (header.Tag),sizeof (MFDomainFlatHeader_t) - sizeof (header.Tag),1,inFile) != 1) {
+		CMmsgPrint (CMmsgSysError,"File Reading Error in: %s:%d",__FILE__,__LINE__);
+		MFDomainFree (domain);
+		return ((MFDomain_p) NULL);
+	}
+	if (header.Swap != 1) {
+		MFSwapHalfWord (&(header.Type));
+		MFSwapWord     (&(header.ObjNum));
+		MFSwapLongWord (&(header.DLinkNum));
+		MFSwapLongWord (&(header.ULinkNum));
+	}
+	linkNum = header.DLinkNum + header.ULinkNum;
+	domain->Swap      = 1;
+	domain->Type      = header.Type;
+	domain->ObjNum    = header.ObjNum;
+	domain->ImageSize = sizeof (MFDomainFlatHeader_t) + header.ObjNum * sizeof (MFObject_t) + linkNum * (sizeof (size_t) + sizeof (float));
+
+	// Regular files are mapped copy-on-write (the object records are patched in place below), anything else is read in one go
+	if ((fstat (fileno (inFile), &fileStat) == 0) && S_ISREG (fileStat.st_mode) && ((size_t) fileStat.st_size >= domain->ImageSize) &&
+	    ((domain->Image = mmap (NULL, domain->ImageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno (inFile), 0)) != MAP_FAILED))
+		domain->Mapped = true;
+	else {
+		if ((domain->Image = malloc (domain->ImageSize)) == (void *) NULL) {
+			CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+			MFDomainFree (domain);
+			return ((MFDomain_p) NULL);
+		}
+		if (fread ((char *) domain->Image + sizeof (MFDomainFlatHeader_t),domain->ImageSize - sizeof (MFDomainFlatHeader_t),1,inFile) != 1) {
+			CMmsgPrint (CMmsgSysError,"File Reading Error in: %s:%d",__FILE__,__LINE__);
+			MFDomainFree (domain);
+			return ((MFDomain_p) NULL);
+		}
+		memcpy (domain->Image, &header, sizeof (MFDomainFlatHeader_t));
+	}
+	image    = (char *) domain->Image;
+	domain->Objects = (MFObject_p) (image + sizeof (MFDomainFlatHeader_t));
+	dLinks   = (size_t *) (domain->Objects + header.ObjNum);
+	uLinks   = dLinks + header.DLinkNum;
+	dWeights = (float *) (uLinks + header.ULinkNum);
+	uWeights = dWeights + header.DLinkNum;
+	for (objID = 0;objID < domain->ObjNum;++objID) {
+		object = domain->Objects + objID;
+		if (header.Swap != 1) {
+			MFSwapWord     (&(object->ID));
+			MFSwapHalfWord (&(object->DLinkNum));
+			MFSwapHalfWord (&(object->ULinkNum));
+			MFSwapWord     (&(object->XCoord));
+			MFSwapWord     (&(object->YCoord));
+			MFSwapWord     (&(object->Lon));
+			MFSwapWord     (&(object->Lat));
+			MFSwapWord     (&(object->Area));
+			MFSwapWord     (&(object->Length));
+		}
+		if ((object->DLinkNum < 0) || (object->ULinkNum < 0) ||
+		    (dLink + object->DLinkNum > header.DLinkNum) || (uLink + object->ULinkNum > header.ULinkNum)) break;
+		if (header.Swap != 1) {
+			for (i = 0;i < object->DLinkNum;++i) { MFSwapLongWord (dLinks + dLink + i); MFSwapWord (dWeights + dLink + i); }
+			for (i = 0;i < object->ULinkNum;++i) { MFSwapLongWord (uLinks + uLink + i); MFSwapWord (uWeights + uLink + i); }
+		}
+		object->DLinks   = object->DLinkNum > 0 ? dLinks   + dLink : (size_t *) NULL;
+		object->DWeights = object->DLinkNum > 0 ? dWeights + dLink : (float *)  NULL;
+		object->ULinks   = object->ULinkNum > 0 ? uLinks   + uLink : (size_t *) NULL;
+		object->UWeights = object->ULinkNum > 0 ? uWeights + uLink : (float *)  NULL;
+		dLink += object->DLinkNum;
+		uLink += object->ULinkNum;
+	}
+	if ((objID < domain->ObjNum) || (dLink != header.DLinkNum) || (uLink != header.ULinkNum)) {
+		CMmsgPrint (CMmsgAppError,"Inconsistent flat domain link counts in: %s:%d",__FILE__,__LINE__);
+		MFDomainFree (domain);
+		return ((MFDomain_p) NULL);
+	}
+	return (domain);
+}
+
+static int _MFDomainUnflatten (MFDomain_p domain) {
+	int objID;
+	MFObject_p objects;
+
+	if ((objects = (MFObject_p) calloc (domain->ObjNum,sizeof (MFObject_t))) == (MFObject_p) NULL) {
+		CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	memcpy (objects, domain->Objects, domain->ObjNum * sizeof (MFObject_t));
+	for (objID = 0;objID < domain->ObjNum;++objID) {
+		objects [objID].DLinks   = (size_t *) NULL;
+		objects [objID].DWeights = (float *)  NULL;
+		objects [objID].ULinks   = (size_t *) NULL;
+		objects [objID].UWeights = (float *)  NULL;
+	}
+	for (objID = 0;objID < domain->ObjNum;++objID) {
+		if (objects [objID].DLinkNum > 0) {
+			if (((objects [objID].DLinks   = (size_t *) malloc (objects [objID].DLinkNum * sizeof (size_t))) == (size_t *) NULL) ||
+			    ((objects [objID].DWeights = (float *)  malloc (objects [objID].DLinkNum * sizeof (float)))  == (float *)  NULL)) break;
+			memcpy (objects [objID].DLinks,   domain->Objects [objID].DLinks,   objects [objID].DLinkNum * sizeof (size_t));
+			memcpy (objects [objID].DWeights, domain->Objects [objID].DWeights, objects [objID].DLinkNum * sizeof (float));
+		}
+		if (objects [objID].ULinkNum > 0) {
+			if (((objects [objID].ULinks   = (size_t *) malloc (objects [objID].ULinkNum * sizeof (size_t))) == (size_t *) NULL) ||
+			    ((objects [objID].UWeights = (float *)  malloc (objects [objID].ULinkNum * sizeof (float)))  == (float *)  NULL)) break;
+			memcpy (objects [objID].ULinks,   domain->Objects [objID].ULinks,   objects [objID].ULinkNum * sizeof (size_t));
+			memcpy (objects [objID].UWeights, domain->Objects [objID].UWeights, objects [objID].ULinkNum * sizeof (float));
+		}
+	}
+	if (objID < domain->ObjNum) {
+		CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+		for (objID = 0;objID < domain->ObjNum;++objID) {
+			if (objects [objID].DLinks   != (size_t *) NULL) free (objects [objID].DLinks);
+			if (objects [objID].DWeights != (float *)  NULL) free (objects [objID].DWeights);
+			if (objects [objID].ULinks   != (size_t *) NULL) free (objects [objID].ULinks);
+			if (objects [objID].UWeights != (float *)  NULL) free (objects [objID].UWeights);
+		}
+		free (objects);
+		return (CMfailed);
+	}
+	if (domain->Mapped) munmap (domain->Image, domain->ImageSize); else free (domain->Image);
+	domain->Image   = (void *) NULL;
+	domain->Mapped  = false;
+	domain->Objects = objects;
+	return (CMsucceeded);
+}
+
+int MFDomainWriteFlat (MFDomain_p domain,FILE *outFile) {
+	int objID, link;
+	float weight;
+	MFObject_t object;
+	MFDomainFlatHeader_t header;
+
+	memset (&header, 0, sizeof (MFDomainFlatHeader_t));
+	memcpy (header.Tag, MFDomainFlatTag, sizeof (header.Tag));
+	header.Swap   = 1;
+	header.Type   = domain->Type;
+	header.ObjNum = domain->ObjNum;
+	for (objID = 0;objID < domain->ObjNum;++objID) {
+		header.DLinkNum += domain->Objects [objID].DLinkNum;
+		header.ULinkNum += domain->Objects [objID].ULinkNum;
+	}
+	if (fwrite (&header,sizeof (MFDomainFlatHeader_t),1,outFile) != 1) {
+		CMmsgPrint (CMmsgSysError,"File Writing Error in: %s:%d",__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	for (objID = 0;objID < domain->ObjNum;++objID) {
+		// Link pointers are resolved by the reader
+		memcpy (&object, domain->Objects + objID, sizeof (MFObject_t));
+		object.DLinks   = object.ULinks   = (size_t *) NULL;
+		object.DWeights = object.UWeights = (float *)  NULL;
+		if (fwrite (&object,sizeof (MFObject_t),1,outFile) != 1) {
+			CMmsgPrint (CMmsgSysError,"File Writing Error in: %s:%d",__FILE__,__LINE__);
+			return (CMfailed);
+		}
+	}
+	for (objID = 0;objID < domain->ObjNum;++objID)
+		if ((domain->Objects [objID].DLinkNum > 0) &&
+		    (fwrite (domain->Objects [objID].DLinks,sizeof (size_t),domain->Objects [objID].DLinkNum,outFile) != (size_t) domain->Objects [objID].DLinkNum)) {
+			CMmsgPrint (CMmsgSysError,"File Writing Error in: %s:%d",__FILE__,__LINE__);
+			return (CMfailed);
+		}
+	for (objID = 0;objID < domain->ObjNum;++objID)
+		if ((domain->Objects [objID].ULinkNum > 0) &&
+		    (fwrite (domain->Objects [objID].ULinks,sizeof (size_t),domain->Objects [objID].ULinkNum,outFile) != (size_t) domain->Objects [objID].ULinkNum)) {
+			CMmsgPrint (CMmsgSysError,"File Writing Error in: %s:%d",__FILE__,__LINE__);
+			return (CMfailed);
+		}
+	// Domains built from networks carry no weights, which defaults to single downlinks with unit weight
+	for (objID = 0;objID < domain->ObjNum;++objID)
+		for (link = 0;link < domain->Objects [objID].DLinkNum;++link) {
+			weight = domain->Objects [objID].DWeights != (float *) NULL ? domain->Objects [objID].DWeights [link] : 1.0;
+			if (fwrite (&weight,sizeof (float),1,outFile) != 1) {
+				CMmsgPrint (CMmsgSysError,"File Writing Error in: %s:%d",__FILE__,__LINE__);
+				return (CMfailed);
+			}
+		}
+	for (objID = 0;objID < domain->ObjNum;++objID)
+		for (link = 0;link < domain->Objects [objID].ULinkNum;++link) {
+			weight = domain->Objects [objID].UWeights != (float *) NULL ? domain->Objects [objID].UWeights [link] : 1.0;
+			if (fwrite (&weight,sizeof (float),1,outFile) != 1) {
+				CMmsgPrint (CMmsgSysError,"File Writing Error in: %s:%d",__FILE__,__LINE__);
+				return (CMfailed);
+			}
+		}
+	return (CMsucceeded);
+}
+
+const char *MFDomainOrderStrings [] = { "file", "travel", "basin", "hilbert", (char *) NULL };
+
+typedef struct _MFDomainKey_s {
+	unsigned long long Key;
+	int Obj;
+} _MFDomainKey_t;
+
+static int _MFDomainKeyCompare (const void *lPtr, const void *rPtr) {
+	const _MFDomainKey_t *left = (const _MFDomainKey_t *) lPtr, *right = (const _MFDomainKey_t *) rPtr;
+
+	if (left->Key != right->Key) return (left->Key < right->Key ? -1 : 1);
+	return (left->Obj - right->Obj);
+}
+
+static unsigned long long _MFDomainHilbert (unsigned int x, unsigned int y) {
+	unsigned int side = 0x10000, s, rx, ry, t;
+	unsigned long long d = 0;
+
+	for (s = side / 2; s > 0; s /= 2) {
+		rx = (x & s) > 0;
+		ry = (y & s) > 0;
+		d += (unsigned long long) s * s * ((3 * rx) ^ ry);
+		if (ry == 0) {
+			if (rx == 1) { x = side - 1 - x; y = side - 1 - y; }
+			t = x; x = y; y = t;
+		}
+	}
+	return (d);
+}
+
+// Returns order [cell] = object in the current domain order, so cell i of the renumbered domain is object order [i].
+int *MFDomainOrder (MFDomain_p domain, int method) {
+	int objID, cell = 0, link, top = 0, *order, *stack = (int *) NULL;
+	bool *visited = (bool *) NULL;
+	float minX, maxX, minY, maxY;
+	_MFDomainKey_t *keys;
+
+	if ((order = (int *) calloc (domain->ObjNum > 0 ? domain->ObjNum : 1,sizeof (int))) == (int *) NULL) {
+		CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+		return ((int *) NULL);
+	}
+	switch (method) {
+		default:
+		case MFDomainOrderFile:
+			for (objID = 0;objID < domain->ObjNum;++objID) order [objID] = objID;
+			break;
+		case MFDomainOrderBasin: {
+			size_t linkNum = domain->ObjNum;
+
+			// Basins are laid out one after the other, each cell followed by its upstream cells so that the
+			// upstream gather reads neighbouring memory. The explicit stack holds at most one entry per link.
+			for (objID = 0;objID < domain->ObjNum;++objID) linkNum += domain->Objects [objID].ULinkNum;
+			if (((stack   = (int *)  calloc (linkNum,sizeof (int)))          == (int *)  NULL) ||
+			    ((visited = (bool *) calloc (domain->ObjNum,sizeof (bool)))  == (bool *) NULL)) {
+				CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+				if (stack != (int *) NULL) free (stack);
+				free (order);
+				return ((int *) NULL);
+			}
+			for (objID = 0;objID < domain->ObjNum;++objID) {
+				if (domain->Objects [objID].DLinkNum > 0) continue;
+				stack [top++] = objID;
+				while (top > 0) {
+					int obj = stack [--top];
+
+					if (visited [obj]) continue; // Bifurcated cells are reached through each of their downlinks
+					visited [obj] = true;
+					order [cell++] = obj;
+					for (link = domain->Objects [obj].ULinkNum - 1;link >= 0;--link)
+						if (!visited [domain->Objects [obj].ULinks [link]]) stack [top++] = (int) domain->Objects [obj].ULinks [link];
+				}
+			}
+			// Cells that do not drain to an outlet (malformed networks) keep their relative order at the end
+			for (objID = 0;objID < domain->ObjNum;++objID) if (!visited [objID]) order [cell++] = objID;
+			free (stack);
+			free (visited);
+		} break;
+		case MFDomainOrderHilbert:
+			if ((keys = (_MFDomainKey_t *) calloc (domain->ObjNum > 0 ? domain->ObjNum : 1,sizeof (_MFDomainKey_t))) == (_MFDomainKey_t *) NULL) {
+				CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+				free (order);
+				return ((int *) NULL);
+			}
+			minX = maxX = domain->ObjNum > 0 ? domain->Objects [0].XCoord : 0.0;
+			minY = maxY = domain->ObjNum > 0 ? domain->Objects [0].YCoord : 0.0;
+			for (objID = 1;objID < domain->ObjNum;++objID) {
+				if (minX > domain->Objects [objID].XCoord) minX = domain->Objects [objID].XCoord;
+				if (maxX < domain->Objects [objID].XCoord) maxX = domain->Objects [objID].XCoord;
+				if (minY > domain->Objects [objID].YCoord) minY = domain->Objects [objID].YCoord;
+				if (maxY < domain->Objects [objID].YCoord) maxY = domain->Objects [objID].YCoord;
+			}
+			if (maxX <= minX) maxX = minX + 1.0;
+			if (maxY <= minY) maxY = minY + 1.0;
+			for (objID = 0;objID < domain->ObjNum;++objID) {
+				keys [objID].Key = _MFDomainHilbert ((unsigned int) ((domain->Objects [objID].XCoord - minX) / (maxX - minX) * 65535.0),
+				                                     (unsigned int) ((domain->Objects [objID].YCoord - minY) / (maxY - minY) * 65535.0));
+				keys [objID].Obj = objID;
+			}
+			qsort (keys, domain->ObjNum, sizeof (_MFDomainKey_t), _MFDomainKeyCompare);
+			for (objID = 0;objID < domain->ObjNum;++objID) order [objID] = keys [objID].Obj;
+			free (keys);
+			break;
+		case MFDomainOrderTravel: {
+			int *travel = (int *) NULL, *pending = (int *) NULL, head = 0, tail = 0, maxTravel = 0;
+
+			// Travel is the longest path to the outlet, which is what the routing job groups the cells by (the most
+			// upstream group runs first). Numbering the cells group by group, in file order within the groups, makes
+			// every group a contiguous sweep over the variable buffers.
+			if (((travel  = (int *) calloc (domain->ObjNum > 0 ? domain->ObjNum : 1,sizeof (int))) == (int *) NULL) ||
+			    ((pending = (int *) calloc (domain->ObjNum > 0 ? domain->ObjNum : 1,sizeof (int))) == (int *) NULL) ||
+			    ((keys = (_MFDomainKey_t *) calloc (domain->ObjNum > 0 ? domain->ObjNum : 1,sizeof (_MFDomainKey_t))) == (_MFDomainKey_t *) NULL)) {
+				CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+				if (travel  != (int *) NULL) free (travel);
+				if (pending != (int *) NULL) free (pending);
+				free (order);
+				return ((int *) NULL);
+			}
+			// Breadth first from the outlets, a cell is queued (in order) once all of its downlinks are resolved
+			for (objID = 0;objID < domain->ObjNum;++objID)
+				if ((pending [objID] = domain->Objects [objID].DLinkNum) == 0) order [tail++] = objID;
+			while (head < tail) {
+				int obj = order [head++];
+
+				if (maxTravel < travel [obj]) maxTravel = travel [obj];
+				for (link = 0;link < domain->Objects [obj].ULinkNum;++link) {
+					int up = (int) domain->Objects [obj].ULinks [link];
+
+					if (travel [up] < travel [obj] + 1) travel [up] = travel [obj] + 1;
+					if (--pending [up] == 0) order [tail++] = up;
+				}
+			}
+			for (objID = 0;objID < domain->ObjNum;++objID) {
+				keys [objID].Key = ((unsigned long long) (maxTravel - travel [objID]) << 32) | (unsigned long long) objID;
+				keys [objID].Obj = objID;
+			}
+			qsort (keys, domain->ObjNum, sizeof (_MFDomainKey_t), _MFDomainKeyCompare);
+			for (objID = 0;objID < domain->ObjNum;++objID) order [objID] = keys [objID].Obj;
+			free (travel);
+			free (pending);
+			free (keys);
+		} break;
+	}
+	return (order);
+}
+
+// Reorders the objects in place (order as returned by MFDomainOrder) and renumbers their links.
+int MFDomainPermute (MFDomain_p domain, const int *order) {
+	int objID, link, *inverse;
+	MFObject_p objects;
+
+	if (((inverse = (int *)      malloc (domain->ObjNum * sizeof (int)))        == (int *)      NULL) ||
+	    ((objects = (MFObject_p) malloc (domain->ObjNum * sizeof (MFObject_t))) == (MFObject_p) NULL)) {
+		CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+		if (inverse != (int *) NULL) free (inverse);
+		return (CMfailed);
+	}
+	for (objID = 0;objID < domain->ObjNum;++objID) inverse [objID] = CMfailed;
+	for (objID = 0;objID < domain->ObjNum;++objID) {
+		if ((order [objID] < 0) || (order [objID] >= domain->ObjNum) || (inverse [order [objID]] != CMfailed)) {
+			CMmsgPrint (CMmsgAppError,"Invalid cell order in: %s:%d",__FILE__,__LINE__);
+			free (inverse);
+			free (objects);
+			return (CMfailed);
+		}
+		inverse [order [objID]] = objID;
+	}
+	memcpy (objects, domain->Objects, domain->ObjNum * sizeof (MFObject_t));
+	for (objID = 0;objID < domain->ObjNum;++objID) {
+		domain->Objects [objID] = objects [order [objID]];
+		for (link = 0;link < domain->Objects [objID].DLinkNum;++link)
+			domain->Objects [objID].DLinks [link] = (size_t) inverse [domain->Objects [objID].DLinks [link]];
+		for (link = 0;link < domain->Objects [objID].ULinkNum;++link)
+			domain->Objects [objID].ULinks [link] = (size_t) inverse [domain->Objects [objID].ULinks [link]];
+	}
+	free (inverse);
+	free (objects);
+	return (CMsucceeded);
+}
+
+void MFUpstreamFree (MFUpstream_p upstream) {
+	if (upstream->Offsets != (size_t *) NULL) free (upstream->Offsets);
+	if (upstream->Links   != (int *)    NULL) free (upstream->Links);
+	if (upstream->Weights != (float *)  NULL) free (upstream->Weights);
+	free (upstream);
+}
+
+MFUpstream_p MFUpstreamCreate (MFDomain_p domain) {
+	int objID, link;
+	size_t linkNum = 0;
+	MFUpstream_p upstream;
+
+	if ((upstream = (MFUpstream_p) calloc (1,sizeof (MFUpstream_t))) == (MFUpstream_p) NULL) {
+		CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+		return ((MFUpstream_p) NULL);
+	}
+	upstream->ObjNum = domain->ObjNum;
+	for (objID = 0;objID < domain->ObjNum;++objID) linkNum += domain->Objects [objID].ULinkNum;
+	if (((upstream->Offsets = (size_t *) calloc (domain->ObjNum + 1,sizeof (size_t))) == (size_t *) NULL) ||
+	    ((upstream->Links   = (int *)    calloc (linkNum > 0 ? linkNum : 1,sizeof (int)))   == (int *)    NULL) ||
+	    ((upstream->Weights = (float *)  calloc (linkNum > 0 ? linkNum : 1,sizeof (float))) == (float *)  NULL)) {
+		CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+		MFUpstreamFree (upstream);
+		return ((MFUpstream_p) NULL);
+	}
+	linkNum = 0;
+	for (objID = 0;objID < domain->ObjNum;++objID) {
+		upstream->Offsets [objID] = linkNum;
+		for (link = 0;link < domain->Objects [objID].ULinkNum;++link) {
+			upstream->Links   [linkNum] = (int) domain->Objects [objID].ULinks [link];
+			upstream->Weights [linkNum] = domain->Objects [objID].UWeights [link];
+			linkNum++;
+		}
+	}
+	upstream->Offsets [domain->ObjNum] = linkNum;
+	return (upstream);
+}
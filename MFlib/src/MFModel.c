@@ -14,62 +14,144 @@ bfekete@ccny.cuny.edu
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <unistd.h>
 #include <cm.h>
 #include <MF.h>
 #include <time.h>
 
 static MFDomain_p _MFDomain     = (MFDomain_p) NULL;
+static MFUpstream_p _MFUpstream = (MFUpstream_p) NULL;
+static MFVariable_p *_MFRouteVars = (MFVariable_p *) NULL;
+static int _MFRouteVarNum = 0;
 static MFFunction *_MFFunctions = (MFFunction *) NULL;
+static char (*_MFFunctionNames) [MFNameLength] = NULL; // Module adding each function, for the profile
 static int _MFFunctionNum = 0;
+static int _MFLocalNum    = 0;     // Leading functions that run as a flat sweep ahead of the routing order
+static bool _MFFlatPhase  = false;
+static bool _MFProbe      = false; // Set while the first time step records which functions touch routed variables
+static bool *_MFFunctionRouted = (bool *) NULL;
+static const char *_MFThreadReport = (char *) NULL;
+static int  _MFCellOrder = MFDomainOrderFile;
+static int *_MFOrder     = (int *) NULL;      // Domain file object of each cell when the cells are renumbered
+static int    _MFSpinupMax       = 0;         // Cycles over the run period before the one that writes the outputs
+static double _MFSpinupTolerance = 0.0;       // Relative change of the states that ends the spin-up early
+static MFVariable_p *_MFSpinupVars  = (MFVariable_p *) NULL;
+static void        **_MFSpinupStart = (void **) NULL;
+static int           _MFSpinupVarNum = 0;
+static const char *_MFCheckpointPath   = (char *) NULL;
+static int         _MFCheckpointPeriod = MFAggrYear; // Checkpoints are taken as a new month or year starts
+static bool        _MFRestart          = false;
+static int _MFMemberNum = 1;                     // Ensemble members stepped together, item = cell * _MFMemberNum + member
+
+#define MFProfileSample 32 // One cell in this many is timed, the timed cells move on with every time step
+
+// Run time of the model functions. A clock read costs as much as a small function, so only the sampled cells are
+// timed and their share of the calls scales the time up, while the calls are counted for every cell. Counts are kept
+// per thread and summed after each time step, which also keeps the slowest step of each function. The entry after
+// the last function is the accumulation of the routed variables from upstream. The cost of the clock read ending each
+// timed call (ClockCost) is taken off, it would otherwise dominate the small functions.
+typedef struct MFProfileCount_s {
+	long long Time;
+	size_t Sampled, Calls;
+} MFProfileCount_t;
+
+static struct MFProfile_s {
+	bool Active, Routed;
+	size_t ThreadNum, FuncNum, Offset, StepNum;
+	long long ClockCost;
+	MFProfileCount_t *Counts;   // [thread * FuncNum + function] of the current time step
+	double *Time, *ThreadTime;  // Seconds per function, and per thread and function
+	double *StepMax;
+	size_t *Calls;
+	char  (*StepDate) [MFDateStringLength];
+} _MFProfile = { false, false, 0, 0, 0, 0, 0, (MFProfileCount_t *) NULL, (double *) NULL, (double *) NULL, (double *) NULL, (size_t *) NULL, NULL };
+
+/* Checkpoint files hold the date the run continues with, then for every variable (in ID order) a record telling which
+   sections follow: the state buffer of initial variables, the offset of the input record the variable holds, the size
+   the output had, and the pending period of each aggregate. They are only meant for the machine that wrote them. */
+#define MFCheckpointTag     "MFCHKPNT"
+#define MFCheckpointVersion 1
+
+typedef struct MFCheckpointHeader_s {
+	char Tag [8];
+	int  Version, ItemNum, Order, VarNum;
+	char Date [MFDateStringLength];
+} MFCheckpointHeader_t;
+
+typedef struct MFCheckpointVar_s {
+	char Name [MFNameLength];
+	int  Type, Flags;
+} MFCheckpointVar_t;
+
+enum { MFCheckpointState = 0x01, MFCheckpointInput = 0x02, MFCheckpointOutput = 0x04, MFCheckpointAggregate = 0x08 }; // One aggregate bit per MFAggrNum
+
+// Image of the run state copied at a checkpoint and written by a background thread while the run goes on. Only one
+// checkpoint is in flight: the next one waits for it before reusing the image.
+static struct MFCheckpoint_s {
+	bool Active;
+	CMreturn Status;
+	pthread_t Thread;
+	char  *Data, *TmpPath;
+	size_t Size, Capacity;
+	int   *Files, FileNum, FileMax; // Duplicated descriptors of the outputs to sync along with the checkpoint
+	double CopyTime, WriteTime;
+	char   Date [MFDateStringLength];
+} _MFCheckpoint = { false, CMsucceeded, (pthread_t) 0, (char *) NULL, (char *) NULL, 0, 0, (int *) NULL, 0, 0, 0.0, 0.0, "" };
 
 int MFModelAddFunction (MFFunction func) {
 
-	if ((_MFFunctions = (MFFunction *) realloc (_MFFunctions, (_MFFunctionNum + 1) * sizeof (MFFunction))) == (MFFunction *) NULL) {
+	if (((_MFFunctions = (MFFunction *) realloc (_MFFunctions, (_MFFunctionNum + 1) * sizeof (MFFunction))) == (MFFunction *) NULL) ||
+	    ((_MFFunctionNames = realloc (_MFFunctionNames, (_MFFunctionNum + 1) * MFNameLength)) == NULL)) {
 		CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
 		return (CMfailed);
 	}
 	_MFFunctions [_MFFunctionNum] = func;
+	strncpy (_MFFunctionNames [_MFFunctionNum], _MFDefCurrent (), MFNameLength - 1);
+	_MFFunctionNames [_MFFunctionNum][MFNameLength - 1] = '\0';
 	_MFFunctionNum++;
 	return (CMsucceeded);
 }
 
 float MFModelGetXCoord (int itemID) {
-	if ((itemID < 0) || (itemID >= _MFDomain->ObjNum)) return (0.0);
-	return (_MFDomain->Objects [itemID].XCoord);
+	if ((itemID < 0) || (itemID >= _MFDomain->ObjNum * _MFMemberNum)) return (0.0);
+	return (_MFDomain->Objects [itemID / _MFMemberNum].XCoord);
 }
 
 float MFModelGetYCoord (int itemID) {
-	if ((itemID < 0) || (itemID >= _MFDomain->ObjNum)) return (0.0);
-	return (_MFDomain->Objects [itemID].YCoord);
+	if ((itemID < 0) || (itemID >= _MFDomain->ObjNum * _MFMemberNum)) return (0.0);
+	return (_MFDomain->Objects [itemID / _MFMemberNum].YCoord);
 }
 
 float MFModelGetLongitude (int itemID) {
-	if ((itemID < 0) || (itemID >= _MFDomain->ObjNum)) return (0.0);
-	return (_MFDomain->Objects [itemID].Lon);
+	if ((itemID < 0) || (itemID >= _MFDomain->ObjNum * _MFMemberNum)) return (0.0);
+	return (_MFDomain->Objects [itemID / _MFMemberNum].Lon);
 }
 
 float MFModelGetLatitude (int itemID) {
-	if ((itemID < 0) || (itemID >= _MFDomain->ObjNum)) return (0.0);
-	return (_MFDomain->Objects [itemID].Lat);
+	if ((itemID < 0) || (itemID >= _MFDomain->ObjNum * _MFMemberNum)) return (0.0);
+	return (_MFDomain->Objects [itemID / _MFMemberNum].Lat);
 }
 
 float MFModelGetArea (int itemID) {
-	if ((itemID < 0) || (itemID >= _MFDomain->ObjNum)) return (0.0);
-	return (_MFDomain->Objects [itemID].Area * 1000000.0);
+	if ((itemID < 0) || (itemID >= _MFDomain->ObjNum * _MFMemberNum)) return (0.0);
+	return (_MFDomain->Objects [itemID / _MFMemberNum].Area * 1000000.0);
 }
 
 float MFModelGetLength (int itemID) {
-	if ((itemID < 0) || (itemID >= _MFDomain->ObjNum)) return (0.0);
-	return (_MFDomain->Objects [itemID].Length * 1000.0);
+	if ((itemID < 0) || (itemID >= _MFDomain->ObjNum * _MFMemberNum)) return (0.0);
+	return (_MFDomain->Objects [itemID / _MFMemberNum].Length * 1000.0);
 }
 
+// The downstream item of the same ensemble member
 int MFModelGetDownLink (int itemID,size_t linkNum) {
+	int cell = itemID / _MFMemberNum;
+
 	if (itemID < 0) return (CMfailed);
-	if (_MFDomain != (MFDomain_p) NULL) return (CMfailed);
-	if (_MFDomain->ObjNum <= itemID)  return (CMfailed);
-	if (_MFDomain->Objects [itemID].DLinkNum <= linkNum) return (CMfailed);
+	if (_MFDomain == (MFDomain_p) NULL) return (CMfailed);
+	if (_MFDomain->ObjNum <= cell)  return (CMfailed);
+	if (_MFDomain->Objects [cell].DLinkNum <= linkNum) return (CMfailed);
 
-	return (_MFDomain->Objects [itemID].DLinks [linkNum]);
+	return (_MFDomain->Objects [cell].DLinks [linkNum] * _MFMemberNum + itemID % _MFMemberNum);
 }
 
 float MFModelGet_dt () { return (86400.0); }
@@ -132,14 +214,19 @@ static void _MFModelVarPrintOut (const char *label) {
 
 static CMthreadTeam_p _MFModelParse (int argc, char *argv [],int argNum, int (*mainDefFunc) (), char **domainFile, char **startDate, char **endDate, bool *testOnly) {
 	bool resolved = false;
-	int argPos, procNum;
+	int argPos, procNum, schedule = CMthreadScheduleStatic;
+	CMthreadTeam_p team;
 	int i, varID;
 	varEntry_p inputVars  = (varEntry_p) NULL;
 	varEntry_p outputVars = (varEntry_p) NULL;
 	varEntry_p stateVars  = (varEntry_p) NULL;
+	varEntry_p aggrVars [MFAggrNum] = { (varEntry_p) NULL, (varEntry_p) NULL };
 	varEntry_p varEntry;
-	int inputVarNum = 0, outputVarNum = 0, stateVarNum = 0;
+	int inputVarNum = 0, outputVarNum = 0, stateVarNum = 0, aggrVarNum [MFAggrNum] = { 0, 0 }, aggr;
 	MFVariable_p var;
+	const char *onOff [] = { "on", "off", (char *) NULL };
+	const char *zFilters [] = { "none", "shuffle", "delta", "both", (char *) NULL };
+	int zFilterFlags [] = { 0, MFdsShuffle, MFdsDelta, MFdsShuffle | MFdsDelta }, zFilter;
     bool _MFOptionTestInUse ();
 
 	*testOnly = false;
@@ -177,6 +264,23 @@ static CMthreadTeam_p _MFModelParse (int argc, char *argv [],int argNum, int (*m
 			if ((argNum = CMargShiftLeft(argPos,argv,argNum)) <= argPos) break;
 			continue;
 	 	}
+		if (CMargTest (argv [argPos],"-M","--monthly") || CMargTest (argv [argPos],"-A","--annual")) {
+			aggr = CMargTest (argv [argPos],"-M","--monthly") ? MFAggrMonth : MFAggrYear;
+			if ((argNum = CMargShiftLeft (argPos,argv,argNum)) < 1) {
+				CMmsgPrint (CMmsgUsrError,"Missing aggregated output argument!\n");
+				goto Stop;
+			}
+			for (i = 0;i < (int) strlen (argv[argPos]);++i) if (argv [argPos][i] == '=') break;
+			if (i == (int) strlen (argv [argPos])) {
+				CMmsgPrint (CMmsgUsrError,"Illformed aggregated output variable [%s]!",argv [argPos]);
+				goto Stop;
+			}
+			argv [argPos][i] = '\0';
+			aggrVars [aggr] = _MFModelVarEntryNew (aggrVars [aggr], aggrVarNum [aggr], argv [argPos],argv [argPos] + i + 1);
+			if (aggrVars [aggr] == (varEntry_p) NULL) goto Stop; else aggrVarNum [aggr]++;
+			if ((argNum = CMargShiftLeft(argPos,argv,argNum)) <= argPos) break;
+			continue;
+	 	}
 		if (CMargTest (argv [argPos],"-t","--state")) {
 			if ((argNum = CMargShiftLeft (argPos,argv,argNum)) < 1) {
 				CMmsgPrint (CMmsgUsrError,"Missing _MFModelOutput argument!\n");
@@ -254,6 +358,180 @@ static CMthreadTeam_p _MFModelParse (int argc, char *argv [],int argNum, int (*m
             }
             if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
             continue;
+        }
+        if (CMargTest (argv[argPos], "-R", "--readahead")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing readahead mode!");
+                goto Stop;
+            }
+            switch (CMoptLookup (onOff, argv[argPos], true)) {
+                case 0: MFDataStreamSetPrefetch (true);  break;
+                case 1: MFDataStreamSetPrefetch (false); break;
+                default:
+                    CMmsgPrint(CMmsgUsrError, "Invalid readahead mode [%s]!", argv[argPos]);
+                    goto Stop;
+            }
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
+        if (CMargTest (argv[argPos], "-W", "--writebehind")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing writebehind mode!");
+                goto Stop;
+            }
+            switch (CMoptLookup (onOff, argv[argPos], true)) {
+                case 0: MFDataStreamSetWriteBehind (true);  break;
+                case 1: MFDataStreamSetWriteBehind (false); break;
+                default:
+                    CMmsgPrint(CMmsgUsrError, "Invalid writebehind mode [%s]!", argv[argPos]);
+                    goto Stop;
+            }
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
+        if (CMargTest (argv[argPos], "-F", "--flatphase")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing flat phase mode!");
+                goto Stop;
+            }
+            switch (CMoptLookup (onOff, argv[argPos], true)) {
+                case 0: _MFFlatPhase = true;  break;
+                case 1: _MFFlatPhase = false; break;
+                default:
+                    CMmsgPrint(CMmsgUsrError, "Invalid flat phase mode [%s]!", argv[argPos]);
+                    goto Stop;
+            }
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
+        if (CMargTest (argv[argPos], "-O", "--order")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing cell order!");
+                goto Stop;
+            }
+            if ((_MFCellOrder = CMoptLookup (MFDomainOrderStrings, argv[argPos], true)) == CMfailed) {
+                CMmsgPrint(CMmsgUsrError, "Invalid cell order [%s]!", argv[argPos]);
+                CMoptPrintList (CMmsgUsrError, "order", MFDomainOrderStrings);
+                goto Stop;
+            }
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
+        if (CMargTest (argv[argPos], "-Z", "--zfilter")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing zfile filter!");
+                goto Stop;
+            }
+            if ((zFilter = CMoptLookup (zFilters, argv[argPos], true)) == CMfailed) {
+                CMmsgPrint(CMmsgUsrError, "Invalid zfile filter [%s]!", argv[argPos]);
+                CMoptPrintList (CMmsgUsrError, "zfilter", zFilters);
+                goto Stop;
+            }
+            MFDataStreamSetFilters (zFilterFlags [zFilter]);
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
+        if (CMargTest (argv[argPos], "-U", "--spinup")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing spin-up cycle number!");
+                goto Stop;
+            }
+            if ((sscanf (argv[argPos],"%d", &_MFSpinupMax) != 1) || (_MFSpinupMax < 0)) {
+                CMmsgPrint(CMmsgUsrError, "Invalid spin-up cycle number!");
+                goto Stop;
+            }
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
+        if (CMargTest (argv[argPos], "-E", "--tolerance")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing spin-up tolerance!");
+                goto Stop;
+            }
+            if ((sscanf (argv[argPos],"%lf", &_MFSpinupTolerance) != 1) || (_MFSpinupTolerance < 0.0)) {
+                CMmsgPrint(CMmsgUsrError, "Invalid spin-up tolerance!");
+                goto Stop;
+            }
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
+        if (CMargTest (argv[argPos], "-K", "--checkpoint")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing checkpoint file!");
+                goto Stop;
+            }
+            _MFCheckpointPath = argv[argPos];
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
+        if (CMargTest (argv[argPos], "-k", "--checkperiod")) {
+            const char *periods [] = { "month", "year", (char *) NULL };
+
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing checkpoint period!");
+                goto Stop;
+            }
+            if ((_MFCheckpointPeriod = CMoptLookup (periods, argv[argPos], true)) == CMfailed) {
+                CMmsgPrint(CMmsgUsrError, "Invalid checkpoint period [%s]!", argv[argPos]);
+                CMoptPrintList (CMmsgUsrError, "checkperiod", periods);
+                goto Stop;
+            }
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
+        if (CMargTest (argv[argPos], "-r", "--restart")) {
+            _MFRestart = true;
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
+        if (CMargTest (argv[argPos], "-N", "--ensemble")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing ensemble member number!");
+                goto Stop;
+            }
+            if ((sscanf (argv[argPos],"%d", &_MFMemberNum) != 1) || (_MFMemberNum < 1)) {
+                CMmsgPrint(CMmsgUsrError, "Invalid ensemble member number!");
+                goto Stop;
+            }
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
+        if (CMargTest (argv[argPos], "-Y", "--profile")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing profile mode!");
+                goto Stop;
+            }
+            switch (CMoptLookup (onOff, argv[argPos], true)) {
+                case 0: _MFProfile.Active = true;  break;
+                case 1: _MFProfile.Active = false; break;
+                default:
+                    CMmsgPrint(CMmsgUsrError, "Invalid profile mode [%s]!", argv[argPos]);
+                    goto Stop;
+            }
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
+        if (CMargTest (argv[argPos], "-X", "--threadreport")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing thread report file!");
+                goto Stop;
+            }
+            _MFThreadReport = argv[argPos];
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
+        if (CMargTest (argv[argPos], "-S", "--scheduler")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing scheduler!");
+                goto Stop;
+            }
+            if ((schedule = CMoptLookup (CMthreadScheduleStrings, argv[argPos], true)) == CMfailed) {
+                CMmsgPrint(CMmsgUsrError, "Invalid scheduler [%s]!", argv[argPos]);
+                CMoptPrintList (CMmsgUsrError, "scheduler", CMthreadScheduleStrings);
+                goto Stop;
+            }
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
         }
 		if (CMargTest (argv [argPos],"-h","--help")) {
 			CMmsgPrint (CMmsgInfo,"%s [options] <domain>",CMfileName (argv [0]));
@@ -261,11 +539,27 @@ static CMthreadTeam_p _MFModelParse (int argc, char *argv [],int argNum, int (*m
 			CMmsgPrint (CMmsgInfo,"     -n, --end        [end date in the form of \"yyyy-mm-dd\"]");
 			CMmsgPrint (CMmsgInfo,"     -i, --input      [variable=source]");
 			CMmsgPrint (CMmsgInfo,"     -o, --output     [variable=destination]");
+			CMmsgPrint (CMmsgInfo,"     -M, --monthly    [variable=[avg:|sum:]destination]");
+			CMmsgPrint (CMmsgInfo,"     -A, --annual     [variable=[avg:|sum:]destination]");
 			CMmsgPrint (CMmsgInfo,"     -t, --state      [variable=statefile]");
 			CMmsgPrint (CMmsgInfo,"     -p, --option     [option=content]");
 			CMmsgPrint (CMmsgInfo,"     -T, --testonly");
 			CMmsgPrint (CMmsgInfo,"     -m, --message    [sys_error|app_error|usr_error|debug|warning|info]=[on|off|file=<filename>]");
 		    CMmsgPrint (CMmsgInfo,"     -P, --processor  [number]");
+		    CMmsgPrint (CMmsgInfo,"     -R, --readahead  [on|off]");
+		    CMmsgPrint (CMmsgInfo,"     -W, --writebehind [on|off]");
+		    CMmsgPrint (CMmsgInfo,"     -S, --scheduler  [static|steal|dataflow]");
+		    CMmsgPrint (CMmsgInfo,"     -F, --flatphase  [on|off]");
+		    CMmsgPrint (CMmsgInfo,"     -O, --order      [file|travel|basin|hilbert]");
+		    CMmsgPrint (CMmsgInfo,"     -Z, --zfilter    [none|shuffle|delta|both]");
+		    CMmsgPrint (CMmsgInfo,"     -U, --spinup     [max cycles]");
+		    CMmsgPrint (CMmsgInfo,"     -E, --tolerance  [relative state change]");
+		    CMmsgPrint (CMmsgInfo,"     -K, --checkpoint [filename]");
+		    CMmsgPrint (CMmsgInfo,"     -k, --checkperiod [month|year]");
+		    CMmsgPrint (CMmsgInfo,"     -r, --restart");
+		    CMmsgPrint (CMmsgInfo,"     -N, --ensemble   [number of members]");
+		    CMmsgPrint (CMmsgInfo,"     -Y, --profile    [on|off]");
+		    CMmsgPrint (CMmsgInfo,"     -X, --threadreport [filename.csv|filename.json]");
 			CMmsgPrint (CMmsgInfo,"     -h, --help");
 			goto Stop;
 		}
@@ -277,6 +571,8 @@ static CMthreadTeam_p _MFModelParse (int argc, char *argv [],int argNum, int (*m
 	}
 	if (*startDate == (char *) NULL) *startDate = "XXXX-01-01";
 	if (*endDate   == (char *) NULL) *endDate   = "XXXX-12-31";
+	if (_MFRestart && (_MFCheckpointPath == (char *) NULL)) { CMmsgPrint (CMmsgUsrError,"Missing checkpoint file to restart from!"); goto Stop; }
+	if ((_MFMemberNum > 1) && (_MFCheckpointPath != (char *) NULL)) { CMmsgPrint (CMmsgUsrError,"Checkpoints are not supported in ensemble runs!"); goto Stop; }
 
     if (!MFDateSetCurrent (*startDate)) { CMmsgPrint (CMmsgUsrError,"Error: Invalid start date!"); goto Stop; }
     if (!MFDateSetCurrent (*endDate))   { CMmsgPrint (CMmsgAppError,"Error: Invalid end date!");   goto Stop; }
@@ -309,6 +605,11 @@ static CMthreadTeam_p _MFModelParse (int argc, char *argv [],int argNum, int (*m
 			varEntry->InUse = true;
 			var->OutputPath = varEntry->Path;
 		}
+		for (aggr = 0; aggr < MFAggrNum; ++aggr)
+			if ((varEntry = _MFModelVarEntryFind (aggrVars [aggr], aggrVarNum [aggr], var->Name)) != (varEntry_p) NULL) {
+				varEntry->InUse = true;
+				var->AggrPath [aggr] = varEntry->Path;
+			}
 		if ((varEntry = _MFModelVarEntryFind (stateVars,  stateVarNum,  var->Name)) != (varEntry_p) NULL) {
             if (var->Initial) {
                 varEntry->InUse = true;
@@ -328,11 +629,15 @@ static CMthreadTeam_p _MFModelParse (int argc, char *argv [],int argNum, int (*m
 		if (inputVars [i].InUse  == false) CMmsgPrint(CMmsgInfo,"Unused input variable : %s",  inputVars [i].Name);
 	for (i = 0; i < outputVarNum; ++i)
 		if (outputVars [i].InUse == false) CMmsgPrint(CMmsgInfo,"Unused output variable : %s", outputVars [i].Name);
+	for (aggr = 0; aggr < MFAggrNum; ++aggr)
+		for (i = 0; i < aggrVarNum [aggr]; ++i)
+			if (aggrVars [aggr][i].InUse == false) CMmsgPrint(CMmsgInfo,"Unused aggregated output variable : %s", aggrVars [aggr][i].Name);
 	for (i = 0; i < stateVarNum;  ++i)
 		if (stateVars [i].InUse  == false) CMmsgPrint(CMmsgInfo,"Unused state variable : %s",  stateVars [i].Name);
 Stop:
     _MFModelVarEntriesFree(inputVars,  inputVarNum);
 	_MFModelVarEntriesFree(outputVars, outputVarNum);
+	for (aggr = 0; aggr < MFAggrNum; ++aggr) _MFModelVarEntriesFree(aggrVars [aggr], aggrVarNum [aggr]);
 	_MFModelVarEntriesFree(stateVars,  stateVarNum);
 
 	if (argNum > 2) {
@@ -343,27 +648,684 @@ Stop:
 	if (argNum < 2) { CMmsgPrint (CMmsgUsrError,"Missing Template Coverage!"); return ((CMthreadTeam_p) NULL); }
 	if (*testOnly)  { _MFModelVarPrintOut ("Source"); return ((CMthreadTeam_p) NULL); }
 	*domainFile = argv [1];
-	return (resolved ? CMthreadTeamCreate (procNum) : (CMthreadTeam_p) NULL);
+	if (!resolved || ((team = CMthreadTeamCreate (procNum)) == (CMthreadTeam_p) NULL)) return ((CMthreadTeam_p) NULL);
+	CMthreadTeamSetSchedule (team, (CMthreadSchedule) schedule);
+	if (_MFThreadReport != (char *) NULL) CMthreadTeamSetProfile (team, true);
+	return (team);
 }
 
+static long long _MFModelClock () {
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((long long) ts.tv_sec * 1000000000LL + (long long) ts.tv_nsec);
+}
+
+static inline void _MFModelProfileAdd (size_t threadId, int iFunc, bool timed, long long *start) {
+	MFProfileCount_t *count = _MFProfile.Counts + threadId * _MFProfile.FuncNum + iFunc;
+	long long now;
+
+	count->Calls += _MFMemberNum;
+	if (timed) {
+		now = _MFModelClock ();
+		count->Time    += now - *start - _MFProfile.ClockCost;
+		count->Sampled += _MFMemberNum;
+		*start = now;
+	}
+}
+
+// Ensemble members of the cell are stepped one function after the other, so each function sweeps their
+// neighbouring items and the members only share the task and its scheduling.
 static void _MFUserFunc (size_t threadId, size_t objectId, void *commonPtr) {
-	int iFunc, varID, link, uLink;
+	int iFunc, iVar, member, itemID = objectId * _MFMemberNum;
+	size_t link, linkEnd = _MFUpstream->Offsets [objectId + 1];
 	MFVariable_p var;
-	float value, weight;
+	float value;
+	bool timed = _MFProfile.Active && ((objectId + _MFProfile.Offset) % MFProfileSample == 0);
+	long long start = timed ? _MFModelClock () : 0;
 
-	for (var = MFVarGetByID (varID = 1);var != (MFVariable_p) NULL;var = MFVarGetByID (++varID))
-		if (var->Route) {
-			// WBM routed variables are considered to be extensive. Intensive variables are
-			// computed within modules I THINK!. Weighing code here assumes this.
+	for (iVar = 0;iVar < _MFRouteVarNum; ++iVar) {
+		// WBM routed variables are considered to be extensive. Intensive variables are
+		// computed within modules I THINK!. Weighing code here assumes this.
+		var   = _MFRouteVars [iVar];
+		for (member = 0; member < _MFMemberNum; ++member) {
 			value = 0.0;
-			for (link  = 0; link < _MFDomain->Objects [objectId].ULinkNum; ++link) {
-				uLink  = _MFDomain->Objects [objectId].ULinks [link];
-                weight = _MFDomain->Objects [objectId].UWeights [link];
-				value += MFVarGetFloat (varID,uLink,0.0) * weight;
+			for (link = _MFUpstream->Offsets [objectId]; link < linkEnd; ++link)
+				value += MFVarFastGetFloat (var,_MFUpstream->Links [link] * _MFMemberNum + member,0.0) * _MFUpstream->Weights [link];
+			MFVarFastSetFloat (var, itemID + member, value);
+		}
+	}
+	if (_MFProfile.Active) _MFModelProfileAdd (threadId, _MFFunctionNum, timed, &start);
+	for (iFunc = _MFLocalNum;iFunc < _MFFunctionNum; ++iFunc) {
+		if (_MFProbe) MFVarRouteTrack (true);
+		for (member = 0; member < _MFMemberNum; ++member) (_MFFunctions [iFunc]) (itemID + member);
+		if (_MFProbe && MFVarRouteTouched ()) _MFFunctionRouted [iFunc] = true;
+		if (_MFProfile.Active) _MFModelProfileAdd (threadId, iFunc, timed, &start);
+	}
+}
+
+// Functions ahead of the first one that reads or writes a routed variable only see values of their own cell
+// (routed variables are the only channel between cells), so they can run for every cell at once before the
+// routing ordered job, which then accumulates the routed variables and runs the remaining functions.
+static void _MFLocalUserFunc (size_t threadId, size_t objectId, void *commonPtr) {
+	int iFunc, member, itemID = objectId * _MFMemberNum;
+	bool timed = _MFProfile.Active && ((objectId + _MFProfile.Offset) % MFProfileSample == 0);
+	long long start = timed ? _MFModelClock () : 0;
+
+	(void) commonPtr;
+	for (iFunc = 0;iFunc < _MFLocalNum; ++iFunc) {
+		for (member = 0; member < _MFMemberNum; ++member) (_MFFunctions [iFunc]) (itemID + member);
+		if (_MFProfile.Active) _MFModelProfileAdd (threadId, iFunc, timed, &start);
+	}
+}
+
+static void _MFModelProfileFree () {
+	if (_MFProfile.Counts     != (MFProfileCount_t *) NULL) free (_MFProfile.Counts);
+	if (_MFProfile.Time       != (double *) NULL) free (_MFProfile.Time);
+	if (_MFProfile.ThreadTime != (double *) NULL) free (_MFProfile.ThreadTime);
+	if (_MFProfile.StepMax    != (double *) NULL) free (_MFProfile.StepMax);
+	if (_MFProfile.Calls      != (size_t *) NULL) free (_MFProfile.Calls);
+	if (_MFProfile.StepDate   != NULL) free (_MFProfile.StepDate);
+	_MFProfile.Counts     = (MFProfileCount_t *) NULL;
+	_MFProfile.Time       = _MFProfile.ThreadTime = _MFProfile.StepMax = (double *) NULL;
+	_MFProfile.Calls      = (size_t *) NULL;
+	_MFProfile.StepDate   = NULL;
+	_MFProfile.Active     = false;
+}
+
+static CMreturn _MFModelProfileStart (size_t threadNum) {
+	int i;
+	long long clock, cost;
+
+	_MFProfile.ClockCost = 0;
+	for (i = 0; i < 1000; ++i) {
+		clock = _MFModelClock ();
+		cost  = _MFModelClock () - clock;
+		if ((i == 0) || (cost < _MFProfile.ClockCost)) _MFProfile.ClockCost = cost;
+	}
+	_MFProfile.Routed    = _MFRouteVarNum > 0;
+	_MFProfile.ThreadNum = threadNum > 0 ? threadNum : 1;
+	_MFProfile.FuncNum   = _MFFunctionNum + 1;
+	_MFProfile.Offset    = _MFProfile.StepNum = 0;
+	if (((_MFProfile.Counts     = (MFProfileCount_t *) calloc (_MFProfile.ThreadNum * _MFProfile.FuncNum, sizeof (MFProfileCount_t))) == (MFProfileCount_t *) NULL) ||
+	    ((_MFProfile.ThreadTime = (double *) calloc (_MFProfile.ThreadNum * _MFProfile.FuncNum, sizeof (double))) == (double *) NULL) ||
+	    ((_MFProfile.Time       = (double *) calloc (_MFProfile.FuncNum, sizeof (double))) == (double *) NULL) ||
+	    ((_MFProfile.StepMax    = (double *) calloc (_MFProfile.FuncNum, sizeof (double))) == (double *) NULL) ||
+	    ((_MFProfile.Calls      = (size_t *) calloc (_MFProfile.FuncNum, sizeof (size_t))) == (size_t *) NULL) ||
+	    ((_MFProfile.StepDate   = calloc (_MFProfile.FuncNum, MFDateStringLength)) == NULL)) {
+		CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+		_MFModelProfileFree ();
+		return (CMfailed);
+	}
+	return (CMsucceeded);
+}
+
+// Called by the master thread between time steps, when no function is running
+static void _MFModelProfileStep (const char *date) {
+	int iFunc;
+	size_t threadId, calls, sampled;
+	long long time;
+	double scale;
+	MFProfileCount_t *count;
+
+	for (iFunc = 0; iFunc < (int) _MFProfile.FuncNum; ++iFunc) {
+		time = 0; calls = sampled = 0;
+		for (threadId = 0; threadId < _MFProfile.ThreadNum; ++threadId) {
+			count    = _MFProfile.Counts + threadId * _MFProfile.FuncNum + iFunc;
+			time    += count->Time;
+			calls   += count->Calls;
+			sampled += count->Sampled;
+		}
+		if (time < 0) time = 0;
+		scale = sampled > 0 ? (double) calls / (double) sampled / 1e9 : 0.0;
+		for (threadId = 0; threadId < _MFProfile.ThreadNum; ++threadId) {
+			count = _MFProfile.Counts + threadId * _MFProfile.FuncNum + iFunc;
+			if (count->Time > 0) _MFProfile.ThreadTime [threadId * _MFProfile.FuncNum + iFunc] += (double) count->Time * scale;
+			memset (count, 0, sizeof (MFProfileCount_t));
+		}
+		_MFProfile.Time  [iFunc] += (double) time * scale;
+		_MFProfile.Calls [iFunc] += calls;
+		if ((double) time * scale > _MFProfile.StepMax [iFunc]) {
+			_MFProfile.StepMax [iFunc] = (double) time * scale;
+			strncpy (_MFProfile.StepDate [iFunc], date, MFDateStringLength - 1);
+		}
+	}
+	_MFProfile.StepNum++;
+	_MFProfile.Offset = (_MFProfile.Offset + 1) % MFProfileSample;
+}
+
+static int _MFModelProfileCompare (const void *a, const void *b) {
+	double timeA = _MFProfile.Time [*((const int *) a)], timeB = _MFProfile.Time [*((const int *) b)];
+
+	return ((timeA < timeB) - (timeA > timeB));
+}
+
+// Ranked by run time. Imbalance is the time of the busiest thread over the mean of the threads.
+static void _MFModelProfilePrint () {
+	int *order, rank, row = 0, iFunc;
+	size_t threadId;
+	double total = 0.0, threadMax;
+	char name [MFNameLength + 8];
+
+	if ((_MFProfile.Counts == (MFProfileCount_t *) NULL) || (_MFProfile.StepNum == 0)) return;
+	if ((order = (int *) malloc (_MFProfile.FuncNum * sizeof (int))) == (int *) NULL) {
+		CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+		return;
+	}
+	for (iFunc = 0; iFunc < (int) _MFProfile.FuncNum; ++iFunc) { order [iFunc] = iFunc; total += _MFProfile.Time [iFunc]; }
+	qsort (order, _MFProfile.FuncNum, sizeof (int), _MFModelProfileCompare);
+	CMmsgPrint (CMmsgInfo, "Function profile: %zu time steps, %zu threads, one cell in %d timed",
+	            _MFProfile.StepNum, _MFProfile.ThreadNum, MFProfileSample);
+	CMmsgPrint (CMmsgInfo, "%4s %-36s %10s %6s %12s %9s %13s %-12s %9s",
+	            "Rank", "Function", "Time [s]", "Share", "Calls", "ns/call", "Max step [ms]", "(date)", "Imbalance");
+	for (rank = 0; rank < (int) _MFProfile.FuncNum; ++rank) {
+		iFunc = order [rank];
+		if (iFunc < _MFFunctionNum) snprintf (name, sizeof (name), "%s [%d]", _MFFunctionNames [iFunc], iFunc + 1);
+		else if (_MFProfile.Routed) strcpy (name, "Upstream accumulation");
+		else continue;
+		threadMax = 0.0;
+		for (threadId = 0; threadId < _MFProfile.ThreadNum; ++threadId)
+			if (_MFProfile.ThreadTime [threadId * _MFProfile.FuncNum + iFunc] > threadMax) threadMax = _MFProfile.ThreadTime [threadId * _MFProfile.FuncNum + iFunc];
+		CMmsgPrint (CMmsgInfo, "%4d %-36s %10.3f %5.1f%% %12zu %9.1f %13.2f %-12s %9.2f", ++row, name,
+		            _MFProfile.Time [iFunc], total > 0.0 ? 100.0 * _MFProfile.Time [iFunc] / total : 0.0, _MFProfile.Calls [iFunc],
+		            _MFProfile.Calls [iFunc] > 0 ? _MFProfile.Time [iFunc] * 1e9 / (double) _MFProfile.Calls [iFunc] : 0.0,
+		            _MFProfile.StepMax [iFunc] * 1e3, _MFProfile.StepDate [iFunc],
+		            _MFProfile.Time [iFunc] > 0.0 ? threadMax * (double) _MFProfile.ThreadNum / _MFProfile.Time [iFunc] : 1.0);
+	}
+	free (order);
+}
+
+static bool _MFModelMemberPath (const char *path) {
+	return ((path == (char *) NULL) || (strstr (path, MFmemberStr) != (char *) NULL));
+}
+
+// Initial values read once for the ensemble are copied to every member, since each member updates its own
+static CMreturn _MFModelMemberSpread (MFVariable_p var) {
+	int cell, member;
+	size_t itemSize = MFVarItemSize (var->Type);
+	void *buffer;
+
+	if ((var->Share < 2) || var->Broadcast) return (CMsucceeded);
+	if ((buffer = malloc (var->ItemNum * var->Share * itemSize)) == (void *) NULL) {
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	for (cell = 0; cell < var->ItemNum; ++cell)
+		for (member = 0; member < var->Share; ++member)
+			memcpy ((char *) buffer + (cell * var->Share + member) * itemSize, (char *) var->Buffer + cell * itemSize, itemSize);
+	free (var->Buffer);
+	var->Buffer   = buffer;
+	var->ItemNum *= var->Share;
+	var->Share    = 1;
+	return (CMsucceeded);
+}
+
+static bool _MFModelPathTemplate (const char *path) {
+	return ((path != (char *) NULL) && (strstr (path, MFyearStr) != (char *) NULL));
+}
+
+// Resolves a per-year file template with the (four character) year of the date
+static char *_MFModelPathYear (const char *path, const char *date) {
+	size_t yearLen = strlen (MFDateClimatologyYearStr), num = 0, pos = 0;
+	char *yearPath;
+	const char *next;
+
+	for (next = strstr (path, MFyearStr); next != (char *) NULL; next = strstr (next + strlen (MFyearStr), MFyearStr)) num++;
+	if ((yearPath = (char *) malloc (strlen (path) + num * yearLen + 1)) == (char *) NULL) {
+		CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+		return ((char *) NULL);
+	}
+	while ((next = strstr (path, MFyearStr)) != (char *) NULL) {
+		memcpy (yearPath + pos, path, next - path);
+		pos += next - path;
+		memcpy (yearPath + pos, date, yearLen);
+		pos += yearLen;
+		path = next + strlen (MFyearStr);
+	}
+	strcpy (yearPath + pos, path);
+	return (yearPath);
+}
+
+static MFDataStream_p _MFModelStreamOpen (const char *path, const char *date, const char *mode) {
+	char *yearPath;
+	MFDataStream_p dStream;
+
+	if ((yearPath = _MFModelPathYear (path, date)) == (char *) NULL) return ((MFDataStream_p) NULL);
+	dStream = MFDataStreamOpen (yearPath, mode);
+	free (yearPath);
+	return (dStream);
+}
+
+static MFAggregate_p _MFModelAggregateOpen (MFVariable_p var, int aggr, const char *date, const char *mode) {
+	char *yearPath;
+	MFAggregate_p aggregate;
+
+	if ((yearPath = _MFModelPathYear (var->AggrPath [aggr], date)) == (char *) NULL) return ((MFAggregate_p) NULL);
+	aggregate = MFAggregateOpen (var, aggr, yearPath, mode);
+	free (yearPath);
+	return (aggregate);
+}
+
+// Writes the state file of the year of the date, the record is dated with the first step it initializes
+static CMreturn _MFModelStateWrite (MFVariable_p var, const char *date, const char *outDate) {
+	MFDataStream_p outStream = var->OutStream;
+	CMreturn ret;
+
+	if ((var->OutStream = _MFModelStreamOpen (var->StatePath, date, "w")) == (MFDataStream_p) NULL) { var->OutStream = outStream; return (CMfailed); }
+	strcpy (var->OutDate, outDate);
+	ret = MFdsRecordWrite (var);
+	if (MFDataStreamClose (var->OutStream) == CMfailed) ret = CMfailed;
+	free (var->OutStream);
+	var->OutStream = outStream;
+	if (ret == CMfailed) CMmsgPrint (CMmsgAppError,"Variable (%s) writing error!",var->Name);
+	return (ret);
+}
+
+// Moves the streams of a variable to the next year: per-year templates are reopened for the new year, and
+// climatological inputs are rewound since their records repeat every year
+static CMreturn _MFModelYearSwitch (MFVariable_p var, const char *dateCur, const char *dateNext, bool spinup) {
+	int aggr;
+	CMreturn ret;
+
+	if ((var->OutStream != (MFDataStream_p) NULL) && _MFModelPathTemplate (var->OutputPath)) {
+		ret = MFDataStreamClose (var->OutStream);
+		free (var->OutStream);
+		if (ret == CMfailed) {
+			CMmsgPrint (CMmsgAppError,"Variable (%s) writing error!",var->Name);
+			var->OutStream = (MFDataStream_p) NULL;
+			return (CMfailed);
+		}
+		if ((var->OutStream = _MFModelStreamOpen (var->OutputPath, dateNext, "w")) == (MFDataStream_p) NULL) return (CMfailed);
+	}
+	for (aggr = 0; aggr < MFAggrNum; ++aggr)
+		if ((var->Aggregate [aggr] != (MFAggregate_p) NULL) && _MFModelPathTemplate (var->AggrPath [aggr])) {
+			if (MFAggregateClose (var->Aggregate [aggr]) == CMfailed) {
+				CMmsgPrint (CMmsgAppError,"Variable (%s) aggregate writing error!",var->Name);
+				var->Aggregate [aggr] = (MFAggregate_p) NULL;
+				return (CMfailed);
+			}
+			if ((var->Aggregate [aggr] = _MFModelAggregateOpen (var, aggr, dateNext, "w")) == (MFAggregate_p) NULL) return (CMfailed);
+		}
+	if (!spinup && _MFModelPathTemplate (var->StatePath) && (_MFModelStateWrite (var, dateCur, dateNext) == CMfailed)) return (CMfailed);
+	if ((var->InStream != (MFDataStream_p) NULL) && (var->InStream->Type != MFConst) &&
+	    (_MFModelPathTemplate (var->InputPath) || (strncmp (var->CurDate, MFDateClimatologyYearStr, strlen (MFDateClimatologyYearStr)) == 0))) {
+		MFDataStreamClose (var->InStream);
+		free (var->InStream);
+		if ((var->InStream = _MFModelStreamOpen (var->InputPath, dateNext, "r")) == (MFDataStream_p) NULL) return (CMfailed);
+	}
+	return (CMsucceeded);
+}
+
+// Spin-up follows the floating point initial variables saved as states, or all of them when there are no state files
+static CMreturn _MFModelSpinupTrack () {
+	int varID, pass;
+	MFVariable_p var;
+
+	for (pass = 0; (pass < 2) && (_MFSpinupVarNum == 0); ++pass)
+		for (var = MFVarGetByID (varID = 1);var != (MFVariable_p) NULL;var = MFVarGetByID (++varID)) {
+			if (!var->Initial || ((var->Type != MFFloat) && (var->Type != MFDouble))) continue;
+			if ((pass == 0) && (var->StatePath == (char *) NULL)) continue;
+			if (MFVarExpand (var) == CMfailed) return (CMfailed);
+			if (((_MFSpinupVars  = (MFVariable_p *) realloc (_MFSpinupVars,  (_MFSpinupVarNum + 1) * sizeof (MFVariable_p))) == (MFVariable_p *) NULL) ||
+			    ((_MFSpinupStart = (void **)        realloc (_MFSpinupStart, (_MFSpinupVarNum + 1) * sizeof (void *)))       == (void **) NULL) ||
+			    ((_MFSpinupStart [_MFSpinupVarNum] = malloc (var->ItemNum * MFVarItemSize (var->Type))) == (void *) NULL)) {
+				CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+				return (CMfailed);
+			}
+			_MFSpinupVars [_MFSpinupVarNum++] = var;
+		}
+	return (CMsucceeded);
+}
+
+static void _MFModelSpinupSnapshot () {
+	int i;
+
+	for (i = 0; i < _MFSpinupVarNum; ++i)
+		memcpy (_MFSpinupStart [i], _MFSpinupVars [i]->Buffer, _MFSpinupVars [i]->ItemNum * MFVarItemSize (_MFSpinupVars [i]->Type));
+}
+
+// Largest relative change of the tracked states over the last cycle: sum of absolute differences over sum of absolute values
+static double _MFModelSpinupChange (int cycle) {
+	int i, item;
+	double val0, val1, sumDiff, sumVal, change, maxChange = 0.0;
+	MFVariable_p var;
+
+	for (i = 0; i < _MFSpinupVarNum; ++i) {
+		var = _MFSpinupVars [i];
+		sumDiff = sumVal = 0.0;
+		for (item = 0; item < var->ItemNum; ++item) {
+			if (var->Type == MFFloat) { val0 = ((float *)  _MFSpinupStart [i]) [item]; val1 = ((float *)  var->Buffer) [item]; }
+			else                      { val0 = ((double *) _MFSpinupStart [i]) [item]; val1 = ((double *) var->Buffer) [item]; }
+			if (CMmathEqualValues (val0, var->Missing.Float) || CMmathEqualValues (val1, var->Missing.Float)) continue;
+			sumDiff += fabs (val1 - val0);
+			sumVal  += fabs (val1);
+		}
+		change = sumVal > 0.0 ? sumDiff / sumVal : sumDiff;
+		CMmsgPrint (CMmsgInfo,"Spin-up cycle %d: %s changed by %g",cycle,var->Name,change);
+		if (change > maxChange) maxChange = change;
+	}
+	return (maxChange);
+}
+
+static void _MFModelSpinupFree () {
+	int i;
+
+	for (i = 0; i < _MFSpinupVarNum; ++i) free (_MFSpinupStart [i]);
+	if (_MFSpinupVars  != (MFVariable_p *) NULL) { free (_MFSpinupVars);  _MFSpinupVars  = (MFVariable_p *) NULL; }
+	if (_MFSpinupStart != (void **)        NULL) { free (_MFSpinupStart); _MFSpinupStart = (void **)        NULL; }
+	_MFSpinupVarNum = 0;
+}
+
+// Outputs are opened for the cycle that writes them, after the spin-up
+static CMreturn _MFModelOutputOpen (const char *startDate) {
+	int varID, aggr;
+	MFVariable_p var;
+
+	for (var = MFVarGetByID (varID = 1);var != (MFVariable_p) NULL;var = MFVarGetByID (++varID)) {
+		if ((var->OutputPath != (char *) NULL) &&
+		    ((var->OutStream = _MFModelStreamOpen (var->OutputPath, startDate, "w")) == (MFDataStream_p) NULL)) return (CMfailed);
+		for (aggr = 0; aggr < MFAggrNum; ++aggr)
+			if ((var->AggrPath [aggr] != (char *) NULL) &&
+			    ((var->Aggregate [aggr] = _MFModelAggregateOpen (var, aggr, startDate, "w")) == (MFAggregate_p) NULL)) return (CMfailed);
+	}
+	return (CMsucceeded);
+}
+
+// Takes the inputs back to the start of the run period for the next cycle
+static CMreturn _MFModelRewind (const char *startDate) {
+	int varID;
+	MFVariable_p var;
+
+	for (var = MFVarGetByID (varID = 1);var != (MFVariable_p) NULL;var = MFVarGetByID (++varID)) {
+		if (var->InStream == (MFDataStream_p) NULL) continue;
+		if (var->InStream->Type != MFConst) {
+			MFDataStreamClose (var->InStream);
+			free (var->InStream);
+			if ((var->InStream = _MFModelStreamOpen (var->InputPath, startDate, "r")) == (MFDataStream_p) NULL) return (CMfailed);
+			strcpy (var->CurDate, "NOT SET");
+		}
+		strcpy (var->InDate, startDate);
+		if (MFdsRecordRead (var) == CMfailed) {
+			CMmsgPrint (CMmsgAppError, "Variable (%s) Reading error!", var->Name);
+			return (CMfailed);
+		}
+	}
+	return (CMsucceeded);
+}
+
+static CMreturn _MFModelCheckpointPut (const void *data, size_t size) {
+	size_t capacity;
+	char *ptr;
+
+	if (_MFCheckpoint.Size + size > _MFCheckpoint.Capacity) {
+		capacity = _MFCheckpoint.Capacity > 0 ? _MFCheckpoint.Capacity * 2 : 1024 * 1024;
+		while (capacity < _MFCheckpoint.Size + size) capacity *= 2;
+		if ((ptr = (char *) realloc (_MFCheckpoint.Data, capacity)) == (char *) NULL) {
+			CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+			return (CMfailed);
+		}
+		_MFCheckpoint.Data     = ptr;
+		_MFCheckpoint.Capacity = capacity;
+	}
+	memcpy (_MFCheckpoint.Data + _MFCheckpoint.Size, data, size);
+	_MFCheckpoint.Size += size;
+	return (CMsucceeded);
+}
+
+// Records how far an output got: everything queued for it is on its way to the file once the write-behind queue is flushed
+static CMreturn _MFModelCheckpointStream (MFDataStream_p dStream) {
+	int fd, *files;
+	long long offset = -1;
+
+	if ((dStream->Type == MFFile) &&
+	    ((fflush (dStream->Handle.File) != 0) || ((offset = (long long) ftello (dStream->Handle.File)) == -1))) {
+		CMmsgPrint (CMmsgSysError,"Output flushing error in: %s:%d",__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	if ((offset >= 0) && ((fd = dup (fileno (dStream->Handle.File))) != -1)) {
+		if (_MFCheckpoint.FileNum == _MFCheckpoint.FileMax) {
+			if ((files = (int *) realloc (_MFCheckpoint.Files, (_MFCheckpoint.FileMax + 16) * sizeof (int))) == (int *) NULL) {
+				CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+				close (fd);
+				return (CMfailed);
+			}
+			_MFCheckpoint.Files    = files;
+			_MFCheckpoint.FileMax += 16;
+		}
+		_MFCheckpoint.Files [_MFCheckpoint.FileNum++] = fd;
+	}
+	return (_MFModelCheckpointPut (&offset, sizeof (offset)));
+}
+
+// Syncs the outputs the checkpoint refers to, then replaces the previous checkpoint file in one rename
+static void *_MFModelCheckpointWork (void *dataPtr) {
+	int i;
+	long long start = _MFModelClock ();
+	FILE *outFile;
+	CMreturn status = CMsucceeded;
+
+	(void) dataPtr;
+	for (i = 0; i < _MFCheckpoint.FileNum; ++i) {
+		if (fsync (_MFCheckpoint.Files [i]) != 0) status = CMfailed;
+		close (_MFCheckpoint.Files [i]);
+	}
+	_MFCheckpoint.FileNum = 0;
+	if ((outFile = fopen (_MFCheckpoint.TmpPath,"w")) == (FILE *) NULL) status = CMfailed;
+	else {
+		if (fwrite (_MFCheckpoint.Data, 1, _MFCheckpoint.Size, outFile) != _MFCheckpoint.Size) status = CMfailed;
+		if ((fflush (outFile) != 0) || (fsync (fileno (outFile)) != 0)) status = CMfailed;
+		if (fclose (outFile) != 0) status = CMfailed;
+		if ((status == CMfailed) || (rename (_MFCheckpoint.TmpPath, _MFCheckpointPath) != 0)) {
+			unlink (_MFCheckpoint.TmpPath);
+			status = CMfailed;
+		}
+	}
+	_MFCheckpoint.WriteTime = (double) (_MFModelClock () - start) / 1e9;
+	_MFCheckpoint.Status    = status;
+	return ((void *) NULL);
+}
+
+// A checkpoint that could not be written leaves the previous one in place, the run itself goes on
+static void _MFModelCheckpointWait () {
+	if (!_MFCheckpoint.Active) return;
+	pthread_join (_MFCheckpoint.Thread, (void **) NULL);
+	_MFCheckpoint.Active = false;
+	if (_MFCheckpoint.Status == CMfailed)
+		CMmsgPrint (CMmsgWarning,"Warning: Checkpoint [%s] at %s writing error!",_MFCheckpointPath,_MFCheckpoint.Date);
+	else
+		CMmsgPrint (CMmsgInfo,"Checkpoint at %s saved (%.1f MB, %.2f s copy, %.2f s write)",_MFCheckpoint.Date,
+		            (double) _MFCheckpoint.Size / (1024.0 * 1024.0),_MFCheckpoint.CopyTime,_MFCheckpoint.WriteTime);
+}
+
+static void _MFModelCheckpointFree () {
+	_MFModelCheckpointWait ();
+	if (_MFCheckpoint.Data    != (char *) NULL) { free (_MFCheckpoint.Data);    _MFCheckpoint.Data    = (char *) NULL; }
+	if (_MFCheckpoint.TmpPath != (char *) NULL) { free (_MFCheckpoint.TmpPath); _MFCheckpoint.TmpPath = (char *) NULL; }
+	if (_MFCheckpoint.Files   != (int *)  NULL) { free (_MFCheckpoint.Files);   _MFCheckpoint.Files   = (int *)  NULL; }
+	_MFCheckpoint.Size = _MFCheckpoint.Capacity = 0;
+	_MFCheckpoint.FileMax = 0;
+}
+
+// Takes a checkpoint ahead of computing the date. The model only waits for the outputs to be flushed and for the state
+// to be copied, the checkpoint file is written in the background.
+static CMreturn _MFModelCheckpointSave (const char *date) {
+	int varID, aggr;
+	long long start;
+	MFVariable_p var;
+	MFAggregate_p aggregate;
+	MFCheckpointHeader_t header;
+	MFCheckpointVar_t varRecord;
+
+	_MFModelCheckpointWait ();
+	start = _MFModelClock ();
+	if ((_MFCheckpoint.TmpPath == (char *) NULL) &&
+	    ((_MFCheckpoint.TmpPath = (char *) malloc (strlen (_MFCheckpointPath) + 5)) == (char *) NULL)) {
+		CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	sprintf (_MFCheckpoint.TmpPath,"%s.tmp",_MFCheckpointPath);
+	if (MFDataStreamFlush () == CMfailed) return (CMfailed);
+
+	_MFCheckpoint.Size = 0;
+	memset (&header, 0, sizeof (header));
+	memcpy (header.Tag, MFCheckpointTag, sizeof (header.Tag));
+	header.Version = MFCheckpointVersion;
+	header.ItemNum = _MFDomain->ObjNum;
+	header.Order   = _MFCellOrder;
+	for (var = MFVarGetByID (varID = 1);var != (MFVariable_p) NULL;var = MFVarGetByID (++varID)) header.VarNum++;
+	strncpy (header.Date, date, sizeof (header.Date) - 1);
+	if (_MFModelCheckpointPut (&header, sizeof (header)) == CMfailed) return (CMfailed);
+	for (var = MFVarGetByID (varID = 1);var != (MFVariable_p) NULL;var = MFVarGetByID (++varID)) {
+		memset (&varRecord, 0, sizeof (varRecord));
+		if (snprintf (varRecord.Name, sizeof (varRecord.Name), "%s", var->Name) >= (int) sizeof (varRecord.Name)) {
+			CMmsgPrint (CMmsgUsrError,"Variable name [%s] is too long for checkpoint in: %s:%d",var->Name,__FILE__,__LINE__);
+			return (CMfailed);
+		}
+		varRecord.Type = var->Type;
+		if (var->Initial && !var->Broadcast) varRecord.Flags |= MFCheckpointState;
+		if ((var->InStream != (MFDataStream_p) NULL) && (var->InStream->Type != MFConst)) varRecord.Flags |= MFCheckpointInput;
+		if (var->OutStream != (MFDataStream_p) NULL) varRecord.Flags |= MFCheckpointOutput;
+		for (aggr = 0; aggr < MFAggrNum; ++aggr)
+			if (var->Aggregate [aggr] != (MFAggregate_p) NULL) varRecord.Flags |= MFCheckpointAggregate << aggr;
+		if (_MFModelCheckpointPut (&varRecord, sizeof (varRecord)) == CMfailed) return (CMfailed);
+		if ((varRecord.Flags & MFCheckpointState) &&
+		    (_MFModelCheckpointPut (var->Buffer, var->ItemNum * MFVarItemSize (var->Type)) == CMfailed)) return (CMfailed);
+		if ((varRecord.Flags & MFCheckpointInput) &&
+		    (_MFModelCheckpointPut (&(var->InStream->Offset), sizeof (long long)) == CMfailed)) return (CMfailed);
+		if ((varRecord.Flags & MFCheckpointOutput) && (_MFModelCheckpointStream (var->OutStream) == CMfailed)) return (CMfailed);
+		for (aggr = 0; aggr < MFAggrNum; ++aggr) {
+			if ((aggregate = var->Aggregate [aggr]) == (MFAggregate_p) NULL) continue;
+			if ((_MFModelCheckpointStream (aggregate->Stream) == CMfailed) ||
+			    (_MFModelCheckpointPut (aggregate->Date,     sizeof (aggregate->Date))   == CMfailed) ||
+			    (_MFModelCheckpointPut (&(aggregate->MaxObs), sizeof (int))              == CMfailed) ||
+			    (_MFModelCheckpointPut (aggregate->Values, aggregate->ItemNum * sizeof (double)) == CMfailed) ||
+			    (_MFModelCheckpointPut (aggregate->ObsNum, aggregate->ItemNum * sizeof (int))    == CMfailed)) return (CMfailed);
+		}
+	}
+	strcpy (_MFCheckpoint.Date, date);
+	_MFCheckpoint.CopyTime = (double) (_MFModelClock () - start) / 1e9;
+	if (pthread_create (&(_MFCheckpoint.Thread), NULL, _MFModelCheckpointWork, (void *) NULL) != 0) {
+		CMmsgPrint (CMmsgSysError,"Checkpoint thread creation error in: %s:%d",__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	_MFCheckpoint.Active = true;
+	return (CMsucceeded);
+}
+
+static CMreturn _MFModelCheckpointGet (const char *data, size_t size, size_t *pos, void *item, size_t itemSize) {
+	if (*pos + itemSize > size) {
+		CMmsgPrint (CMmsgUsrError,"Truncated checkpoint [%s]!",_MFCheckpointPath);
+		return (CMfailed);
+	}
+	memcpy (item, data + *pos, itemSize);
+	*pos += itemSize;
+	return (CMsucceeded);
+}
+
+// Picks the run up at the checkpoint date: states are restored, inputs go back to the records they held and outputs are
+// cut back to the size they had. Without a checkpoint file the run starts from the beginning.
+static CMreturn _MFModelRestart (const char *startDate, const char *endDate, bool *restarted) {
+	int varID, aggr, flags;
+	char *data = (char *) NULL;
+	size_t size = 0, pos = 0;
+	long long offset;
+	FILE *inFile;
+	MFVariable_p var;
+	MFAggregate_p aggregate;
+	MFCheckpointHeader_t header;
+	MFCheckpointVar_t varRecord;
+	CMreturn ret = CMfailed;
+
+	*restarted = false;
+	if ((inFile = fopen (_MFCheckpointPath,"r")) == (FILE *) NULL) {
+		CMmsgPrint (CMmsgWarning,"Warning: No checkpoint [%s] to restart from, starting at %s",_MFCheckpointPath,startDate);
+		return (CMsucceeded);
+	}
+	if ((fseeko (inFile, 0, SEEK_END) != 0) || ((offset = (long long) ftello (inFile)) < 0) || (fseeko (inFile, 0, SEEK_SET) != 0)) {
+		CMmsgPrint (CMmsgSysError,"Checkpoint [%s] reading error!",_MFCheckpointPath);
+		fclose (inFile);
+		return (CMfailed);
+	}
+	size = (size_t) offset;
+	if ((data = (char *) malloc (size + 1)) == (char *) NULL) {
+		CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+		fclose (inFile);
+		return (CMfailed);
+	}
+	if (fread (data, 1, size, inFile) != size) {
+		CMmsgPrint (CMmsgSysError,"Checkpoint [%s] reading error!",_MFCheckpointPath);
+		fclose (inFile);
+		goto Stop;
+	}
+	fclose (inFile);
+
+	if (_MFModelCheckpointGet (data, size, &pos, &header, sizeof (header)) == CMfailed) goto Stop;
+	header.Date [sizeof (header.Date) - 1] = '\0';
+	for (var = MFVarGetByID (varID = 1);var != (MFVariable_p) NULL;var = MFVarGetByID (++varID));
+	if ((strncmp (header.Tag, MFCheckpointTag, sizeof (header.Tag)) != 0) || (header.Version != MFCheckpointVersion) ||
+	    (header.ItemNum != _MFDomain->ObjNum) || (header.Order != _MFCellOrder) || (header.VarNum != varID - 1)) {
+		CMmsgPrint (CMmsgUsrError,"Checkpoint [%s] does not belong to this model setup!",_MFCheckpointPath);
+		goto Stop;
+	}
+	if ((MFDateCompare (startDate, header.Date) >= 0) || (MFDateCompare (header.Date, endDate) > 0) || !MFDateSetCurrent (header.Date)) {
+		CMmsgPrint (CMmsgUsrError,"Checkpoint date %s is outside the run period!",header.Date);
+		goto Stop;
+	}
+	for (var = MFVarGetByID (varID = 1);var != (MFVariable_p) NULL;var = MFVarGetByID (++varID)) {
+		if (_MFModelCheckpointGet (data, size, &pos, &varRecord, sizeof (varRecord)) == CMfailed) goto Stop;
+		flags = ((var->InStream != (MFDataStream_p) NULL) && (var->InStream->Type != MFConst) ? MFCheckpointInput : 0) |
+		        (var->OutputPath != (char *) NULL ? MFCheckpointOutput : 0);
+		for (aggr = 0; aggr < MFAggrNum; ++aggr) if (var->AggrPath [aggr] != (char *) NULL) flags |= MFCheckpointAggregate << aggr;
+		if ((strncmp (varRecord.Name, var->Name, sizeof (varRecord.Name)) != 0) || ((varRecord.Flags & ~MFCheckpointState) != flags) ||
+		    ((varRecord.Flags & MFCheckpointState) && (varRecord.Type != var->Type))) {
+			CMmsgPrint (CMmsgUsrError,"Checkpoint [%s] does not match variable [%s]!",_MFCheckpointPath,var->Name);
+			goto Stop;
+		}
+		if (varRecord.Flags & MFCheckpointState) {
+			if ((MFVarExpand (var) == CMfailed) ||
+			    (_MFModelCheckpointGet (data, size, &pos, var->Buffer, var->ItemNum * MFVarItemSize (var->Type)) == CMfailed)) goto Stop;
+		}
+		if (varRecord.Flags & MFCheckpointInput) {
+			if (_MFModelCheckpointGet (data, size, &pos, &offset, sizeof (offset)) == CMfailed) goto Stop;
+			MFDataStreamClose (var->InStream);
+			free (var->InStream);
+			if (((var->InStream = _MFModelStreamOpen (var->InputPath, header.Date, "r")) == (MFDataStream_p) NULL) ||
+			    (MFDataStreamSeek (var->InStream, offset) == CMfailed)) goto Stop;
+			strcpy (var->CurDate, "NOT SET");
+			strcpy (var->InDate, header.Date);
+			if (MFdsRecordRead (var) == CMfailed) {
+				CMmsgPrint (CMmsgAppError, "Variable (%s) Reading error!", var->Name);
+				goto Stop;
 			}
-			MFVarSetFloat (varID, objectId, value);
 		}
-	for (iFunc = 0;iFunc < _MFFunctionNum; ++iFunc) (_MFFunctions [iFunc]) (objectId);
+		if (varRecord.Flags & MFCheckpointOutput) {
+			if (_MFModelCheckpointGet (data, size, &pos, &offset, sizeof (offset)) == CMfailed) goto Stop;
+			if (((var->OutStream = _MFModelStreamOpen (var->OutputPath, header.Date, offset < 0 ? "w" : "r+")) == (MFDataStream_p) NULL) ||
+			    (MFDataStreamResume (var->OutStream, offset) == CMfailed)) {
+				CMmsgPrint (CMmsgUsrError,"Variable (%s) output does not match the checkpoint!",var->Name);
+				goto Stop;
+			}
+		}
+		for (aggr = 0; aggr < MFAggrNum; ++aggr) {
+			if ((varRecord.Flags & (MFCheckpointAggregate << aggr)) == 0) continue;
+			if (_MFModelCheckpointGet (data, size, &pos, &offset, sizeof (offset)) == CMfailed) goto Stop;
+			if (((aggregate = var->Aggregate [aggr] = _MFModelAggregateOpen (var, aggr, header.Date, offset < 0 ? "w" : "r+")) == (MFAggregate_p) NULL) ||
+			    (MFDataStreamResume (aggregate->Stream, offset) == CMfailed)) {
+				CMmsgPrint (CMmsgUsrError,"Variable (%s) aggregate does not match the checkpoint!",var->Name);
+				goto Stop;
+			}
+			if ((_MFModelCheckpointGet (data, size, &pos, aggregate->Date,     sizeof (aggregate->Date))   == CMfailed) ||
+			    (_MFModelCheckpointGet (data, size, &pos, &(aggregate->MaxObs), sizeof (int))              == CMfailed) ||
+			    (_MFModelCheckpointGet (data, size, &pos, aggregate->Values, aggregate->ItemNum * sizeof (double)) == CMfailed) ||
+			    (_MFModelCheckpointGet (data, size, &pos, aggregate->ObsNum, aggregate->ItemNum * sizeof (int))    == CMfailed)) goto Stop;
+		}
+	}
+	CMmsgPrint (CMmsgInfo,"Restarting from checkpoint [%s] at %s",_MFCheckpointPath,header.Date);
+	*restarted = true;
+	ret = CMsucceeded;
+Stop:
+	free (data);
+	return (ret);
 }
 
 int MFModelRun (int argc, char *argv [], int argNum, int (*mainDefFunc) ()) {
@@ -377,8 +1339,12 @@ int MFModelRun (int argc, char *argv [], int argNum, int (*mainDefFunc) ()) {
     void *buffer, *status;
 	MFVariable_p var;
 	time_t sec;
-	CMthreadTeam_p team = (CMthreadTeam_p) NULL;
- 	CMthreadJob_p  job  = (CMthreadJob_p)  NULL;
+	CMthreadTeam_p team = (CMthreadTeam_p) NULL, probeTeam = (CMthreadTeam_p) NULL;
+ 	CMthreadJob_p  job  = (CMthreadJob_p)  NULL, localJob = (CMthreadJob_p) NULL;
+	int iFunc, aggr, cycle = 0;
+	bool newYear, newPeriod, spinup, rewound, restarted = false;
+	long long cycleStart = 0;
+	double cycleTime;
     pthread_attr_t thread_attr;
 
 	team = _MFModelParse (argc,argv,argNum, mainDefFunc, &domainFileName, &startDate, &endDate, &testOnly);
@@ -401,17 +1367,32 @@ int MFModelRun (int argc, char *argv [], int argNum, int (*mainDefFunc) ()) {
    if ((bifurFileName = MFOptionGet(MFBifurcationOpt)) != (char *) NULL) {
         if (MFDomainSetBifurcations(_MFDomain, bifurFileName) == CMfailed) { goto Stop; }
     }
+	if (_MFCellOrder != MFDomainOrderFile) {
+		// Cells are renumbered after the bifurcations, which refer to the domain file IDs
+		if (((_MFOrder = MFDomainOrder (_MFDomain, _MFCellOrder)) == (int *) NULL) ||
+		    (MFDomainPermute (_MFDomain, _MFOrder) == CMfailed)) goto Stop;
+		MFDataStreamSetOrder (_MFOrder);
+	}
+	if ((_MFUpstream = MFUpstreamCreate (_MFDomain)) == (MFUpstream_p) NULL) goto Stop;
+	MFDataStreamSetMembers (_MFMemberNum, _MFDomain->ObjNum);
 
 	for (var = MFVarGetByID (varID = 1);var != (MFVariable_p) NULL;var = MFVarGetByID (++varID)) {
-		var->ItemNum = _MFDomain->ObjNum;
+		var->ItemNum = _MFDomain->ObjNum * _MFMemberNum;
         if (var->InputPath != (char *) NULL) {
-            if ((var->InStream = MFDataStreamOpen(var->InputPath, "r")) == (MFDataStream_p) NULL) goto Stop;
+            // Ensemble members share the inputs read from files, held once per cell
+            if ((_MFMemberNum > 1) && (strncmp (var->InputPath, MFconstStr, strlen (MFconstStr)) != 0)) {
+                var->ItemNum = _MFDomain->ObjNum;
+                var->Share   = _MFMemberNum;
+            }
+            if ((var->InStream = _MFModelStreamOpen(var->InputPath, startDate, "r")) == (MFDataStream_p) NULL) goto Stop;
             if (var->Initial) {
                 strcpy (var->InDate, climatologyStr);
                 var->Read = true;
                 if (MFdsRecordRead(var)              == CMfailed) goto Stop;
                 if (MFDataStreamClose(var->InStream) == CMfailed) goto Stop;
+                free (var->InStream);
                 var->InStream   = (MFDataStream_p) NULL;
+                if (_MFModelMemberSpread (var) == CMfailed) goto Stop;
             }
             else {
                 strcpy (var->InDate, startDate);
@@ -438,11 +1419,26 @@ int MFModelRun (int argc, char *argv [], int argNum, int (*mainDefFunc) ()) {
             for (item = 0; item < var->ItemNum; ++item) MFVarSetFloat(var->ID,item,0.0);
         }
         if (var->Flux) snprintf (var->Unit + strlen(var->Unit), sizeof(var->Unit) - strlen(var->Unit), "/%s", MFDateTimeStepUnit(var->TStep));
-        if (var->OutputPath != (char *) NULL) {
-            if ((var->OutStream = MFDataStreamOpen(var->OutputPath,"w")) == (MFDataStream_p) NULL) { goto Stop; }
-        }
 	}
     _MFModelVarPrintOut ("Start date");
+	// Variables the members compute apart have to be written to a file per member
+	for (var = MFVarGetByID (varID = 1);(_MFMemberNum > 1) && (var != (MFVariable_p) NULL);var = MFVarGetByID (++varID)) {
+		if ((var->Share > 1) || var->Broadcast) continue;
+		for (aggr = 0; aggr < MFAggrNum; ++aggr) if (!_MFModelMemberPath (var->AggrPath [aggr])) break;
+		if (!_MFModelMemberPath (var->OutputPath) || !_MFModelMemberPath (var->StatePath) || (aggr < MFAggrNum)) {
+			CMmsgPrint (CMmsgUsrError,"Variable (%s) output needs a per member (%s) file template in ensemble runs!",var->Name,MFmemberStr);
+			goto Stop;
+		}
+	}
+
+	for (var = MFVarGetByID (varID = 1);var != (MFVariable_p) NULL;var = MFVarGetByID (++varID)) {
+		if (!var->Route) continue;
+		if ((_MFRouteVars = (MFVariable_p *) realloc (_MFRouteVars, (_MFRouteVarNum + 1) * sizeof (MFVariable_p))) == (MFVariable_p *) NULL) {
+			CMmsgPrint (CMmsgSysError,"Memory Allocation Error in: %s:%d",__FILE__,__LINE__);
+			goto Stop;
+		}
+		_MFRouteVars [_MFRouteVarNum++] = var;
+	}
 
     if ((job = CMthreadJobCreate(_MFDomain->ObjNum, _MFUserFunc, (void *) NULL)) == (CMthreadJob_p) NULL) {
         CMmsgPrint(CMmsgAppError, "Job creation error in %s:%d", __FILE__, __LINE__);
@@ -455,15 +1451,63 @@ int MFModelRun (int argc, char *argv [], int argNum, int (*mainDefFunc) ()) {
             CMthreadJobTaskDependent(job, taskId, dlinks, _MFDomain->Objects[taskId].DLinkNum);
         }
     }
+    // A restarted run carries on with the outputs of the checkpoint, after any spin-up
+    if (_MFRestart && (_MFModelRestart (startDate, endDate, &restarted) == CMfailed)) goto Stop;
+    if ((spinup = !restarted && (_MFSpinupMax > 0))) {
+        if (_MFModelSpinupTrack () == CMfailed) goto Stop;
+        _MFModelSpinupSnapshot ();
+        cycleStart = _MFModelClock ();
+    }
+    else if (!restarted && (_MFModelOutputOpen (startDate) == CMfailed)) goto Stop;
     time(&sec);
     strcpy (dateCur,  MFDateGetCurrent ());
     strcpy (dateNext, MFDateGetNext ());
     CMmsgPrint (CMmsgInfo, "Model run started at... %s  started at %.24s", dateCur, ctime(&sec));
 
+    if (_MFFlatPhase && (_MFFunctionNum > 0)) {
+        // The first time step runs on a single thread and records the functions that touch routed variables
+        if (((_MFFunctionRouted = (bool *) calloc (_MFFunctionNum, sizeof (bool))) == (bool *) NULL) ||
+            ((probeTeam = CMthreadTeamCreate (1)) == (CMthreadTeam_p) NULL)) {
+            CMmsgPrint(CMmsgSysError, "Memory Allocation Error in: %s:%d", __FILE__, __LINE__);
+            goto Stop;
+        }
+        _MFProbe = true;
+    }
+    if (_MFProfile.Active && (_MFModelProfileStart (team->ThreadNum) == CMfailed)) goto Stop;
     do {
         CMmsgPrint(CMmsgDebug, "Computing: %s", dateCur);
 
-        CMthreadJobExecute (team, job);
+        if (localJob != (CMthreadJob_p) NULL) {
+            // The first step only saw the branches it took: a flat function reaching a routed variable later has
+            // already run out of routing order, so the step cannot be trusted and the run stops before writing it
+            MFVarRouteTrack (true);
+            CMthreadJobExecute (team, localJob);
+            if (MFVarRouteTouched ()) {
+                CMmsgPrint (CMmsgAppError,"Routed variable accessed in the flat phase at %s, rerun with -F off!",dateCur);
+                MFVarRouteTrack (false);
+                ret = CMfailed;
+                goto Stop;
+            }
+            MFVarRouteTrack (false);
+        }
+        CMthreadJobExecute (_MFProbe ? probeTeam : team, job);
+        if (_MFProfile.Active) _MFModelProfileStep (dateCur);
+        if (_MFProbe) {
+            _MFProbe = false;
+            MFVarRouteTrack (false);
+            CMthreadTeamDelete (probeTeam);
+            probeTeam = (CMthreadTeam_p) NULL;
+            for (iFunc = 0; (iFunc < _MFFunctionNum) && (_MFFunctionRouted [iFunc] == false); ++iFunc);
+            if ((iFunc > 0) && ((localJob = CMthreadJobCreate (_MFDomain->ObjNum, _MFLocalUserFunc, (void *) NULL)) == (CMthreadJob_p) NULL)) {
+                CMmsgPrint(CMmsgAppError, "Job creation error in %s:%d", __FILE__, __LINE__);
+                goto Stop;
+            }
+            _MFLocalNum = iFunc;
+            CMmsgPrint (CMmsgDebug, "Flat phase functions: %d of %d", _MFLocalNum, _MFFunctionNum);
+        }
+        newYear = (strncmp (dateCur, dateNext, strlen (MFDateClimatologyYearStr)) != 0) && (MFDateCompare (dateNext, endDate) <= 0);
+        newPeriod = (strncmp (dateCur, dateNext, strlen (_MFCheckpointPeriod == MFAggrMonth ? MFDateClimatologyMonthStr : MFDateClimatologyYearStr)) != 0) &&
+                    (MFDateCompare (dateNext, endDate) <= 0);
         for (var = MFVarGetByID(varID = 1); var != (MFVariable_p) NULL; var = MFVarGetByID(++varID)) {
             strcpy (var->OutDate, dateCur);
             if (var->OutStream != (MFDataStream_p) NULL) {
@@ -472,6 +1516,13 @@ int MFModelRun (int argc, char *argv [], int argNum, int (*mainDefFunc) ()) {
                     goto Stop;
                 }
             }
+            for (aggr = 0; aggr < MFAggrNum; ++aggr)
+                if ((var->Aggregate [aggr] != (MFAggregate_p) NULL) && (MFAggregateUpdate (var, var->Aggregate [aggr]) == CMfailed)) {
+                    CMmsgPrint(CMmsgAppError, "Variable (%s) aggregate writing error!", var->Name);
+                    ret = CMfailed;
+                    goto Stop;
+                }
+            if (newYear && (_MFModelYearSwitch (var, dateCur, dateNext, spinup) == CMfailed)) { ret = CMfailed; goto Stop; }
             if (var->InStream != (MFDataStream_p) NULL) {
                 if ((MFDateCompare(startDate, dateNext) < 0) && (MFDateCompare(dateNext,endDate) <= 0)) {
                     strcpy (var->InDate, dateNext);
@@ -486,27 +1537,89 @@ int MFModelRun (int argc, char *argv [], int argNum, int (*mainDefFunc) ()) {
         strcpy (dateCur,  dateNext);
         MFDateSetCurrent(dateCur);
         strcpy (dateNext, MFDateGetNext ());
-    } while ((MFDateCompare(startDate, dateCur) < 0) && (MFDateCompare (dateCur,endDate) <= 0));
+        rewound = false;
+        if (spinup && !((MFDateCompare(startDate, dateCur) < 0) && (MFDateCompare (dateCur,endDate) <= 0))) {
+            cycle++;
+            if ((_MFModelSpinupChange (cycle) <= _MFSpinupTolerance) || (cycle >= _MFSpinupMax)) {
+                cycleTime = (double) (_MFModelClock () - cycleStart) / 1e9 / (double) cycle;
+                CMmsgPrint (CMmsgInfo, "Spin-up finished after %d of %d cycles, saving %d cycles (%.1f s)",
+                            cycle, _MFSpinupMax, _MFSpinupMax - cycle, (double) (_MFSpinupMax - cycle) * cycleTime);
+                spinup = false;
+                if (_MFModelOutputOpen (startDate) == CMfailed) goto Stop;
+            }
+            else _MFModelSpinupSnapshot ();
+            MFDateSetCurrent (startDate);
+            strcpy (dateCur,  MFDateGetCurrent ());
+            strcpy (dateNext, MFDateGetNext ());
+            if (_MFModelRewind (startDate) == CMfailed) goto Stop;
+            rewound = true;
+        }
+        if ((_MFCheckpointPath != (char *) NULL) && newPeriod && !spinup && !rewound && (_MFModelCheckpointSave (dateCur) == CMfailed)) { ret = CMfailed; goto Stop; }
+    } while (rewound || ((MFDateCompare(startDate, dateCur) < 0) && (MFDateCompare (dateCur,endDate) <= 0)));
 
+	_MFModelCheckpointWait ();
 	for (var = MFVarGetByID (varID = 1);var != (MFVariable_p) NULL;var = MFVarGetByID (++varID)) {
-		if (var->InStream  != (MFDataStream_p) NULL) MFDataStreamClose (var->InStream);
-		if (var->OutStream != (MFDataStream_p) NULL) MFDataStreamClose (var->OutStream);
-        if (var->StatePath != (char *) NULL) {
-            if ((var->OutStream = MFDataStreamOpen (var->StatePath,"w")) == (MFDataStream_p) NULL) ret = CMfailed;
-            strcpy (var->OutDate,dateCur);
-			if (MFdsRecordWrite(var) == CMfailed) {
-                CMmsgPrint (CMmsgAppError,"Variable (%s) writing error!",var->Name);
-                goto Stop;
-            }
-			MFDataStreamClose (var->OutStream);
+		if (var->InStream  != (MFDataStream_p) NULL) { MFDataStreamClose (var->InStream); free (var->InStream); var->InStream = (MFDataStream_p) NULL; }
+		if (var->OutStream != (MFDataStream_p) NULL) {
+			ret = MFDataStreamClose (var->OutStream);
+			free (var->OutStream);
+			var->OutStream = (MFDataStream_p) NULL;
+			if (ret == CMfailed) {
+				CMmsgPrint (CMmsgAppError,"Variable (%s) writing error!",var->Name);
+				goto Stop;
+			}
 		}
+		for (aggr = 0; aggr < MFAggrNum; ++aggr)
+			if (var->Aggregate [aggr] != (MFAggregate_p) NULL) {
+				ret = MFAggregateClose (var->Aggregate [aggr]);
+				var->Aggregate [aggr] = (MFAggregate_p) NULL;
+				if (ret == CMfailed) {
+					CMmsgPrint (CMmsgAppError,"Variable (%s) aggregate writing error!",var->Name);
+					goto Stop;
+				}
+			}
+        if ((var->StatePath != (char *) NULL) && (_MFModelStateWrite (var, endDate, dateCur) == CMfailed)) goto Stop;
 		free (var->Buffer);
+		if (var->Scalar != (void *) NULL) free (var->Scalar);
 	}
+	// The checkpoints of a finished run are of no use
+	if (_MFCheckpointPath != (char *) NULL) unlink (_MFCheckpointPath);
 	ret = CMsucceeded;
 Stop:
+	// Streams are still open only when the run stopped on an error: closing them drains the write-behind queue
+	for (var = MFVarGetByID (varID = 1);var != (MFVariable_p) NULL;var = MFVarGetByID (++varID)) {
+		if (var->InStream  != (MFDataStream_p) NULL) { MFDataStreamClose (var->InStream);  free (var->InStream);  var->InStream  = (MFDataStream_p) NULL; }
+		if (var->OutStream != (MFDataStream_p) NULL) { MFDataStreamClose (var->OutStream); free (var->OutStream); var->OutStream = (MFDataStream_p) NULL; }
+		for (aggr = 0; aggr < MFAggrNum; ++aggr)
+			if (var->Aggregate [aggr] != (MFAggregate_p) NULL) { MFAggregateClose (var->Aggregate [aggr]); var->Aggregate [aggr] = (MFAggregate_p) NULL; }
+	}
     if (job  != (CMthreadJob_p)  NULL) CMthreadJobDestroy (job);
+    if (localJob  != (CMthreadJob_p)  NULL) CMthreadJobDestroy (localJob);
+    if (probeTeam != (CMthreadTeam_p) NULL) CMthreadTeamDelete (probeTeam);
+    if (_MFFunctionRouted != (bool *) NULL) { free (_MFFunctionRouted); _MFFunctionRouted = (bool *) NULL; }
+    if (_MFRouteVars != (MFVariable_p *) NULL) { free (_MFRouteVars); _MFRouteVars = (MFVariable_p *) NULL; _MFRouteVarNum = 0; }
+    if (_MFUpstream  != (MFUpstream_p)  NULL) { MFUpstreamFree (_MFUpstream); _MFUpstream = (MFUpstream_p) NULL; }
+    _MFModelSpinupFree ();
+    _MFModelCheckpointFree ();
+    _MFModelProfilePrint ();
+    _MFModelProfileFree ();
+    if (_MFOrder     != (int *)         NULL) { MFDataStreamSetOrder ((int *) NULL); free (_MFOrder); _MFOrder = (int *) NULL; }
+    MFDataStreamSetMembers (1, 0);
 	if (team != (CMthreadTeam_p) NULL) {
 	    CMthreadTeamPrintReport (CMmsgInfo, team);
+	    if (_MFThreadReport != (char *) NULL) {
+	        size_t len = strlen (_MFThreadReport);
+	        FILE *outFile;
+
+	        if ((outFile = fopen (_MFThreadReport,"w")) == (FILE *) NULL)
+	            CMmsgPrint (CMmsgUsrError,"Thread report [%s] opening error!",_MFThreadReport);
+	        else {
+	            if (CMthreadTeamWriteReport (team, (len > 5) && (strcmp (_MFThreadReport + len - 5,".json") == 0) ?
+	                                         CMthreadReportJSON : CMthreadReportCSV, outFile) == CMfailed)
+	                CMmsgPrint (CMmsgAppError,"Thread report [%s] writing error!",_MFThreadReport);
+	            fclose (outFile);
+	        }
+	    }
     	CMthreadTeamDelete (team);
 	}
 	return (ret);
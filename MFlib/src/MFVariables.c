@@ -15,11 +15,25 @@ bfekete@ccny.cuny.edu
 #include <cm.h>
 #include <MF.h>
 
-static MFVariable_p _MFVariables = (MFVariable_p) NULL;
+static MFVariable_p *_MFVariables = (MFVariable_p *) NULL; // Individually allocated so MFVariable_p handles stay valid
 static int _MFVariableNum = 0;
 
+bool _MFVarRouteTrack = false;
+static bool _MFVarRouteTouched = false;
+
+void MFVarRouteTrack (bool track) {
+	_MFVarRouteTrack   = track;
+	_MFVarRouteTouched = false;
+}
+
+bool MFVarRouteTouched () { return (__atomic_load_n (&_MFVarRouteTouched, __ATOMIC_RELAXED)); }
+
+void _MFVarRouteTouch () { __atomic_store_n (&_MFVarRouteTouched, true, __ATOMIC_RELAXED); }
+
+#define _MFVarRouteCheck(var) if ((var)->Route && _MFVarRouteTrack) _MFVarRouteTouch ()
+
 MFVariable_p MFVarGetByID (int id) {
-	return ((id > 0) && (id <= _MFVariableNum) ? _MFVariables + id - 1: (MFVariable_p) NULL); // TODO assert() !!
+	return ((id > 0) && (id <= _MFVariableNum) ? _MFVariables [id - 1] : (MFVariable_p) NULL); // TODO assert() !!
 }
 
 char *MFVarTypeString (int type) {
@@ -38,13 +52,14 @@ char *MFVarTypeString (int type) {
 }
 
 static MFVariable_p _MFVarNewEntry (const char *name) {
+	int i;
 	MFVariable_p var;
-	_MFVariables = (MFVariable_p) realloc (_MFVariables,(_MFVariableNum + 1) * sizeof (MFVariable_t));
-	if (_MFVariables == (MFVariable_p) NULL) {
+	_MFVariables = (MFVariable_p *) realloc (_MFVariables,(_MFVariableNum + 1) * sizeof (MFVariable_p));
+	if ((_MFVariables == (MFVariable_p *) NULL) || ((var = (MFVariable_p) calloc (1, sizeof (MFVariable_t))) == (MFVariable_p) NULL)) {
 	 	CMmsgPrint (CMmsgSysError,"Error: Memory allocation error in: %s:%d",__FILE__,__LINE__);
 		return ((MFVariable_p) NULL);
 	}
-	var = _MFVariables + _MFVariableNum;
+	_MFVariables [_MFVariableNum] = var;
 	var->ID = _MFVariableNum + 1;
 	strncpy (var->Name,name,sizeof (var->Name) - 1);
 	strcpy  (var->Unit,MFNoUnit);
@@ -54,11 +69,18 @@ static MFVariable_p _MFVarNewEntry (const char *name) {
 	var->ItemNum  = 0;
 	var->Type = MFInput;
 	var->Buffer     = (void *) NULL;
+	var->Scalar     = (void *) NULL;
+	var->Broadcast  = false;
+	var->Share      = 1;
 	var->InputPath  = (char *) NULL;
 	var->OutputPath = (char *) NULL;
 	var->StatePath  = (char *) NULL;
 	var->InStream   = (MFDataStream_p) NULL;
 	var->OutStream  = (MFDataStream_p) NULL;
+	for (i = 0; i < MFAggrNum; ++i) {
+		var->AggrPath  [i] = (char *) NULL;
+		var->Aggregate [i] = (MFAggregate_p) NULL;
+	}
 	var->TStep      = MFTimeStepYear;
     var->NStep      = 1;
 	var->Set        = false;
@@ -73,8 +95,8 @@ static MFVariable_p _MFVarNewEntry (const char *name) {
 static MFVariable_p _MFVarFindEntry (const char *name) {
 	int i;
 
-	for (i = 0;i < _MFVariableNum;++i) if (strcmp (_MFVariables [i].Name,name) == 0) break;
-	if (i < _MFVariableNum) return (_MFVariables + i);
+	for (i = 0;i < _MFVariableNum;++i) if (strcmp (_MFVariables [i]->Name,name) == 0) break;
+	if (i < _MFVariableNum) return (_MFVariables [i]);
 	return ((MFVariable_p) NULL);
 }
 
@@ -130,14 +152,53 @@ int MFVarGetID (char *name,char *unit,int type, bool flux, bool initial) {
 	return (var->ID);
 }
 
-static bool _MFVarTestMissingVal (MFVariable_p var,int itemID)
+static pthread_mutex_t _MFVarExpandMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Storage holding the item: the single item of broadcast const: inputs (read for every cell) or the per-cell buffer,
+// which holds one item per cell for the inputs ensemble members share
+static inline void *_MFVarData (MFVariable_p var, int *itemID) {
+	if (__atomic_load_n (&(var->Broadcast), __ATOMIC_ACQUIRE)) { *itemID = 0; return (var->Scalar); }
+	if (var->Share > 1) *itemID /= var->Share;
+	return (var->Buffer);
+}
+
+// The per-cell buffer is published before the flag is cleared, and the scalar stays allocated, so concurrent
+// readers see either the constant or the filled buffer.
+CMreturn MFVarExpand (MFVariable_p var) {
+	int i;
+	size_t itemSize;
+	void *buffer;
+
+	if (var->Share > 1) {
+		CMmsgPrint (CMmsgAppError,"Error: Input [%s] shared by the ensemble members cannot be written in: %s:%d",var->Name,__FILE__,__LINE__);
+		return (CMfailed);
+	}
+	if (!__atomic_load_n (&(var->Broadcast), __ATOMIC_ACQUIRE)) return (CMsucceeded);
+	pthread_mutex_lock (&_MFVarExpandMutex);
+	if (__atomic_load_n (&(var->Broadcast), __ATOMIC_ACQUIRE)) {
+		itemSize = MFVarItemSize (var->Type);
+		if ((buffer = malloc (var->ItemNum * itemSize)) == (void *) NULL) {
+			pthread_mutex_unlock (&_MFVarExpandMutex);
+			CMmsgPrint (CMmsgSysError,"Memory allocation error in: %s:%d",__FILE__,__LINE__);
+			return (CMfailed);
+		}
+		for (i = 0; i < var->ItemNum; ++i) memcpy ((char *) buffer + i * itemSize, var->Scalar, itemSize);
+		var->Buffer = buffer;
+		__atomic_store_n (&(var->Broadcast), false, __ATOMIC_RELEASE);
+		CMmsgPrint (CMmsgDebug,"Expanding written const: variable [%s]",var->Name);
+	}
+	pthread_mutex_unlock (&_MFVarExpandMutex);
+	return (CMsucceeded);
+}
+
+static bool _MFVarTestMissingVal (MFVariable_p var,const void *data,int itemID)
 	{
 	switch (var->Type) {
-		case MFByte:   return ((int) (((char *)  var->Buffer) [itemID]) == var->Missing.Int);
-		case MFShort:  return ((int) (((short *) var->Buffer) [itemID]) == var->Missing.Int);
-		case MFInt:	   return ((int) (((int *)   var->Buffer) [itemID]) == var->Missing.Int);
-		case MFFloat:  return (CMmathEqualValues ((((float *)  var->Buffer) [itemID]),var->Missing.Float));
-		case MFDouble: return (CMmathEqualValues ((((double *) var->Buffer) [itemID]),var->Missing.Float));
+		case MFByte:   return ((int) (((char *)  data) [itemID]) == var->Missing.Int);
+		case MFShort:  return ((int) (((short *) data) [itemID]) == var->Missing.Int);
+		case MFInt:	   return ((int) (((int *)   data) [itemID]) == var->Missing.Int);
+		case MFFloat:  return (CMmathEqualValues ((((float *)  data) [itemID]),var->Missing.Float));
+		case MFDouble: return (CMmathEqualValues ((((double *) data) [itemID]),var->Missing.Float));
 		default:
 			CMmsgPrint (CMmsgAppError,"Error: Invalid variable [%s,%d] type [%d] in %s:%d",var->Name, itemID, var->Type,__FILE__,__LINE__);
 			break;
@@ -147,27 +208,33 @@ static bool _MFVarTestMissingVal (MFVariable_p var,int itemID)
 
 bool MFVarTestMissingVal (int id,int itemID)
 	{
+	const void *data;
 	MFVariable_p var;
 
 	if ((var = MFVarGetByID (id)) == (MFVariable_p) NULL)  {
 		CMmsgPrint (CMmsgAppError,"Error: Invalid variable [%d] in: %s:%d",id,__FILE__,__LINE__);
 		return (true);
 	}
-	if ((itemID < 0) || (itemID >= var->ItemNum)) {
+
+	if ((itemID < 0) || (itemID >= var->ItemNum * var->Share)) {
 		CMmsgPrint (CMmsgAppError,"Error: Invalid item [%s,%d] in: %s:%d",var->Name,itemID,__FILE__,__LINE__);
 		return (true);
 	}
-	return  (_MFVarTestMissingVal (var,itemID));
+	_MFVarRouteCheck (var);
+	data = _MFVarData (var,&itemID);
+	return  (_MFVarTestMissingVal (var,data,itemID));
 }
 
 void MFVarSetMissingVal (int id, int itemID)
 	{
 	MFVariable_p var;
 
-	if (((var = MFVarGetByID (id)) == (MFVariable_p) NULL) || (itemID < 0) || (itemID >= var->ItemNum)) {
+	if (((var = MFVarGetByID (id)) == (MFVariable_p) NULL) || (itemID < 0) || (itemID >= var->ItemNum * var->Share)) {
 		CMmsgPrint (CMmsgAppError,"Error: Invalid variable [%d,%d] in: %s:%d\n",id,itemID,__FILE__,__LINE__);
 		return;
 	}
+	_MFVarRouteCheck (var);
+	if ((__atomic_load_n (&(var->Broadcast), __ATOMIC_ACQUIRE) || (var->Share > 1)) && (MFVarExpand (var) == CMfailed)) return;
 	switch (var->Type) {
 		case MFByte:	((char *)   var->Buffer) [itemID] = (char)   var->Missing.Int;		break;
 		case MFShort:	((short *)  var->Buffer) [itemID] = (short)  var->Missing.Int;		break;
@@ -183,10 +250,12 @@ void MFVarSetMissingVal (int id, int itemID)
 void MFVarSetFloat (int id,int itemID,double val) {
 	MFVariable_p var;
 
-	if (((var = MFVarGetByID (id)) == (MFVariable_p) NULL) || (itemID < 0) || (itemID >= var->ItemNum)) {
+	if (((var = MFVarGetByID (id)) == (MFVariable_p) NULL) || (itemID < 0) || (itemID >= var->ItemNum * var->Share)) {
 		CMmsgPrint (CMmsgAppError,"Error: Invalid variable [%d,%d] in: MFVarSetFloat ()\n",id,itemID);
 		return;
 	}
+	_MFVarRouteCheck (var);
+	if ((__atomic_load_n (&(var->Broadcast), __ATOMIC_ACQUIRE) || (var->Share > 1)) && (MFVarExpand (var) == CMfailed)) return;
 
 	var->Set = true;
 	if (var->Flux) val = val * (double) var->NStep;
@@ -204,21 +273,24 @@ void MFVarSetFloat (int id,int itemID,double val) {
 
 double MFVarGetFloat (int id,int itemID,double missingVal) {
 	double val;
+	const void *data;
 	MFVariable_p var;
 
-	if (((var = MFVarGetByID (id)) == (MFVariable_p) NULL) || (itemID < 0) || (itemID >= var->ItemNum)) {
+	if (((var = MFVarGetByID (id)) == (MFVariable_p) NULL) || (itemID < 0) || (itemID >= var->ItemNum * var->Share)) {
 		CMmsgPrint (CMmsgAppError,"Error: Invalid variable [%d,%d] in: MFVarGetFloat ()\n",id,itemID);
 		return (MFDefaultMissingFloat);
 	}
+	_MFVarRouteCheck (var);
 	if ((itemID == 0) && (var->Set != true)) CMmsgPrint (CMmsgWarning,"Warning: Unset variable [%s]!\n",var->Name);
-	if (_MFVarTestMissingVal (var,itemID)) return (missingVal);
+	data = _MFVarData (var,&itemID);
+	if (_MFVarTestMissingVal (var,data,itemID)) return (missingVal);
 
 	switch (var->Type) {
-		case MFByte:	val = (double) (((char *)   var->Buffer) [itemID]); break;
-		case MFShort:	val = (double) (((short *)  var->Buffer) [itemID]); break;
-		case MFInt:		val = (double) (((int *)    var->Buffer) [itemID]); break;
-		case MFFloat:	val = (double) (((float *)  var->Buffer) [itemID]); break;
-		case MFDouble:	val = (double) (((double *) var->Buffer) [itemID]); break;
+		case MFByte:	val = (double) (((char *)   data) [itemID]); break;
+		case MFShort:	val = (double) (((short *)  data) [itemID]); break;
+		case MFInt:		val = (double) (((int *)    data) [itemID]); break;
+		case MFFloat:	val = (double) (((float *)  data) [itemID]); break;
+		case MFDouble:	val = (double) (((double *) data) [itemID]); break;
 		default:
 			CMmsgPrint (CMmsgAppError,"Error: Invalid variable [%s,%d] type [%d] in %s:%d\n",var->Name, itemID, var->Type,__FILE__,__LINE__);
 			return (MFDefaultMissingFloat);
@@ -229,10 +301,12 @@ double MFVarGetFloat (int id,int itemID,double missingVal) {
 void MFVarSetInt (int id,int itemID,int val) {
 	MFVariable_p var;
 
-	if (((var = MFVarGetByID (id)) == (MFVariable_p) NULL) || (itemID < 0) || (itemID >= var->ItemNum)) {
+	if (((var = MFVarGetByID (id)) == (MFVariable_p) NULL) || (itemID < 0) || (itemID >= var->ItemNum * var->Share)) {
 		CMmsgPrint (CMmsgAppError,"Error: Invalid variable [%d,%d] in: %s:%d\n",id,itemID,__FILE__,__LINE__);
 		return;
 	}
+	_MFVarRouteCheck (var);
+	if ((__atomic_load_n (&(var->Broadcast), __ATOMIC_ACQUIRE) || (var->Share > 1)) && (MFVarExpand (var) == CMfailed)) return;
 
 	var->Set = true;
 	if (var->Flux) val = val * var->NStep;
@@ -250,22 +324,25 @@ void MFVarSetInt (int id,int itemID,int val) {
 
 int MFVarGetInt (int id,int itemID, int missingVal) {
 	int val;
+	const void *data;
 	MFVariable_p var;
 
-	if (((var = MFVarGetByID (id)) == (MFVariable_p) NULL) || (itemID < 0) || (itemID >= var->ItemNum)) {
+	if (((var = MFVarGetByID (id)) == (MFVariable_p) NULL) || (itemID < 0) || (itemID >= var->ItemNum * var->Share)) {
 		CMmsgPrint (CMmsgAppError,"Error: Invalid variable [%d,%d] in: %s:%d\n",id,itemID,__FILE__,__LINE__);
 		return (MFDefaultMissingInt);
 	}
+	_MFVarRouteCheck (var);
 
 	if (var->Set != true) CMmsgPrint (CMmsgWarning,"Warning: Unset variable %s\n",var->Name);
-	if (_MFVarTestMissingVal (var,itemID)) return (missingVal);
+	data = _MFVarData (var,&itemID);
+	if (_MFVarTestMissingVal (var,data,itemID)) return (missingVal);
 	
 	switch (var->Type) {
-		case MFByte:	val = (int) (((char *)   var->Buffer) [itemID]); break;
-		case MFShort:	val = (int) (((short *)  var->Buffer) [itemID]); break;
-		case MFInt:		val = (int) (((int *)    var->Buffer) [itemID]); break;
-		case MFFloat:	val = (int) (((float *)  var->Buffer) [itemID]); break;
-		case MFDouble:	val = (int) (((double *) var->Buffer) [itemID]); break;
+		case MFByte:	val = (int) (((char *)   data) [itemID]); break;
+		case MFShort:	val = (int) (((short *)  data) [itemID]); break;
+		case MFInt:		val = (int) (((int *)    data) [itemID]); break;
+		case MFFloat:	val = (int) (((float *)  data) [itemID]); break;
+		case MFDouble:	val = (int) (((double *) data) [itemID]); break;
 		default:
 			CMmsgPrint (CMmsgAppError,"Error: Invalid variable [%s,%d] type [%d] in %s:%d\n",var->Name, itemID, var->Type,__FILE__,__LINE__);
 			return (MFDefaultMissingInt);
@@ -273,6 +350,42 @@ int MFVarGetInt (int id,int itemID, int missingVal) {
 	return (var->Flux ? (val / var->NStep) : val);
 }	
 
+float *MFVarGetFloatBuffer (int id) {
+	MFVariable_p var;
+
+	if ((var = MFVarGetByID (id)) == (MFVariable_p) NULL) {
+		CMmsgPrint (CMmsgAppError,"Error: Invalid variable [%d] in: %s:%d",id,__FILE__,__LINE__);
+		return ((float *) NULL);
+	}
+	if (__atomic_load_n (&(var->Broadcast), __ATOMIC_ACQUIRE) && (MFVarExpand (var) == CMfailed)) return ((float *) NULL);
+	if ((var->Type != MFFloat) || (var->Buffer == (void *) NULL) || (var->Share > 1)) {
+		CMmsgPrint (CMmsgAppError,"Error: Variable [%s] has no float buffer (%s) in: %s:%d",var->Name,MFVarTypeString (var->Type),__FILE__,__LINE__);
+		return ((float *) NULL);
+	}
+	_MFVarRouteCheck (var);
+	if (var->Set != true) CMmsgPrint (CMmsgWarning,"Warning: Unset variable [%s]!",var->Name);
+	return ((float *) var->Buffer);
+}
+
+const float *MFVarGetFloatView (int id, size_t *stride) {
+	int itemID = 0;
+	const void *data;
+	MFVariable_p var;
+
+	if ((var = MFVarGetByID (id)) == (MFVariable_p) NULL) {
+		CMmsgPrint (CMmsgAppError,"Error: Invalid variable [%d] in: %s:%d",id,__FILE__,__LINE__);
+		return ((float *) NULL);
+	}
+	if ((var->Type != MFFloat) || (var->Share > 1) || ((data = _MFVarData (var,&itemID)) == (void *) NULL)) {
+		CMmsgPrint (CMmsgAppError,"Error: Variable [%s] has no float buffer (%s) in: %s:%d",var->Name,MFVarTypeString (var->Type),__FILE__,__LINE__);
+		return ((float *) NULL);
+	}
+	_MFVarRouteCheck (var);
+	if (var->Set != true) CMmsgPrint (CMmsgWarning,"Warning: Unset variable [%s]!",var->Name);
+	*stride = data == var->Scalar ? 0 : 1;
+	return ((const float *) data);
+}
+
 size_t MFVarItemSize (int type) {
 	switch (type) {
 		case MFByte:	return (sizeof (char));
@@ -17,10 +17,11 @@ bfekete@ccny.cuny.edu
 
 DBInt RGLibTableJoin(DBObjTable *itemTable, DBObjTableField *relateField,
                      DBObjTable *joinTable, DBObjTableField *joinField) {
-    DBInt itemID, joinID, fieldID, fieldNum = 0;
+    DBInt itemID, fieldID, fieldNum = 0;
     DBObjectLIST<DBObjTableField> *fields = joinTable->Fields();
     DBObjRecord *itemRec, *joinRec;
     DBObjTableField *field, **newFields;
+    DBTableFieldMatchIndex *matchIndex;
 
     if ((newFields = (DBObjTableField **) calloc(1, sizeof(DBObjTableField *))) == (DBObjTableField **) NULL) {
         CMmsgPrint(CMmsgSysError, "Memory Allocation Error in: RGLibTableJoin ()");
@@ -47,42 +48,46 @@ DBInt RGLibTableJoin(DBObjTable *itemTable, DBObjTableField *relateField,
         }
     }
 
+    // The first active join record matching the relate field is looked up in a hash index instead of a scan
+    matchIndex = new DBTableFieldMatchIndex(1, &relateField, &joinField, 1);
+    if (matchIndex->Build(joinTable, true, true) != DBSuccess) {
+        CMmsgPrint(CMmsgAppError, "Join index error in: %s %d", __FILE__, __LINE__);
+        delete matchIndex;
+        free(newFields);
+        return (DBFault);
+    }
     for (itemID = 0; itemID < itemTable->ItemNum(); itemID++) {
         itemRec = itemTable->Item(itemID);
         DBPause(itemID * 100 / itemTable->ItemNum());
         if ((itemRec->Flags() & DBObjectFlagIdle) == DBObjectFlagIdle) continue;
-        for (joinID = 0; joinID < joinTable->ItemNum(); joinID++) {
-            joinRec = joinTable->Item(joinID);
-            if ((joinRec->Flags() & DBObjectFlagIdle) == DBObjectFlagIdle) continue;
-            if (DBTableFieldMatch(relateField, itemRec, joinField, joinRec)) {
-                fieldNum = 0;
-                newFields[fieldNum]->String(itemRec, joinRec->Name());
-                for (fieldID = 0; fieldID < fields->ItemNum(); fieldID++) {
-                    field = fields->Item(fieldID);
-                    if (DBTableFieldIsVisible(field)) {
-                        fieldNum++;
-                        if (newFields[fieldNum]->Required()) continue;
-                        switch (newFields[fieldNum]->Type()) {
-                            default:
-                            case DBTableFieldString:
-                                newFields[fieldNum]->String(itemRec, field->String(joinRec));
-                                break;
-                            case DBTableFieldInt:
-                                newFields[fieldNum]->Int(itemRec, field->Int(joinRec));
-                                break;
-                            case DBTableFieldFloat:
-                                newFields[fieldNum]->Float(itemRec, field->Float(joinRec));
-                                break;
-                            case DBTableFieldDate:
-                                newFields[fieldNum]->Date(itemRec, field->Date(joinRec));
-                                break;
-                        }
+        if ((joinRec = matchIndex->Find(itemRec)) != (DBObjRecord *) NULL) {
+            fieldNum = 0;
+            newFields[fieldNum]->String(itemRec, joinRec->Name());
+            for (fieldID = 0; fieldID < fields->ItemNum(); fieldID++) {
+                field = fields->Item(fieldID);
+                if (DBTableFieldIsVisible(field)) {
+                    fieldNum++;
+                    if (newFields[fieldNum]->Required()) continue;
+                    switch (newFields[fieldNum]->Type()) {
+                        default:
+                        case DBTableFieldString:
+                            newFields[fieldNum]->String(itemRec, field->String(joinRec));
+                            break;
+                        case DBTableFieldInt:
+                            newFields[fieldNum]->Int(itemRec, field->Int(joinRec));
+                            break;
+                        case DBTableFieldFloat:
+                            newFields[fieldNum]->Float(itemRec, field->Float(joinRec));
+                            break;
+                        case DBTableFieldDate:
+                            newFields[fieldNum]->Date(itemRec, field->Date(joinRec));
+                            break;
                     }
                 }
-                break;
             }
         }
     }
+    delete matchIndex;
     free(newFields);
     return (itemID < itemTable->ItemNum() ? DBFault : DBSuccess);
 }
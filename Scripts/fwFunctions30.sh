@@ -10,16 +10,20 @@
 source "${GHAASDIR}/Scripts/RGISfunctions.sh"
 
          _fwCLEANUP="on"
+      _fwCHECKPOINT="off"
      _fwDAILYOUTPUT="off"
 	    _fwFINALRUN="on"
 _fwLENGTHCORRECTION=""
 	   _fwOUTFORMAT="gdbc"
          _fwPASSNUM="5"
+         _fwPROFILE="off"
     _fwOPTIONSPRINT="off"
          _fwMAXPROC="${GHAASprocessorNum}"
+       _fwMULTIYEAR="off"
          _fwRESTART=""
            _fwSTART="TRUE"
 	      _fwSPINUP="on"
+       _fwSPINUPTOL=""
 	    _fwTESTONLY="off"
          _fwVERBOSE="off"
         _fwWARNINGS="on"
@@ -73,6 +77,17 @@ function FwArguments () {
 				shift
 				_fwCLEANUP=${1}
 			;;
+			(-k|--checkpoint)
+				shift
+				case ${1} in
+					(month|year|off)
+						_fwCHECKPOINT="${1}"
+					;;
+					(*)
+						echo "Invalid --checkpoint argument [${1}]"
+					;;
+				esac
+			;;
 			(-D|--dailyoutput)
 				shift
 				case ${1} in
@@ -132,6 +147,17 @@ function FwArguments () {
 			(-O|--optionsprint)
 				_fwOPTIONSPRINT="on"
 			;;
+			(-Y|--multiyear)
+				shift
+				case ${1} in
+					(on|off)
+						_fwMULTIYEAR="${1}"
+					;;
+					(*)
+						echo "Invalid --multiyear argument [${1}]"
+					;;
+				esac
+			;;
 			(-P|--postprocessors)
 				shift
 				if   (( ${1} <= 0 ))
@@ -142,6 +168,17 @@ function FwArguments () {
 					_fwMAXPROC=${1}
 				fi
 			;;
+			(-p|--profile)
+				shift
+				case ${1} in
+					(on|off)
+						_fwPROFILE="${1}"
+					;;
+					(*)
+						echo "Invalid --profile argument [${1}]"
+					;;
+				esac
+			;;
 			(-r|--restart)
 				shift
 				 _fwRESTART="${1}"
@@ -158,6 +195,17 @@ function FwArguments () {
 					;;
 				esac
 			;;
+			(-e|--tolerance)
+				shift
+				case ${1} in
+					(off)
+						_fwSPINUPTOL=""
+					;;
+					(*)
+						_fwSPINUPTOL="${1}"
+					;;
+				esac
+			;;
 			(-T|--testonly)
 				_fwTESTONLY="on"
 			;;
@@ -180,17 +228,21 @@ function FwArguments () {
 				echo "${_fwPROGNAME} [options]"
 				echo"            -C|--cleanup       on|off|<destination directory>"
 				echo "           -D, --dailyoutput  on|off"
+				echo "           -k, --checkpoint   month|year|off"
 				echo "           -f, --finalrun     on|off"
 				echo "           -l, --lengthcorrection [<value>|auto]"
 				echo "           -m, --outputformat [rgis|netcdf]"
 				echo "           -n, --passnum      [num]"
 				echo "           -O, --optionsprint"
 				echo "           -P, --processors   [# of processors]"
+				echo "           -p, --profile      on|off"
 				echo "           -r, --restart      <year>"
 				echo "           -s, --spinup       on|off"
+				echo "           -e, --tolerance    [<relative state change>|off]"
 				echo "           -T, --testonly"
 				echo "           -V, --verbose"
 				echo "           -W, --warnings     on|off"
+				echo "           -Y, --multiyear    on|off"
 				echo "           -h, --help"
 				return 1
 		esac
@@ -512,6 +564,19 @@ function _fwPreprocess () {
 	return 0
 }
 
+function _fwOutputOptions () {
+	local   fwVARIABLE="${1}"; shift
+	local fwExperiment="${1}"; shift
+	local       fwYEAR="${1}"; shift
+	local      fwAMODE="$(_fwVariable "${fwVARIABLE}")"
+
+	[ "${fwAMODE}" == "" ] || fwAMODE="${fwAMODE}:"
+	echo "-M ${fwVARIABLE}=${fwAMODE}file:$(FwGDSFilename "${fwVARIABLE}" "Output" "${fwExperiment}" "${fwYEAR}" "m")"
+	echo "-A ${fwVARIABLE}=${fwAMODE}file:$(FwGDSFilename "${fwVARIABLE}" "Output" "${fwExperiment}" "${fwYEAR}" "a")"
+	[ "${_fwDAILYOUTPUT}" == "on" ] && echo "-o ${fwVARIABLE}=file:$(FwGDSFilename "${fwVARIABLE}" "Output" "${fwExperiment}" "${fwYEAR}" "d")"
+	return 0
+}
+
 function _fwPostprocess () {
     local fwExperiment="${1}"; shift
 	local       fwYEAR="${1}"; shift
@@ -534,19 +599,20 @@ function _fwPostprocess () {
 		local    fwAMODE="$(_fwVariable "${fwVARIABLE}")"
 		[ "${fwAMODE}" == "" ] && { echo "Skipping undefinded variable [${fwVARIABLE}]"; continue; }
 		local fwGDSFileNAME="$(FwGDSFilename "${fwVARIABLE}" "Output" "${fwExperiment}" "${fwYEAR}" "d")"
-		[ -e "${fwGDSFileNAME}" ] || ( echo "Skipping missing variable [${fwVARIABLE}]"; echo ${fwGDSFileNAME}; ) || continue
-
-		(local fwRGISFileNAME="$(FwRGISFilename "${fwVARIABLE}" "${fwExperiment}" "a" "${fwYEAR}")"
+		# Monthly and annual streams are accumulated by the model (see _fwOutputOptions)
+		(local fwGDSFileNAME="$(FwGDSFilename "${fwVARIABLE}" "Output" "${fwExperiment}" "${fwYEAR}" "a")"
+		 [ -e "${fwGDSFileNAME}" ] || { echo "Skipping missing variable [${fwVARIABLE}]"; echo ${fwGDSFileNAME}; exit; }
+		 local fwRGISFileNAME="$(FwRGISFilename "${fwVARIABLE}" "${fwExperiment}" "a" "${fwYEAR}")"
 		 [ -e "${fwRGISFileNAME%/*}" ] || mkdir -p "${fwRGISFileNAME%/*}"
-		 dsAggregate -e year -a ${fwAMODE} "${fwGDSFileNAME}" - |\
 		 ds2rgis -t "${_fwDomainNAME}, ${fwVARIABLE} ${fwExperiment} (${FwDomainRES}, Yearly${fwSUFFIX})" \
-		         -m ${_fwRGISDomainFILE} -d "${_fwDomainNAME}" -u "${fwVARIABLE}"  -s blue - ${fwRGISFileNAME}) &
-		(local fwRGISFileNAME="$(FwRGISFilename "${fwVARIABLE}" "${fwExperiment}" "m" "${fwYEAR}")"
+		         -m ${_fwRGISDomainFILE} -d "${_fwDomainNAME}" -u "${fwVARIABLE}"  -s blue "${fwGDSFileNAME}" ${fwRGISFileNAME}) &
+		(local fwGDSFileNAME="$(FwGDSFilename "${fwVARIABLE}" "Output" "${fwExperiment}" "${fwYEAR}" "m")"
+		 [ -e "${fwGDSFileNAME}" ] || { echo "Skipping missing variable [${fwVARIABLE}]"; echo ${fwGDSFileNAME}; exit; }
+		 local fwRGISFileNAME="$(FwRGISFilename "${fwVARIABLE}" "${fwExperiment}" "m" "${fwYEAR}")"
 		 [ -e "${fwRGISFileNAME%/*}" ] || mkdir -p "${fwRGISFileNAME%/*}"
-		 dsAggregate -e month -a ${fwAMODE} "${fwGDSFileNAME}" - |\
 		 ds2rgis -t "${_fwDomainNAME}, ${fwVARIABLE} ${fwExperiment} (${FwDomainRES}, Monthly${fwSUFFIX})" \
-		         -m ${_fwRGISDomainFILE}  -d "${_fwDomainNAME}" -u "${fwVARIABLE}" -s blue - ${fwRGISFileNAME}) &
-		if [ "${_fwDAILYOUTPUT}" == "on" ]
+		         -m ${_fwRGISDomainFILE}  -d "${_fwDomainNAME}" -u "${fwVARIABLE}" -s blue "${fwGDSFileNAME}" ${fwRGISFileNAME}) &
+		if [[ "${_fwDAILYOUTPUT}" == "on" && -e "${fwGDSFileNAME}" ]]
 		then
 			(local fwRGISFileNAME="$(FwRGISFilename "${fwVARIABLE}" "${fwExperiment}" "d" "${fwYEAR}")"
 			 [ -e "${fwRGISFileNAME%/*}" ] || mkdir -p "${fwRGISFileNAME%/*}"
@@ -556,10 +622,12 @@ function _fwPostprocess () {
 		fi
 	done
 	wait
-	for (( fwI = 0; fwI < ${#_fwOutputARRAY[@]} ; ++fwI ))
+	for (( fwI = 0; fwI < ${#_fwOutputARRAY[@]} * 3 ; ++fwI ))
 	do
-		local fwVARIABLE="${_fwOutputARRAY[${fwI}]}"
-		local fwGDSFileNAME="$(FwGDSFilename "${fwVARIABLE}" "Output" "${fwExperiment}" "${fwYEAR}" "d")"
+		local fwSTEPS=(d m a)
+		local fwVARIABLE="${_fwOutputARRAY[$(( fwI / 3 ))]}"
+		local fwGDSFileNAME="$(FwGDSFilename "${fwVARIABLE}" "Output" "${fwExperiment}" "${fwYEAR}" "${fwSTEPS[$(( fwI % 3 ))]}")"
+		[ -e "${fwGDSFileNAME}" ] || continue
 		case "${_fwCLEANUP}" in
 			("on")
 				[ -e "${fwGDSFileNAME}" ] && rm "${fwGDSFileNAME}" &
@@ -594,10 +662,13 @@ function _fwSpinup () {
 	local fwInputITEM
 	local fwOutputITEM
 	local doState="dostate"
+	local fwFirstPASS=1
 
+	# With a tolerance the model cycles itself and stops early once the states settle
+	[ "${_fwSPINUPTOL}" == "" ] || fwFirstPASS="${_fwPASSNUM}"
 	[ "${_fwVERBOSE}" == "on" ] && echo "Initialization started:  $(date '+%Y-%m-%d %H:%M:%S')"
 	_fwPreprocess ""
-	for ((fwPASS = 1; fwPASS <= _fwPASSNUM; ++fwPASS))
+	for ((fwPASS = fwFirstPASS; fwPASS <= _fwPASSNUM; ++fwPASS))
 	do
 		if   (( fwPASS == 1 ))
 		then
@@ -640,7 +711,8 @@ function _fwSpinup () {
 				echo "-i ${fwSOURCE[0]}=file:$(FwGDSFilename "${fwSOURCE[0]}" "Input" "${fwSOURCE[2]}" "" "d")"
 			fi
 		done
-		if (( fwPASS == 1 ))
+		[ "${_fwSPINUPTOL}" == "" ] || echo "-U $(( _fwPASSNUM - 1 )) -E ${_fwSPINUPTOL}"
+		if (( fwPASS == fwFirstPASS ))
 		then
 			for (( fwI = 0; fwI < ${#_fwStateARRAY[@]} ; ++fwI ))
 			do
@@ -672,7 +744,7 @@ function _fwSpinup () {
 			for (( fwI = 0; fwI < ${#_fwOutputARRAY[@]} ; ++fwI ))
 			do
 				local fwOutputITEM=(${_fwOutputARRAY[${fwI}]})
-				echo "-o ${fwOutputITEM[0]}=file:$(FwGDSFilename "${fwOutputITEM[0]}" "Output" "${fwExperiment}" "" "d")"
+				_fwOutputOptions "${fwOutputITEM[0]}" "${fwExperiment}" ""
 			done
 		fi)
 
@@ -704,13 +776,23 @@ function _fwRun () {
     fi
 	for (( fwYEAR = fwFirstYEAR; fwYEAR <= fwEndYEAR; ++fwYEAR ))
 	do
-		local fwOptionsFILE="${_fwGDSLogDIR}/Run${fwYEAR}_Options.log"
-		local     fwUserLOG="file:${_fwGDSLogDIR}/Run${fwYEAR}_UserError.log"
-		local    fwDebugLOG="file:${_fwGDSLogDIR}/Run${fwYEAR}_Debug.log"
-		local  fwWarningLOG="file:${_fwGDSLogDIR}/Run${fwYEAR}_Warnings.log"
-		local     fwInfoLOG="file:${_fwGDSLogDIR}/Run${fwYEAR}_Info.log"
+		if [ "${_fwMULTIYEAR}" == "on" ]
+		then # A single model run covers the remaining years, switching the per-year files (%Y) at each new year
+			local fwLastYEAR="${fwEndYEAR}"
+			local fwFileYEAR="%Y"
+			local  fwRunNAME="${fwYEAR}-${fwEndYEAR}"
+		else
+			local fwLastYEAR="${fwYEAR}"
+			local fwFileYEAR="${fwYEAR}"
+			local  fwRunNAME="${fwYEAR}"
+		fi
+		local fwOptionsFILE="${_fwGDSLogDIR}/Run${fwRunNAME}_Options.log"
+		local     fwUserLOG="file:${_fwGDSLogDIR}/Run${fwRunNAME}_UserError.log"
+		local    fwDebugLOG="file:${_fwGDSLogDIR}/Run${fwRunNAME}_Debug.log"
+		local  fwWarningLOG="file:${_fwGDSLogDIR}/Run${fwRunNAME}_Warnings.log"
+		local     fwInfoLOG="file:${_fwGDSLogDIR}/Run${fwRunNAME}_Info.log"
 
-		fwOptions=$(echo ${_fwGDSDomainFILE} -s "${fwYEAR}-01-01" -n "${fwYEAR}-12-31"
+		fwOptions=$(echo ${_fwGDSDomainFILE} -s "${fwYEAR}-01-01" -n "${fwLastYEAR}-12-31"
 		echo "-m sys_error=on"
 		echo "-m app_error=on"
 		echo "-m usr_error=${fwUserLOG}"
@@ -718,6 +800,10 @@ function _fwRun () {
 		echo "-m   warning=${fwWarningLOG}"
 		echo "-m      info=${fwInfoLOG}"
 		echo "$(_fwOptionList)"
+		# Rerunning a pre-empted run picks it up from its last checkpoint
+		[ "${_fwCHECKPOINT}" == "off" ] || echo "-K ${_fwGDSLogDIR}/Run${fwRunNAME}_Checkpoint.mfc -k ${_fwCHECKPOINT} -r"
+		# The ranked function timings go to the info log
+		[ "${_fwPROFILE}" == "off" ] || echo "-Y on"
 
 		for (( fwI = 0; fwI < ${#_fwInputARRAY[@]} ; ++fwI ))
 		do
@@ -742,7 +828,7 @@ function _fwRun () {
 				then
 					echo "-i ${fwSOURCE[0]}=const:${fwSOURCE[4]}"
 				else
-					echo "-i ${fwSOURCE[0]}=file:$(FwGDSFilename "${fwSOURCE[0]}" "Input" "${fwSOURCE[2]}" "${fwYEAR}" "d")"
+					echo "-i ${fwSOURCE[0]}=file:$(FwGDSFilename "${fwSOURCE[0]}" "Input" "${fwSOURCE[2]}" "${fwFileYEAR}" "d")"
 				fi
 			fi
 		done
@@ -764,22 +850,29 @@ function _fwRun () {
 		for (( fwI = 0; fwI < ${#_fwStateARRAY[@]} ; ++fwI ))
  		do
 			local fwStateITEM=(${_fwStateARRAY[${fwI}]})
-			echo "-t ${fwStateITEM}=file:$(FwGDSFilename "${fwStateITEM}" "State" "${fwExperiment}" "${fwYEAR}" "d")"
+			echo "-t ${fwStateITEM}=file:$(FwGDSFilename "${fwStateITEM}" "State" "${fwExperiment}" "${fwFileYEAR}" "d")"
 		done
 		for (( fwI = 0; fwI < ${#_fwOutputARRAY[@]} ; ++fwI ))
  		do
 			local fwOutputITEM=${_fwOutputARRAY[${fwI}]}
-			echo "-o ${fwOutputITEM}=file:$(FwGDSFilename "${fwOutputITEM[0]}" "Output" "${fwExperiment}" "${fwYEAR}" "d")"
+			_fwOutputOptions "${fwOutputITEM}" "${fwExperiment}" "${fwFileYEAR}"
  		done)
 
 		echo "${fwOptions}" > ${fwOptionsFILE}
 
-		[ "${_fwVERBOSE}" == "on" ] && echo "   Running year [${fwYEAR}] started:  $(date '+%Y-%m-%d %H:%M:%S')"
-		_fwPreprocess "${fwYEAR}"                 || return 1
+		[ "${_fwVERBOSE}" == "on" ] && echo "   Running year [${fwRunNAME}] started:  $(date '+%Y-%m-%d %H:%M:%S')"
+		for (( fwRunYEAR = fwYEAR; fwRunYEAR <= fwLastYEAR; ++fwRunYEAR ))
+		do
+			_fwPreprocess "${fwRunYEAR}"              || return 1
+		done
         echo ${fwOptions} | xargs ${_fwModelBIN}  || return 1
-		_fwPostprocess "${fwExperiment}" "${fwYEAR}" || return 1
 		local fwInputList=$(echo "${fwOptions}" | grep -e "-i" | grep -e "file:"| grep -e "Input" | sed "s:.*file\:\(.*\):\1:")
-		[ "${fwInputList}" == "" ] || rm -f ${fwInputList}
+		for (( fwRunYEAR = fwYEAR; fwRunYEAR <= fwLastYEAR; ++fwRunYEAR ))
+		do
+			_fwPostprocess "${fwExperiment}" "${fwRunYEAR}" || return 1
+			[ "${fwInputList}" == "" ] || rm -f ${fwInputList//%Y/${fwRunYEAR}}
+		done
+		fwYEAR="${fwLastYEAR}"
 	done
 	[ "${_fwVERBOSE}" == "on" ] && echo "Model run finished: $(date '+%Y-%m-%d %H:%M:%S')"
 	return 0
@@ -29,21 +29,26 @@ static int _MDOutRouting_DischargeIntID = MFUnset;
 static int _MDOutRouting_RiverStorChgID = MFUnset;
 static int _MDOutRouting_RiverStorageID = MFUnset;
 
+static MFVariable_p _MDInCore_RunoffFlow,       _MDInRouting_MuskingumC0,  _MDInRouting_MuskingumC1, _MDInRouting_MuskingumC2;
+static MFVariable_p _MDInRouting_Discharge,     _MDInAux_BankfullDischarge;
+static MFVariable_p _MDOutRouting_FloodPlain,   _MDOutRouting_Discharge0,  _MDOutRouting_Discharge1, _MDOutRouting_DischargeInt;
+static MFVariable_p _MDOutRouting_RiverStorChg, _MDOutRouting_RiverStorage;
+
 static void _MDDischLevel3Muskingum (int itemID) { 
 // Input
-	float C0         = MFVarGetFloat (_MDInRouting_MuskingumC0ID, itemID, 1.0); // Muskingum C0 coefficient (current inflow)
-	float C1         = MFVarGetFloat (_MDInRouting_MuskingumC1ID, itemID, 0.0); // Muskingum C1 coefficient (previous inflow)
-	float C2         = MFVarGetFloat (_MDInRouting_MuskingumC2ID, itemID, 0.0); // MUskingum C2 coefficient (previous outflow) 
-	float runoffFlow = MFVarGetFloat (_MDInCore_RunoffFlowID,     itemID, 0.0); // Runoff flow [m3/s]
-	float bankfullDischarge = MFVarGetFloat(_MDInAux_BankfullDischargeID, itemID, 0.0); // Bankfull Discharge used to cap inflow [m3/s]
+	float C0         = MFVarFastGetFloat (_MDInRouting_MuskingumC0, itemID, 1.0); // Muskingum C0 coefficient (current inflow)
+	float C1         = MFVarFastGetFloat (_MDInRouting_MuskingumC1, itemID, 0.0); // Muskingum C1 coefficient (previous inflow)
+	float C2         = MFVarFastGetFloat (_MDInRouting_MuskingumC2, itemID, 0.0); // MUskingum C2 coefficient (previous outflow) 
+	float runoffFlow = MFVarFastGetFloat (_MDInCore_RunoffFlow,     itemID, 0.0); // Runoff flow [m3/s]
+	float bankfullDischarge = MFVarFastGetFloat (_MDInAux_BankfullDischarge, itemID, 0.0); // Bankfull Discharge used to cap inflow [m3/s]
 // Initial
-	float inDischPrevious = MFVarGetFloat (_MDOutRouting_Discharge0ID,   itemID, 0.0); // Upstream discharge at the previous time step [m3/s]
-	float outDisch        = MFVarGetFloat (_MDOutRouting_Discharge1ID,   itemID, 0.0); // Downstream discharge [m3/s]
-	float storage         = MFVarGetFloat (_MDOutRouting_RiverStorageID, itemID, 0.0); // River Storage [m3]
-	float floodplain = MFVarGetFloat (_MDOutRouting_FloodPlainID, itemID, 0.0); // Floodplain storage [m3]
+	float inDischPrevious = MFVarFastGetFloat (_MDOutRouting_Discharge0,   itemID, 0.0); // Upstream discharge at the previous time step [m3/s]
+	float outDisch        = MFVarFastGetFloat (_MDOutRouting_Discharge1,   itemID, 0.0); // Downstream discharge [m3/s]
+	float storage         = MFVarFastGetFloat (_MDOutRouting_RiverStorage, itemID, 0.0); // River Storage [m3]
+	float floodplain = MFVarFastGetFloat (_MDOutRouting_FloodPlain, itemID, 0.0); // Floodplain storage [m3]
 
 // Route
-	float inDischCurrent  = MFVarGetFloat (_MDInRouting_DischargeID,     itemID, 0.0); // Upstream discharge at the current time step [m3/s]
+	float inDischCurrent  = MFVarFastGetFloat (_MDInRouting_Discharge,     itemID, 0.0); // Upstream discharge at the current time step [m3/s]
 // Output
 	float storageChg;      // River Storage Change [m3]
 // Local
@@ -100,12 +105,12 @@ static void _MDDischLevel3Muskingum (int itemID) {
 
 
 
-	MFVarSetFloat (_MDOutRouting_Discharge0ID,   itemID, inDischCurrent);
-	MFVarSetFloat (_MDOutRouting_Discharge1ID,   itemID, outDisch);
-	MFVarSetFloat (_MDOutRouting_DischargeIntID, itemID, outDisch);
-	MFVarSetFloat (_MDOutRouting_RiverStorChgID, itemID, storageChg);
-	MFVarSetFloat (_MDOutRouting_RiverStorageID, itemID, storage);
-	MFVarSetFloat (_MDOutRouting_FloodPlainID,   itemID, floodplain);
+	MFVarFastSetFloat (_MDOutRouting_Discharge0,   itemID, inDischCurrent);
+	MFVarFastSetFloat (_MDOutRouting_Discharge1,   itemID, outDisch);
+	MFVarFastSetFloat (_MDOutRouting_DischargeInt, itemID, outDisch);
+	MFVarFastSetFloat (_MDOutRouting_RiverStorChg, itemID, storageChg);
+	MFVarFastSetFloat (_MDOutRouting_RiverStorage, itemID, storage);
+	MFVarFastSetFloat (_MDOutRouting_FloodPlain,   itemID, floodplain);
 }
 
 int MDRouting_ChannelDischargeMuskingumDef () {
@@ -126,6 +131,18 @@ int MDRouting_ChannelDischargeMuskingumDef () {
         ((_MDOutRouting_RiverStorageID = MFVarGetID (MDVarRouting_RiverStorage,    "m3",     MFOutput, MFState, MFInitial))  == CMfailed) ||
         ((_MDOutRouting_DischargeIntID = MFVarGetID ("__DischargeInternal",        "m3/s",   MFOutput, MFState, MFBoundary)) == CMfailed) ||
         (MFModelAddFunction(_MDDischLevel3Muskingum) == CMfailed)) return (CMfailed);
+	_MDInCore_RunoffFlow        = MFVarGetByID (_MDInCore_RunoffFlowID);
+	_MDInRouting_MuskingumC0    = MFVarGetByID (_MDInRouting_MuskingumC0ID);
+	_MDInRouting_MuskingumC1    = MFVarGetByID (_MDInRouting_MuskingumC1ID);
+	_MDInRouting_MuskingumC2    = MFVarGetByID (_MDInRouting_MuskingumC2ID);
+	_MDInRouting_Discharge      = MFVarGetByID (_MDInRouting_DischargeID);
+	_MDInAux_BankfullDischarge  = MFVarGetByID (_MDInAux_BankfullDischargeID);
+	_MDOutRouting_FloodPlain    = MFVarGetByID (_MDOutRouting_FloodPlainID);
+	_MDOutRouting_Discharge0    = MFVarGetByID (_MDOutRouting_Discharge0ID);
+	_MDOutRouting_Discharge1    = MFVarGetByID (_MDOutRouting_Discharge1ID);
+	_MDOutRouting_DischargeInt  = MFVarGetByID (_MDOutRouting_DischargeIntID);
+	_MDOutRouting_RiverStorChg  = MFVarGetByID (_MDOutRouting_RiverStorChgID);
+	_MDOutRouting_RiverStorage  = MFVarGetByID (_MDOutRouting_RiverStorageID);
 
 	MFDefLeaving ("Discharge Routing - Muskingum");
 	return (_MDOutRouting_DischargeIntID);
@@ -0,0 +1,59 @@
+#include <string.h>
+#include <time.h>
+#include <DB.hpp>
+
+static double _Clock () {
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ((double) ts.tv_sec + (double) ts.tv_nsec / 1e9);
+}
+
+// Name lookup the way DBObjectLIST::Item(name) did it before the name index
+static DBObjRecord *_ScanItem (DBObjTable *table, const char *name) {
+    DBInt rowID;
+
+    for (rowID = 0; rowID < table->ItemNum(); ++rowID)
+        if (strcmp(table->Item(rowID)->Name(), name) == 0) return (table->Item(rowID));
+    return ((DBObjRecord *) NULL);
+}
+
+int main(int argv, char *argc[]) {
+    int ret, yearNum = 20, startYear = 1990, loopNum = 1, year, month, day, dayNum, loop;
+    int monthDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    char name[DBStringLength];
+    DBInt rowID, mismatch = 0;
+    double start, scanTime, indexTime;
+    DBObjTable *layers;
+
+    if ((argv > 1) && (sscanf(argc[1], "%d", &ret) == 1)) yearNum = ret > 0 ? ret : 1;
+    if ((argv > 2) && (sscanf(argc[2], "%d", &ret) == 1)) startYear = ret;
+    if ((argv > 3) && (sscanf(argc[3], "%d", &ret) == 1)) loopNum = ret > 0 ? ret : 1;
+
+    // Daily layer table named by date, as grdDateLayers leaves it
+    layers = new DBObjTable("Layers");
+    for (year = startYear; year < startYear + yearNum; ++year)
+        for (month = 0; month < 12; ++month) {
+            dayNum = monthDays[month] + ((month == 1) && ((year % 4) == 0) && (((year % 100) != 0) || ((year % 400) == 0)) ? 1 : 0);
+            for (day = 1; day <= dayNum; ++day) {
+                snprintf(name, sizeof(name), "%04d-%02d-%02d", year, month + 1, day);
+                layers->Add(name);
+            }
+        }
+    printf("%d %d %d records %d\n", yearNum, startYear, loopNum, (int) layers->ItemNum());
+
+    // Every layer looked up by its name once per loop, first by the linear scan then through the index
+    start = _Clock();
+    for (loop = 0; loop < loopNum; ++loop)
+        for (rowID = 0; rowID < layers->ItemNum(); ++rowID)
+            if (_ScanItem(layers, layers->Item(rowID)->Name()) != layers->Item(rowID)) mismatch++;
+    scanTime = _Clock() - start;
+    start = _Clock();
+    for (loop = 0; loop < loopNum; ++loop)
+        for (rowID = 0; rowID < layers->ItemNum(); ++rowID)
+            if (layers->Item(layers->Item(rowID)->Name()) != layers->Item(rowID)) mismatch++;
+    indexTime = _Clock() - start;
+    printf("Scan %.4fs Index %.4fs Mismatches %d\n", scanTime, indexTime, (int) mismatch);
+    delete layers;
+    return (mismatch > 0 ? 1 : 0);
+}
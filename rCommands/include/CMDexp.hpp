@@ -18,6 +18,7 @@ private:
         DBObjTableField *FieldPTR;
     } Var;
     DBMathOperand *Operand;
+    DBMathProgram Program;
     DBObjTable *TablePTR;
 public:
     CMDExpression(char *fieldName, char *expression, DBInt tmpVar) {
@@ -35,6 +36,7 @@ public:
     DBInt Expand(DBObjectLIST<DBObject> *variables) { return (Operand->Expand(variables)); }
 
     DBInt Configure(DBObjTable *table) {
+        DBInt type;
         DBObjTableField *fieldPTR;
         TablePTR = table;
         if ((fieldPTR = table->Field(Var.NamePTR)) == (DBObjTableField *) NULL) {
@@ -54,19 +56,21 @@ public:
             }
         }
         Var.FieldPTR = fieldPTR;
-        return (Operand->Configure(table->Fields()));
+        if ((type = Operand->Configure(table->Fields())) == DBFault) return (DBFault);
+        Program.Compile(Operand, fieldPTR->Type());
+        return (type);
     }
 
     void Evaluate(DBObjRecord *record) {
         switch (Var.FieldPTR->Type()) {
             case DBVariableString:
-                Var.FieldPTR->String(record, Operand->String(record));
+                Var.FieldPTR->String(record, Program.Mode() != DBFault ? Program.String(record) : Operand->String(record));
                 break;
             case DBVariableInt:
-                Var.FieldPTR->Int(record, Operand->Int(record));
+                Var.FieldPTR->Int(record, Program.Mode() != DBFault ? Program.Int(record) : Operand->Int(record));
                 break;
             case DBVariableFloat:
-                Var.FieldPTR->Float(record, Operand->Float(record));
+                Var.FieldPTR->Float(record, Program.Mode() != DBFault ? Program.Float(record) : Operand->Float(record));
                 break;
         }
     }
@@ -13,6 +13,7 @@ bfekete@ccny.cuny.edu
 #include <cm.h>
 #include <DB.hpp>
 #include <RG.hpp>
+#include <MF.h>
 
 static void _CMDprintUsage (const char *arg0) {
     CMmsgPrint(CMmsgInfo, "%s [options] <data stream file> <rgis file>", CMfileName(arg0));
@@ -22,15 +23,41 @@ static void _CMDprintUsage (const char *arg0) {
     CMmsgPrint(CMmsgInfo, "     -d, --domain    [domain]");
     CMmsgPrint(CMmsgInfo, "     -v, --version   [version]");
     CMmsgPrint(CMmsgInfo, "     -s, --shadeset  [standard|grey|blue|blue-to-red|elevation]");
+    CMmsgPrint(CMmsgInfo, "     -b, --begin     [start date in the form of \"yyyy-mm-dd\"]");
     CMmsgPrint(CMmsgInfo, "     -h, --help");
 }
 
+// Positions the data stream at its first record that is not before the start date, through the date index when the
+// file has one, otherwise by skipping records and stepping back over the header of the first one kept.
+static DBInt _CMDdsBegin (FILE *inFile, const char *fileName, const char *begin) {
+    MFdsHeader_t header;
+    MFdsIndex_p index;
+
+    if ((fileName != (char *) NULL) && ((index = MFdsIndexLoad(fileName)) != (MFdsIndex_p) NULL)) {
+        if (MFdsIndexSeek(index, inFile, begin) == CMfailed) CMmsgPrint(CMmsgWarning, "Ignoring mismatching date index!");
+        MFdsIndexFree(index);
+    }
+    while (MFdsHeaderRead(&header, inFile) == CMsucceeded) {
+        if (MFDateCompare(header.Date, begin) >= 0) {
+            if (fseeko(inFile, -((off_t) sizeof(MFdsHeader_t)), SEEK_CUR) == 0) return (DBSuccess);
+            CMmsgPrint(CMmsgUsrError, "Start date requires a seekable data stream!");
+            return (DBFault);
+        }
+        if (MFdsRecordSkip(&header, inFile) == CMfailed) {
+            CMmsgPrint(CMmsgSysError, "Input data stream reading error in: %s %d", __FILE__, __LINE__);
+            return (DBFault);
+        }
+    }
+    return (DBSuccess);
+}
+
 int main(int argc, char *argv[]) {
     FILE *inFile;
     int argPos, argNum = argc, ret;
     char *title   = (char *) NULL, *subject = (char *) NULL;
     char *domain  = (char *) NULL, *version = (char *) NULL;
     char *tmpName = (char *) NULL;
+    const char *begin = (char *) NULL;
     DBInt shadeSet = DBFault;
     DBObjData *outData, *tmpData = (DBObjData *) NULL;
 
@@ -102,6 +129,15 @@ int main(int argc, char *argv[]) {
             if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
             continue;
         }
+        if (CMargTest (argv[argPos], "-b", "--begin")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing start date!");
+                return (CMfailed);
+            }
+            begin = argv[argPos];
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
 Help:   if (CMargTest (argv[argPos], "-h", "--help")) {
             _CMDprintUsage (argv[0]);
             return (DBSuccess);
@@ -129,6 +165,10 @@ Help:   if (CMargTest (argv[argPos], "-h", "--help")) {
         CMmsgPrint(CMmsgSysError, "Input data stream opening error in: %s %d", __FILE__, __LINE__);
         return (DBFault);
     }
+    if ((begin != (char *) NULL) && (_CMDdsBegin(inFile, inFile != stdin ? argv[1] : (char *) NULL, begin) == DBFault)) {
+        if (inFile != stdin) fclose(inFile);
+        return (DBFault);
+    }
 
     tmpData = new DBObjData();
     if (tmpData->Read(tmpName) == DBFault) {
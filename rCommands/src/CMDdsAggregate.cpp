@@ -19,6 +19,7 @@ static void _CMDprintUsage (const char *arg0) {
     CMmsgPrint(CMmsgUsrError, "%s [options] <in datastream> <out datastream>", CMfileName(arg0));
     CMmsgPrint(CMmsgUsrError, "  -e, --step [day|month|year]");
     CMmsgPrint(CMmsgUsrError, "  -a, --aggregate [avg|sum]");
+    CMmsgPrint(CMmsgUsrError, "  -b, --begin [start date in the form of \"yyyy-mm-dd\"]");
     CMmsgPrint(CMmsgUsrError, "  -h, --help");
 }
 
@@ -33,6 +34,8 @@ int main(int argc, char *argv[]) {
     double *array = (double *) NULL;
     float *record = (float *) NULL;
     int *obsNum = (int *) NULL, maxObs = 0;
+    const char *begin = (char *) NULL;
+    MFdsIndex_p index;
 
     if (argNum < 2) goto Help;
     date[0] = '\0';
@@ -72,6 +75,15 @@ int main(int argc, char *argv[]) {
             if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
             continue;
         }
+        if (CMargTest(argv[argPos], "-b", "--begin")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing start date!");
+                break;
+            }
+            begin = argv[argPos];
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
         Help:
         if (CMargTest(argv[argPos], "-h", "--help")) {
             if ((argNum = CMargShiftLeft(argPos, argv, argNum)) < argPos) break;
@@ -100,7 +112,18 @@ int main(int argc, char *argv[]) {
         goto Stop;
     }
 
+    if ((begin != (char *) NULL) && (inFile != stdin) && ((index = MFdsIndexLoad(argv[1])) != (MFdsIndex_p) NULL)) {
+        if (MFdsIndexSeek(index, inFile, begin) == CMfailed) CMmsgPrint(CMmsgWarning, "Ignoring mismatching date index!");
+        MFdsIndexFree(index);
+    }
     while (MFdsHeaderRead(&header, inFile) == CMsucceeded) {
+        if ((begin != (char *) NULL) && (MFDateCompare(header.Date, begin) < 0)) {
+            if (MFdsRecordSkip(&header, inFile) == CMfailed) {
+                CMmsgPrint(CMmsgSysError, "Input reading error in: %s:%d", __FILE__, __LINE__);
+                goto Stop;
+            }
+            continue;
+        }
         if (items == (void *) NULL) {
             itemSize = MFVarItemSize(header.Type);
             if ((items = (void *) calloc(header.ItemNum, itemSize)) == (void *) NULL) {
@@ -18,15 +18,159 @@ bfekete@ccny.cuny.edu
 
 static void _CMDprintUsage (const char *arg0) {
     CMmsgPrint(CMmsgUsrError, "%s [options] <out datastream>", CMfileName(arg0));
-    CMmsgPrint(CMmsgUsrError, "  -i, --input [input datastream]");
-    CMmsgPrint(CMmsgUsrError, "  -b, --bins  [# of bins]");
-    CMmsgPrint(CMmsgUsrError, "  -m, --mode  [percent|value]");
+    CMmsgPrint(CMmsgUsrError, "  -i, --input  [input datastream|pipe:command|-]");
+    CMmsgPrint(CMmsgUsrError, "  -b, --bins   [# of bins]");
+    CMmsgPrint(CMmsgUsrError, "  -m, --mode   [percent|value]");
+    CMmsgPrint(CMmsgUsrError, "  -s, --sketch");
+    CMmsgPrint(CMmsgUsrError, "  -e, --error  [relative error]");
     CMmsgPrint(CMmsgUsrError, "  -h, --help");
 }
 
+/* Single pass duration curves keep a logarithmic histogram per item (the DDSketch layout): bucket k holds the values
+ * in (gamma^(k-1), gamma^k] with gamma = (1 + error) / (1 - error), so every percentile is returned within the
+ * relative error.  Positive and negative values have separate stores and zeros a counter of their own.  A store
+ * never grows past the bin number; when an item spans a wider range its smallest magnitudes are merged. */
+
+#define _CMDsketchMinValue 1.0e-30
+
+typedef struct _CMDsketchStore_s {
+    int MinKey, KeyNum;
+    unsigned int *Counts;
+} _CMDsketchStore_t;
+
+typedef struct _CMDsketch_s {
+    _CMDsketchStore_t Positive, Negative;
+    unsigned int Zero, Count;
+    double Min, Max;
+} _CMDsketch_t;
+
+static double _CMDsketchLogGamma = 0.0;
+static int _CMDsketchMaxKeys = 1000;
+
+static int _CMDsketchKey (double value) { return ((int) ceil (log (value) / _CMDsketchLogGamma)); }
+
+static double _CMDsketchValue (int key) {
+    return (2.0 * exp ((double) key * _CMDsketchLogGamma) / (1.0 + exp (_CMDsketchLogGamma)));
+}
+
+static CMreturn _CMDsketchStoreAdd (_CMDsketchStore_t *store, int key) {
+    int minKey, maxKey, k;
+    unsigned int *counts;
+
+    if ((store->KeyNum == 0) || (key < store->MinKey) || (key >= store->MinKey + store->KeyNum)) {
+        minKey = (store->KeyNum == 0) || (key < store->MinKey) ? key : store->MinKey;
+        maxKey = (store->KeyNum == 0) || (key >= store->MinKey + store->KeyNum) ? key : store->MinKey + store->KeyNum - 1;
+        if (maxKey - minKey + 1 > _CMDsketchMaxKeys) minKey = maxKey - _CMDsketchMaxKeys + 1;
+        if ((counts = (unsigned int *) calloc (maxKey - minKey + 1, sizeof (unsigned int))) == (unsigned int *) NULL) {
+            CMmsgPrint (CMmsgSysError, "Memory allocation error in: %s:%d", __FILE__, __LINE__);
+            return (CMfailed);
+        }
+        // Buckets falling below the new minimum are merged into it
+        for (k = 0; k < store->KeyNum; ++k)
+            counts [(store->MinKey + k > minKey ? store->MinKey + k : minKey) - minKey] += store->Counts [k];
+        if (store->Counts != (unsigned int *) NULL) free (store->Counts);
+        store->Counts = counts;
+        store->MinKey = minKey;
+        store->KeyNum = maxKey - minKey + 1;
+    }
+    store->Counts [(key > store->MinKey ? key : store->MinKey) - store->MinKey] += 1;
+    return (CMsucceeded);
+}
+
+static CMreturn _CMDsketchAdd (_CMDsketch_t *sketch, double value) {
+    if (sketch->Min > value) sketch->Min = value;
+    if (sketch->Max < value) sketch->Max = value;
+    sketch->Count++;
+    if (value > _CMDsketchMinValue)  return (_CMDsketchStoreAdd (&(sketch->Positive), _CMDsketchKey ( value)));
+    if (value < -_CMDsketchMinValue) return (_CMDsketchStoreAdd (&(sketch->Negative), _CMDsketchKey (-value)));
+    sketch->Zero++;
+    return (CMsucceeded);
+}
+
+// Value exceeded by the given percent of the samples
+static double _CMDsketchPercentile (const _CMDsketch_t *sketch, double percent) {
+    double rank = (1.0 - percent / 100.0) * (double) (sketch->Count - 1), value = sketch->Max, cumulative = 0.0;
+    int k;
+
+    for (k = sketch->Negative.KeyNum - 1; k >= 0; --k)
+        if ((cumulative += sketch->Negative.Counts [k]) > rank) { value = -_CMDsketchValue (sketch->Negative.MinKey + k); goto Clamp; }
+    if ((cumulative += sketch->Zero) > rank) { value = 0.0; goto Clamp; }
+    for (k = 0; k < sketch->Positive.KeyNum; ++k)
+        if ((cumulative += sketch->Positive.Counts [k]) > rank) { value = _CMDsketchValue (sketch->Positive.MinKey + k); goto Clamp; }
+Clamp:
+    return (value < sketch->Min ? sketch->Min : (value > sketch->Max ? sketch->Max : value));
+}
+
+// Turns the bucket counts into the number of samples below each bucket (only exceedance queries work afterwards)
+static void _CMDsketchCumulate (_CMDsketch_t *sketch) {
+    unsigned int below = 0, count;
+    int k;
+
+    for (k = sketch->Negative.KeyNum - 1; k >= 0; --k) {
+        count = sketch->Negative.Counts [k];
+        sketch->Negative.Counts [k] = below;
+        below += count;
+    }
+    below += sketch->Zero;
+    sketch->Zero = below - sketch->Zero;
+    for (k = 0; k < sketch->Positive.KeyNum; ++k) {
+        count = sketch->Positive.Counts [k];
+        sketch->Positive.Counts [k] = below;
+        below += count;
+    }
+}
+
+// Percent of the samples falling into the bucket of value or above (after _CMDsketchCumulate)
+static double _CMDsketchExceedance (const _CMDsketch_t *sketch, double value) {
+    const _CMDsketchStore_t *store;
+    unsigned int below;
+    int key;
+
+    if ((value > _CMDsketchMinValue) || (value < -_CMDsketchMinValue)) {
+        store = value > 0.0 ? &(sketch->Positive) : &(sketch->Negative);
+        key = _CMDsketchKey (fabs (value)) - store->MinKey;
+        key = key < 0 ? 0 : (key < store->KeyNum ? key : store->KeyNum - 1);
+        below = store->Counts [key];
+    }
+    else below = sketch->Zero;
+    return (100.0 * (double) (sketch->Count - below) / (double) sketch->Count);
+}
+
+static bool _CMDitemValue (const MFdsHeader_t *header, void *items, int i, double *value) {
+    switch (header->Type) {
+        case MFByte:
+            if (((char *) items)[i] == header->Missing.Int) return (false);
+            *value = (double) (((char *) items)[i]);
+            return (true);
+        case MFShort:
+            if (header->Swap != 1) MFSwapHalfWord(((short *) items) + i);
+            if (((short *) items)[i] == header->Missing.Int) return (false);
+            *value = (double) (((short *) items)[i]);
+            return (true);
+        case MFInt:
+            if (header->Swap != 1) MFSwapWord(((int *) items) + i);
+            if (((int *) items)[i] == header->Missing.Int) return (false);
+            *value = (double) (((int *) items)[i]);
+            return (true);
+        case MFFloat:
+            if (header->Swap != 1) MFSwapWord(((float *) items) + i);
+            if (CMmathEqualValues(((float *) items)[i], header->Missing.Float) == true) return (false);
+            *value = (double) (((float *) items)[i]);
+            return (true);
+        case MFDouble:
+            if (header->Swap != 1) MFSwapLongWord(((double *) items) + i);
+            if (CMmathEqualValues(((double *) items)[i], header->Missing.Float) == true) return (false);
+            *value = (double) (((double *) items)[i]);
+            return (true);
+    }
+    return (false);
+}
+
 int main(int argc, char *argv[]) {
-    int argPos, argNum = argc, ret = CMfailed, itemSize, i, bin, binNum = 1000, percent;
-    bool valueMode = false;
+    int argPos, argNum = argc, ret = CMfailed, itemSize, i, bin, binNum = 1000, percent, itemNum = 0;
+    bool valueMode = false, sketchMode = false, inPipe = false;
+    double error = 0.01;
+    _CMDsketch_t *sketches = (_CMDsketch_t *) NULL;
     FILE *inFile = (FILE *) NULL, *outFile = stdout;
     char *fileName = (char *) NULL;
     void *items = (void *) NULL;
@@ -55,6 +199,21 @@ int main(int argc, char *argv[]) {
             if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
             continue;
         }
+        if (CMargTest(argv[argPos], "-s", "--sketch")) {
+            sketchMode = true;
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
+        if (CMargTest(argv[argPos], "-e", "--error")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            if ((sscanf(argv[argPos], "%lf", &error) != 1) || (error <= 0.0) || (error >= 1.0)) {
+                CMmsgPrint(CMmsgUsrError, "Ilformed relative error!");
+                goto Stop;
+            }
+            sketchMode = true;
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
         if (CMargTest (argv[argPos], "-m", "--mode")) {
             int mode;
             const char *modes[] = {"percent", "value", (char *) NULL};
@@ -88,17 +247,95 @@ Help:   if (CMargTest(argv[argPos], "-h", "--help")) {
         goto Stop;
     }
 
-    if (fileName == (char *) NULL) {
-        CMmsgPrint(CMmsgUsrError, "Missing input file!");
-        _CMDprintUsage (argv[0]);
+    if ((fileName == (char *) NULL) || (strcmp(fileName, "-") == 0)) inFile = stdin;
+    else if (strncmp(fileName, "pipe:", 5) == 0) {
+        inFile = popen(fileName + 5, "r");
+        inPipe = true;
+    }
+    else inFile = fopen(fileName, "r");
+    if (inFile == (FILE *) NULL) {
+        CMmsgPrint(CMmsgSysError, "Input file opening error in: %s %d", __FILE__, __LINE__);
         goto Stop;
     }
-    if ((outFile = (argNum > 2) && (strcmp(argv[1], "-") != 0) ? fopen(argv[1], "w") : stdout) == (FILE *) NULL) {
+    if ((inFile == stdin) || inPipe) {
+        if (sketchMode == false) {
+            CMmsgPrint(CMmsgUsrError, "Reading from a pipe or standard input requires the single pass sketch (-s)!");
+            goto Stop;
+        }
+        if (valueMode == false) {
+            CMmsgPrint(CMmsgUsrError, "Percent mode reads the input twice, use value mode or a file input!");
+            goto Stop;
+        }
+    }
+    if ((outFile = (argNum > 1) && (strcmp(argv[1], "-") != 0) ? fopen(argv[1], "w") : stdout) == (FILE *) NULL) {
         CMmsgPrint(CMmsgSysError, "Output file opening error in: %s %d", __FILE__, __LINE__);
         goto Stop;
     }
-    if ((inFile = fopen(fileName, "r")) == (FILE *) NULL) {
-        CMmsgPrint(CMmsgSysError, "Input file opening error in: %s %d", __FILE__, __LINE__);
+
+    if (sketchMode) {
+        _CMDsketchLogGamma = log((1.0 + error) / (1.0 - error));
+        _CMDsketchMaxKeys  = binNum > 1 ? binNum : 2;
+        while (MFdsHeaderRead(&header, inFile) == CMsucceeded) {
+            if (items == (void *) NULL) {
+                itemSize = MFVarItemSize(header.Type);
+                itemNum  = header.ItemNum;
+                if (((items    = (void *) calloc(itemNum, itemSize)) == (void *) NULL) ||
+                    ((output   = (float *) calloc(itemNum, sizeof(float))) == (float *) NULL) ||
+                    ((sketches = (_CMDsketch_t *) calloc(itemNum, sizeof(_CMDsketch_t))) == (_CMDsketch_t *) NULL)) {
+                    CMmsgPrint(CMmsgSysError, "Memory allocation error in: %s:%d", __FILE__, __LINE__);
+                    goto Stop;
+                }
+                for (i = 0; i < itemNum; i++) {
+                    sketches[i].Min =  HUGE_VAL;
+                    sketches[i].Max = -HUGE_VAL;
+                }
+                outHeader.Swap = 1;
+                outHeader.Type = MFFloat;
+                outHeader.ItemNum = itemNum;
+                outHeader.Missing.Float = MFDefaultMissingFloat;
+            }
+            if ((header.ItemNum != itemNum) || ((int) fread(items, itemSize, itemNum, inFile) != itemNum)) {
+                CMmsgPrint(CMmsgSysError, "Input reading error in: %s:%d", __FILE__, __LINE__);
+                goto Stop;
+            }
+            for (i = 0; i < itemNum; i++)
+                if (_CMDitemValue(&header, items, i, &value) && (_CMDsketchAdd(sketches + i, value) != CMsucceeded)) goto Stop;
+        }
+        if (ferror (inFile) != 0) {
+            CMmsgPrint(CMmsgSysError, "Input file reading error in: %s %d", __FILE__, __LINE__);
+            goto Stop;
+        }
+        if (valueMode) {
+            for (percent = 0; percent < 100; ++percent) {
+                for (i = 0; i < itemNum; i++)
+                    output[i] = sketches[i].Count > 0 ? _CMDsketchPercentile(sketches + i, (double) percent) : outHeader.Missing.Float;
+                snprintf(outHeader.Date, sizeof(outHeader.Date), "%3d", percent + 1);
+                if ((MFdsHeaderWrite (&outHeader, outFile) != CMsucceeded) ||
+                    ((int) fwrite(output, sizeof(float), outHeader.ItemNum, outFile) != outHeader.ItemNum)) {
+                    CMmsgPrint(CMmsgSysError, "Output writing error in: %s:%d", __FILE__, __LINE__);
+                    goto Stop;
+                }
+            }
+        }
+        else {
+            for (i = 0; i < itemNum; i++) _CMDsketchCumulate(sketches + i);
+            rewind(inFile);
+            while (MFdsHeaderRead (&header, inFile) == CMsucceeded) {
+                if ((int) fread(items, itemSize, itemNum, inFile) != itemNum) {
+                    CMmsgPrint(CMmsgSysError, "Input reading error in: %s:%d", __FILE__, __LINE__);
+                    goto Stop;
+                }
+                for (i = 0; i < itemNum; i++)
+                    output[i] = _CMDitemValue(&header, items, i, &value) ? _CMDsketchExceedance(sketches + i, value) : outHeader.Missing.Float;
+                strcpy(outHeader.Date, header.Date);
+                if ((MFdsHeaderWrite (&outHeader, outFile) != CMsucceeded) ||
+                    ((int) fwrite(output, sizeof(float), outHeader.ItemNum, outFile) != outHeader.ItemNum)) {
+                    CMmsgPrint(CMmsgSysError, "Output writing error in: %s:%d", __FILE__, __LINE__);
+                    goto Stop;
+                }
+            }
+        }
+        ret = CMsucceeded;
         goto Stop;
     }
 
@@ -265,7 +502,7 @@ Help:   if (CMargTest(argv[argPos], "-h", "--help")) {
                 if (CMmathEqualValues(binSize, 0.0)) output[i] = min[i];
                 else {
                     for (bin = 0; bin < binNum; ++bin) {
-                        percentMin = bins[bin * header.ItemNum + i] / bins[i] * 100.0;
+                        percentMin = (double) bins[bin * header.ItemNum + i] / (double) bins[i] * 100.0;
                         if ((float) percent > percentMin) break;
                     }
                     binMax = bin < binNum ? (float) bin * binSize + min[i] : max[i];
@@ -275,7 +512,7 @@ Help:   if (CMargTest(argv[argPos], "-h", "--help")) {
                 }
             }
             snprintf(outHeader.Date, sizeof(outHeader.Date), "%3d", percent + 1);
-            if (MFdsHeaderWrite (&outHeader, outFile) == CMsucceeded) {
+            if (MFdsHeaderWrite (&outHeader, outFile) != CMsucceeded) {
                 CMmsgPrint(CMmsgSysError, "Output writing error in: %s:%d", __FILE__, __LINE__);
                 goto Stop;
             }
@@ -357,7 +594,7 @@ Help:   if (CMargTest(argv[argPos], "-h", "--help")) {
                     break;
             }
             strcpy(outHeader.Date, header.Date);
-            if (MFdsHeaderWrite(&outHeader, outFile) == CMsucceeded) {
+            if (MFdsHeaderWrite(&outHeader, outFile) != CMsucceeded) {
                 CMmsgPrint(CMmsgSysError, "Output writing error in: %s:%d", __FILE__, __LINE__);
                 goto Stop;
             }
@@ -376,7 +613,16 @@ Help:   if (CMargTest(argv[argPos], "-h", "--help")) {
     if (items != (void *) NULL) free(items);
     if (max != (double *) NULL) free(max);
     if (min != (double *) NULL) free(min);
-    if (inFile != (FILE *) NULL) fclose(inFile);
+    if (output != (float *) NULL) free(output);
+    if (bins != (int *) NULL) free(bins);
+    if (sketches != (_CMDsketch_t *) NULL) {
+        for (i = 0; i < itemNum; i++) {
+            if (sketches[i].Positive.Counts != (unsigned int *) NULL) free(sketches[i].Positive.Counts);
+            if (sketches[i].Negative.Counts != (unsigned int *) NULL) free(sketches[i].Negative.Counts);
+        }
+        free(sketches);
+    }
+    if (inFile != (FILE *) NULL) { if (inPipe) pclose(inFile); else if (inFile != stdin) fclose(inFile); }
     if (outFile != stdout) fclose(outFile);
     return (ret);
 }
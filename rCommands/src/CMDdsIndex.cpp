@@ -0,0 +1,58 @@
+/******************************************************************************
+
+GHAAS RiverGIS Utilities V3.0
+Global Hydrological Archive and Analysis System
+Copyright 1994-2024, UNH - CCNY
+
+CMDdsIndex.cpp
+
+bfekete@ccny.cuny.edu
+
+*******************************************************************************/
+
+#include <cm.h>
+#include <MF.h>
+#include <string.h>
+
+static void _CMDprintUsage (const char *arg0) {
+    CMmsgPrint(CMmsgInfo, "%s [options] <datastream1> <datastream2> ... <datastreamN>", CMfileName(arg0));
+    CMmsgPrint(CMmsgInfo, "  -h, --help");
+}
+
+int main(int argc, char *argv[]) {
+    int argPos = 0, argNum = argc, ret = CMsucceeded;
+    FILE *inFile;
+    MFdsIndex_p index;
+
+    if (argNum < 2) { _CMDprintUsage (argv[0]); return (CMsucceeded); }
+
+    for (argPos = 1; argPos < argNum;) {
+        if (CMargTest(argv[argPos], "-h", "--help")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) < argPos) break;
+            _CMDprintUsage (argv[0]);
+            return (CMsucceeded);
+        }
+        if ((argv[argPos][0] == '-') && (strlen(argv[argPos]) > 1)) {
+            CMmsgPrint(CMmsgUsrError, "Unknown option: %s!", argv[argPos]);
+            return (CMfailed);
+        }
+        argPos++;
+    }
+
+    for (argPos = 1; argPos < argNum; ++argPos) {
+        if ((inFile = fopen(argv[argPos], "r")) == (FILE *) NULL) {
+            CMmsgPrint(CMmsgSysError, "Data stream [%s] opening error!", argv[argPos]);
+            ret = CMfailed;
+            continue;
+        }
+        if (((index = MFdsIndexScan(inFile)) == (MFdsIndex_p) NULL) || (MFdsIndexSave(index, argv[argPos]) == CMfailed)) {
+            CMmsgPrint(CMmsgUsrError, "Data stream [%s] indexing error!", argv[argPos]);
+            ret = CMfailed;
+        }
+        else CMmsgPrint(CMmsgInfo, "%s: %d records [%s - %s]", argv[argPos], index->RecordNum,
+                        index->RecordNum > 0 ? index->Dates[0] : "", index->RecordNum > 0 ? index->Dates[index->RecordNum - 1] : "");
+        MFdsIndexFree(index);
+        fclose(inFile);
+    }
+    return (ret);
+}
@@ -22,6 +22,7 @@ static void _CMDprintUsage (const char *arg0) {
     CMmsgPrint(CMmsgInfo, "  -D, --domainfile <filename>");
     CMmsgPrint(CMmsgInfo, "  -M, --mapper     <filename>");
     CMmsgPrint(CMmsgInfo, "  -o, --output     <filename>");
+    CMmsgPrint(CMmsgInfo, "  -b, --begin      [start date in the form of \"yyyy-mm-dd\"]");
     CMmsgPrint(CMmsgInfo, "  -t, --title       [dataset title]");
     CMmsgPrint(CMmsgInfo, "  -u, --subject     [subject]");
     CMmsgPrint(CMmsgInfo, "  -d, --domain      [domain]");
@@ -47,10 +48,12 @@ int main(int argc, char *argv[]) {
     char *domainFileName = (char *) NULL, *mapperFileName = (char *) NULL, *outFileName = (char *) NULL;
     char *title  = (char *) NULL, *subject = (char *) NULL;
     char *domain = (char *) NULL, *version = (char *) NULL;
+    const char *begin = (char *) NULL;
     DBDate date;
     MFDomain_p domainPTR = (MFDomain_p) NULL;
     MFMapper_p mapperPTR = (MFMapper_p) NULL;
     MFdsHeader_t header;
+    MFdsIndex_p index;
     MFMapperStats_p mapperStats;
     DBObjData  *data = (DBObjData *) NULL;
     DBObjTable *table;
@@ -94,6 +97,15 @@ int main(int argc, char *argv[]) {
             if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
             continue;
         }
+        if (CMargTest(argv[argPos], "-b", "--begin")) {
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing start date!");
+                return (CMfailed);
+            }
+            begin = argv[argPos];
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
         if (CMargTest (argv[argPos], "-t", "--title")) {
             if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
                 CMmsgPrint(CMmsgUsrError, "Missing title!");
@@ -236,7 +248,18 @@ int main(int argc, char *argv[]) {
             goto Stop;
         }
 
+        if ((begin != (char *) NULL) && (inFile != stdin) && !compressed && ((index = MFdsIndexLoad(argv[argPos])) != (MFdsIndex_p) NULL)) {
+            if (MFdsIndexSeek(index, inFile, begin) == CMfailed) CMmsgPrint(CMmsgWarning, "Ignoring mismatching date index of [%s]!", argv[argPos]);
+            MFdsIndexFree(index);
+        }
         while (MFdsHeaderRead(&header, inFile) == CMsucceeded) {
+            if ((begin != (char *) NULL) && (MFDateCompare(header.Date, begin) < 0)) {
+                if (MFdsRecordSkip(&header, inFile) == CMfailed) {
+                    CMmsgPrint(CMmsgSysError, "Data stream reading error in: %s:%d", __FILE__, __LINE__);
+                    goto Stop;
+                }
+                continue;
+            }
             if (header.ItemNum != mapperPTR->ObjNum) {
                 CMmsgPrint(CMmsgUsrError, "Data stream [%d] and mapperPTR [%d] missmatch!", header.ItemNum, mapperPTR->ObjNum);
                 goto Stop;
@@ -201,6 +201,7 @@ private:
     DBObjectLIST<DBObject> *Variables;
     DBObjTable *Table;
     DBMathOperand *Operand;
+    DBMathProgram Program;
 public:
     CMDgrdThreadData() {
         Expressions = (CMDExpression **) NULL;
@@ -284,6 +285,7 @@ public:
 
         for (i = 0; i < ExpNum; ++i) if (Expressions[i]->Configure(Table) == DBFault) return (CMfailed);
         Operand->Configure(Table->Fields());
+        Program.Compile(Operand, DBVariableFloat);
 
         if (data != (DBObjData *) NULL) {
             switch (data->Type ()) {
@@ -317,7 +319,6 @@ public:
         DBInt i, layerID, dataLayerID;
         size_t threadId;
         DBPosition pos;
-        DBCoordinate coord;
         char *layerName;
         DBObjData *data;
         DBObjRecord *record;
@@ -328,7 +329,7 @@ public:
         if ((data = DBGridCreate(title, Extent, CellSize)) == (DBObjData *) NULL) return ((DBObjData *) NULL);
         data->Projection(GrdVar[0]->Projection()); // Taking projection from first grid variable
         GridIF = new DBGridIF(data);
-        taskNum = GridIF->RowNum() * (size_t) GridIF->ColNum();
+        taskNum = GridIF->RowNum(); // One task per grid row
         if (team->ThreadNum > 1) { job = CMthreadJobCreate(taskNum, userFunc, (void *) this); }
         if (job != (CMthreadJob_p) NULL) {
             for (threadId = 0; threadId < team->ThreadNum; ++threadId) {
@@ -356,13 +357,7 @@ public:
 
             if (job != (CMthreadJob_p) NULL) CMthreadJobExecute(team, job);
             else {
-                for (pos.Row = 0; pos.Row < GridIF->RowNum(); ++pos.Row)
-                    for (pos.Col = 0; pos.Col < GridIF->ColNum(); ++pos.Col) {
-                        GridIF->Pos2Coord(pos, coord);
-                        for (i = 0; i < (DBInt) VarNum; ++i) GrdVar[i]->GetVariable(record, coord);
-                        for (i = 0; i < (DBInt) ExpNum; ++i) Expressions[i]->Evaluate(record);
-                        GridIF->Value(LayerRec, pos, Operand->Float(record));
-                    }
+                for (pos.Row = 0; pos.Row < GridIF->RowNum(); ++pos.Row) ComputeTask(record, pos.Row);
             }
             GridIF->RecalcStats(LayerRec);
         }
@@ -375,13 +370,13 @@ public:
         DBPosition pos;
         DBCoordinate coord;
 
-        pos.Row = taskId / GridIF->ColNum();
-        pos.Col = taskId % GridIF->ColNum();
-
-        GridIF->Pos2Coord(pos, coord);
-        for (i = 0; i < VarNum; ++i) GrdVar[i]->GetVariable(record, coord);
-        for (i = 0; i < ExpNum; ++i) Expressions[i]->Evaluate(record);
-        GridIF->Value(LayerRec, pos, Operand->Float(record));
+        pos.Row = taskId;
+        for (pos.Col = 0; pos.Col < GridIF->ColNum(); ++pos.Col) {
+            GridIF->Pos2Coord(pos, coord);
+            for (i = 0; i < VarNum; ++i) GrdVar[i]->GetVariable(record, coord);
+            for (i = 0; i < ExpNum; ++i) Expressions[i]->Evaluate(record);
+            GridIF->Value(LayerRec, pos, Program.Mode() != DBFault ? Program.Float(record) : Operand->Float(record));
+        }
     }
 };
 
@@ -18,6 +18,7 @@ bfekete@ccny.cuny.edu
 static void _CMDprintUsage (const char *arg0) {
     CMmsgPrint(CMmsgInfo, "%s [options] <input rgisdata> <output domain>", CMfileName(arg0));
     CMmsgPrint(CMmsgInfo, "     -l, --lengthcorrection");
+    CMmsgPrint(CMmsgInfo, "     -f, --format [linked|flat]");
     CMmsgPrint(CMmsgInfo, "     -h, --help");
 }
 
@@ -26,6 +27,7 @@ int main(int argc, char *argv[]) {
     DBInt argPos, argNum = argc, ret;
     int objID, size;
     DBFloat lCorrection = 1.0;
+    bool flat = false;
     MFDomain_t *domain = (MFDomain_t *) NULL;
     DBCoordinate coord;
     DBObjRecord *objRec;
@@ -44,6 +46,22 @@ int main(int argc, char *argv[]) {
             if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
             continue;
         }
+        if (CMargTest (argv[argPos], "-f", "--format")) {
+            int format;
+            const char *formats[] = {"linked", "flat", (char *) NULL};
+
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) {
+                CMmsgPrint(CMmsgUsrError, "Missing domain format!");
+                return (CMfailed);
+            }
+            if ((format = CMoptLookup(formats, argv[argPos], true)) == CMfailed) {
+                CMmsgPrint(CMmsgUsrError, "Invalid domain format!");
+                return (CMfailed);
+            }
+            flat = format == 1;
+            if ((argNum = CMargShiftLeft(argPos, argv, argNum)) <= argPos) break;
+            continue;
+        }
         if (CMargTest (argv[argPos], "-h", "--help")) {
             _CMDprintUsage(argv[0]);
             return (DBSuccess);
@@ -165,7 +183,7 @@ int main(int argc, char *argv[]) {
                 delete netIF;
             } break;
         }
-        ret = MFDomainWrite(domain, outFile);
+        ret = flat ? MFDomainWriteFlat(domain, outFile) : MFDomainWrite(domain, outFile);
     }
     Stop:
     delete data;
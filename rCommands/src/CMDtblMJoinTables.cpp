@@ -278,39 +278,49 @@ int main(int argc, char *argv[]) {
     }
 
 /* Search for matches and create output table*************/
-    for (int joinRecID = 0; joinRecID < joinTable->ItemNum(); ++joinRecID)
-//	for (int joinRecID = joinTable->ItemNum() - 1;joinRecID != -1;++joinRecID) // use this line when multiple matches add LAST found
-    {
-        joinRecord = joinTable->Item(joinRecID);
-        for (int relateRecID = 0; relateRecID < relateTable->ItemNum(); ++relateRecID) {
-            relateRecord = relateTable->Item(relateRecID);
+    // The nested loop copied every matching join record in turn, so the last match (highest join row) is indexed
+    DBObjTableField **joinFLDs = (DBObjTableField **) calloc(numGrps + 1, sizeof(DBObjTableField *));
+    DBObjTableField **relateFLDs = (DBObjTableField **) calloc(numGrps + 1, sizeof(DBObjTableField *));
+    if ((joinFLDs == (DBObjTableField **) NULL) || (relateFLDs == (DBObjTableField **) NULL)) {
+        CMmsgPrint(CMmsgSysError, "Memory Allocation Error in: %s %d", __FILE__, __LINE__);
+        return (CMfailed);
+    }
+    for (int i = 0; i < numGrps; i++) {
+        joinFLDs[i] = groups[i]->joinFLD;
+        relateFLDs[i] = groups[i]->relateFLD;
+    }
+    DBTableFieldMatchIndex *matchIndex = new DBTableFieldMatchIndex(numGrps, joinFLDs, relateFLDs, 0);
+    if (matchIndex->Build(joinTable, false, false) != DBSuccess) {
+        CMmsgPrint(CMmsgAppError, "Join index error in: %s %d", __FILE__, __LINE__);
+        return (CMfailed);
+    }
+    for (int relateRecID = 0; relateRecID < relateTable->ItemNum(); ++relateRecID) {
+        relateRecord = relateTable->Item(relateRecID);
+        if ((joinRecord = matchIndex->Find(relateRecord)) != (DBObjRecord *) NULL) {
             int i = 0;
-            while (i < numGrps &&
-                   DBTableFieldMatch(groups[i]->joinFLD, joinRecord, groups[i]->relateFLD, relateRecord))
-                i++;
-            if (i == numGrps) {
-                i = 0;
-                while (i < numFlds) {
-                    if (fields[i]->relateFLD->Required()) continue; // We don't want to overwrite protected fields.
-                    switch (fields[i]->relateFLD->Type()) {
-                        case DBTableFieldInt:
-                            fields[i]->relateFLD->Int(relateRecord, fields[i]->joinFLD->Int(joinRecord));
-                            break;
-                        case DBTableFieldString:
-                            fields[i]->relateFLD->String(relateRecord, fields[i]->joinFLD->String(joinRecord));
-                            break;
-                        case DBTableFieldFloat:
-                            fields[i]->relateFLD->Float(relateRecord, fields[i]->joinFLD->Float(joinRecord));
-                            break;
-                        case DBTableFieldDate:
-                            fields[i]->relateFLD->Date(relateRecord, fields[i]->joinFLD->Date(joinRecord));
-                            break;
-                    }
-                    i++;
+            while (i < numFlds) {
+                if (fields[i]->relateFLD->Required()) continue; // We don't want to overwrite protected fields.
+                switch (fields[i]->relateFLD->Type()) {
+                    case DBTableFieldInt:
+                        fields[i]->relateFLD->Int(relateRecord, fields[i]->joinFLD->Int(joinRecord));
+                        break;
+                    case DBTableFieldString:
+                        fields[i]->relateFLD->String(relateRecord, fields[i]->joinFLD->String(joinRecord));
+                        break;
+                    case DBTableFieldFloat:
+                        fields[i]->relateFLD->Float(relateRecord, fields[i]->joinFLD->Float(joinRecord));
+                        break;
+                    case DBTableFieldDate:
+                        fields[i]->relateFLD->Date(relateRecord, fields[i]->joinFLD->Date(joinRecord));
+                        break;
                 }
+                i++;
             }
         }
     }
+    delete matchIndex;
+    free(joinFLDs);
+    free(relateFLDs);
 
     if (ascii) DBExportASCIITable(relateTable, outFile); else relateData->Write(outFile);
 
@@ -1,41 +1,132 @@
+#include <stdlib.h>
+#include <string.h>
 #include <cm.h>
+#include <MF.h>
 
 static size_t _Iteration = 1000000;
+static size_t _TaskNum   = 10000;
+static size_t _Skew      = 1;
+static size_t _Spread    = 0;
+static size_t _Loop      = 0;
+static size_t *_DownLinks = (size_t *) NULL;
+static size_t *_Stamps    = (size_t *) NULL;
+static size_t  _Violations = 0;
 
 static void _UserFunc(size_t threadId, size_t taskId, void *commonPtr) {
-    size_t count;
-    for (count = 0; count < _Iteration; count++);
+    size_t count, iteration;
+    // A sixteenth of the tasks carries _Skew times more work to mimic reservoir, irrigation or thermal-plant cells:
+    // the first sixteenth (all in thread 0's static chunk) or every sixteenth task when spread
+    iteration = (_Spread ? (taskId % 16) == 0 : taskId < _TaskNum / 16) ? _Iteration * _Skew : _Iteration;
+    for (count = 0; count < iteration; count++) __asm__ __volatile__ ("");
+    if (_DownLinks != (size_t *) NULL) {
+        // A downstream task that already ran in this loop means the dependency was not honoured
+        if ((_DownLinks [taskId] != taskId) && (_Stamps [_DownLinks [taskId]] == _Loop + 1)) __atomic_add_fetch (&_Violations, 1, __ATOMIC_RELAXED);
+        _Stamps [taskId] = _Loop + 1;
+    }
 }
 
-int main(int argv, char *argc[]) {
-    int ret, threadNum = 1;
-    size_t loopNum = 2, timeLoop, taskNum = 10000, taskId;
-    size_t _taskId, _taskNum;
+int main(int argc, char *argv[]) {
+    int ret, fields, threadNum = 1;
+    size_t loopNum = 2, window = 0, taskId;
+    unsigned long seed = 1;
+    char layout [16], *end;
+    const char *layouts[] = {"block", "spread", (char *) NULL};
+    CMthreadSchedule schedule = CMthreadScheduleStatic;
     CMthreadTeam_p team = (CMthreadTeam_p) NULL;
     CMthreadJob_p job;
+    FILE *reportFile = (FILE *) NULL, *inFile;
+    MFDomain_p domain = (MFDomain_p) NULL;
 
-    if ((argv > 1) && (sscanf(argc[1], "%d", &ret) == 1)) threadNum = (size_t) ret > 0 ? ret : 1;
-    if ((argv > 2) && (sscanf(argc[2], "%d", &ret) == 1)) taskNum = (size_t) ret;
-    if ((argv > 3) && (sscanf(argc[3], "%d", &ret) == 1)) _Iteration = (size_t) ret;
-    if ((argv > 4) && (sscanf(argc[4], "%d", &ret) == 1)) loopNum = (size_t) ret;
-    printf("%d %d %d %d\n", (int) threadNum, (int) taskNum, (int) _Iteration, (int) loopNum);
+    if ((argc > 1) && (sscanf(argv[1], "%d", &ret) == 1)) threadNum = (size_t) ret > 0 ? ret : 1;
+    if ((argc > 2) && (sscanf(argv[2], "%d", &ret) == 1)) _TaskNum = (size_t) ret;
+    if ((argc > 3) && (sscanf(argv[3], "%d", &ret) == 1)) _Iteration = (size_t) ret;
+    if ((argc > 4) && (sscanf(argv[4], "%d", &ret) == 1)) loopNum = (size_t) ret;
+    if ((argc > 5) && ((ret = CMoptLookup(CMthreadScheduleStrings, argv[5], true)) != CMfailed)) schedule = (CMthreadSchedule) ret;
+    // Skew factor, optionally followed by the layout of the heavy tasks: 16 or 16,block or 16,spread
+    if ((argc > 6) && ((fields = sscanf(argv[6], "%d,%15s", &ret, layout)) >= 1)) {
+        _Skew = (size_t) ret > 0 ? ret : 1;
+        if ((fields == 2) && ((ret = CMoptLookup(layouts, layout, true)) == CMfailed)) {
+            CMmsgPrint (CMmsgUsrError,"Invalid skew layout [%s]!", layout);
+            return (CMfailed);
+        }
+        _Spread = fields == 2 ? (size_t) ret : 0;
+    }
+    if ((argc > 7) && (strncmp(argv[7], MFfileStr, strlen(MFfileStr)) == 0)) {
+        // A model domain file (file:path) instead of the window: its cells are the tasks and its down links the dependencies
+        if ((inFile = fopen (argv[7] + strlen(MFfileStr), "r")) == (FILE *) NULL) {
+            CMmsgPrint (CMmsgUsrError,"Domain file [%s] opening error!", argv[7] + strlen(MFfileStr));
+            return (CMfailed);
+        }
+        domain = MFDomainRead (inFile);
+        fclose (inFile);
+        if (domain == (MFDomain_p) NULL) return (CMfailed);
+        _TaskNum = (size_t) domain->ObjNum;
+    }
+    else if (argc > 7) {
+        window = (size_t) strtoul(argv[7], &end, 10);
+        if ((end == argv[7]) || (*end != '\0')) {
+            CMmsgPrint (CMmsgUsrError,"Invalid window [%s], domain files are given as %spath!", argv[7], MFfileStr);
+            return (CMfailed);
+        }
+    }
+    if ((argc > 8) && ((reportFile = fopen (argv[8], "w")) == (FILE *) NULL)) {
+        CMmsgPrint (CMmsgUsrError,"Report file [%s] opening error!", argv[8]);
+        return (CMfailed);
+    }
+    printf("%d %d %d %d %s %d,%s %s\n", (int) threadNum, (int) _TaskNum, (int) _Iteration, (int) loopNum, CMthreadScheduleStrings[schedule], (int) _Skew, layouts[_Spread], argc > 7 ? argv[7] : "0");
 
     if ((team = CMthreadTeamCreate (threadNum)) == (CMthreadTeam_p) NULL) {
         CMmsgPrint (CMmsgUsrError,"Team initialization error %s, %d",__FILE__,__LINE__);
         return (CMfailed);
     }
-    if ((job = CMthreadJobCreate(taskNum, _UserFunc, (void *) NULL)) == (CMthreadJob_p) NULL) {
+    CMthreadTeamSetSchedule (team, schedule);
+    if (reportFile != (FILE *) NULL) CMthreadTeamSetProfile (team, true);
+    if ((job = CMthreadJobCreate(_TaskNum, _UserFunc, (void *) NULL)) == (CMthreadJob_p) NULL) {
         CMmsgPrint(CMmsgAppError, "Job creation error in %s:%d", __FILE__, __LINE__);
         CMthreadTeamDelete (team);
         return (CMfailed);
     }
+    if ((window > 0) || (domain != (MFDomain_p) NULL)) {
+        if (((_DownLinks = (size_t *) calloc (_TaskNum, sizeof (size_t))) == (size_t *) NULL) ||
+            ((_Stamps    = (size_t *) calloc (_TaskNum, sizeof (size_t))) == (size_t *) NULL)) {
+            CMmsgPrint (CMmsgSysError, "Memory allocation error in %s:%d", __FILE__, __LINE__);
+            return (CMfailed);
+        }
+    }
+    if (domain != (MFDomain_p) NULL) {
+        for (taskId = 0; taskId < _TaskNum; ++taskId) {
+            _DownLinks [taskId] = domain->Objects [taskId].DLinkNum > 0 ? domain->Objects [taskId].DLinks [0] : taskId;
+            if (domain->Objects [taskId].DLinkNum > 0)
+                CMthreadJobTaskDependent(job, taskId, domain->Objects [taskId].DLinks, domain->Objects [taskId].DLinkNum);
+        }
+    }
+    else if (window > 0) {
+        // Synthetic river network: task 0 is the outlet and every other task drains into one of the window tasks
+        // preceding it, which gives long chains (many travel levels) similar to continental WBM domains.
+        for (taskId = 1; taskId < _TaskNum; ++taskId) {
+            seed = seed * 1103515245 + 12345;
+            _DownLinks [taskId] = taskId - 1 - (size_t) ((seed >> 16) % (taskId < window ? taskId : window));
+            CMthreadJobTaskDependent(job, taskId, _DownLinks + taskId, 1);
+        }
+    }
 
-    for (timeLoop = 0; timeLoop < loopNum; ++timeLoop) {
-        printf("Time %d\n", (int) timeLoop);
+    for (_Loop = 0; _Loop < loopNum; ++_Loop) {
+        printf("Time %d\n", (int) _Loop);
         CMthreadJobExecute(team, job);
     }
+    if (_DownLinks != (size_t *) NULL) {
+        printf("Groups %d Dependency violations %d\n", (int) job->GroupNum, (int) _Violations);
+        free (_DownLinks);
+        free (_Stamps);
+    }
     CMthreadJobDestroy(job);
+    if (domain != (MFDomain_p) NULL) MFDomainFree (domain);
     CMthreadTeamPrintReport (CMmsgInfo, team);
+    if (reportFile != (FILE *) NULL) {
+        // Reports named *.json are written as JSON, anything else as CSV
+        CMthreadTeamWriteReport (team, strstr (argv[8], ".json") != (char *) NULL ? CMthreadReportJSON : CMthreadReportCSV, reportFile);
+        fclose (reportFile);
+    }
     CMthreadTeamDelete(team);
     return (0);
 }